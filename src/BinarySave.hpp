@@ -0,0 +1,480 @@
+#pragma once
+
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <format>
+#include <type_traits>
+#include <bit>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+#include "Logging.hpp"
+#include "Compression.hpp"
+
+
+constexpr uint32_t BINARY_SAVE_VERSION = 2; // Bump whenever a record layout or the section table changes
+constexpr char BINARY_SAVE_MAGIC[8] = {'M', 'E', 'A', 'T', 'S', 'A', 'V', 'E'};
+constexpr uint64_t BINARY_SAVE_ALIGNMENT = 64; // Sections start on cache line boundaries
+
+
+/*
+ * Layout of a binary save, every integer and float is stored little endian as it is in memory:
+ *
+ *   SaveHeader
+ *   SaveSectionEntry[section_count]
+ *   sections, each an array of fixed size records aligned to BINARY_SAVE_ALIGNMENT, optionally compressed
+ *
+ * Version 1 had no encoding and stored size in its section table and is still read.
+ * Unknown section types are skipped when loading, so sections can be added without a version bump.
+ * What goes into each section is up to the caller, see Snapshot.hpp
+ */
+
+
+enum SaveSectionType: uint32_t {
+    GENOME_SECTION,
+    CELL_SECTION,
+    EGG_SECTION,
+    PLANT_SECTION,
+    MEAT_SECTION,
+    NUTRIENT_SECTION,
+    // Checkpoint chains, see Checkpoint.hpp
+    CHECKPOINT_SECTION,
+    CELL_DELTA_SECTION,
+    EGG_DELTA_SECTION,
+    PLANT_DELTA_SECTION,
+    MEAT_DELTA_SECTION,
+    NUTRIENT_DELTA_SECTION,
+    CELL_REMOVED_SECTION,
+    EGG_REMOVED_SECTION,
+    PLANT_REMOVED_SECTION,
+    MEAT_REMOVED_SECTION,
+    NUTRIENT_REMOVED_SECTION,
+    // Tile index for progressive loading, see ProgressiveLoader.hpp
+    TILE_GRID_SECTION,
+    TILE_SECTION,
+    TILE_ORDER_SECTION,
+    // Counters and random generators of the simulation, see Snapshot::has_state
+    STATE_SECTION,
+    RANDOM_STATE_SECTION
+};
+
+enum SaveSectionEncoding: uint32_t {
+    RAW_ENCODING, // Records as they are in memory, can be used straight from the mapping
+    LZ_ENCODING // Compressed with lz_compress()
+};
+
+class SaveHeader {
+public:
+    char magic[8];
+    uint32_t version;
+    uint32_t section_count;
+    uint64_t table_checksum; // Checksum of the section table
+};
+
+class SaveSectionEntry {
+public:
+    uint32_t type;
+    uint32_t record_size; // A mismatch with the loading build's record means the layout changed, e.g. a different brain size
+    uint64_t offset; // From the start of the file
+    uint64_t count;
+    uint64_t checksum; // Of the stored bytes
+    uint32_t encoding;
+    uint32_t padding;
+    uint64_t stored_size;
+};
+
+/**
+ * Section table entry of version 1 saves, always raw
+ */
+class SaveSectionEntryV1 {
+public:
+    uint32_t type;
+    uint32_t record_size;
+    uint64_t offset;
+    uint64_t count;
+    uint64_t checksum;
+};
+
+/**
+ * Section to be written, records are written as they are laid out in memory
+ */
+class SaveSection {
+public:
+    SaveSectionType type;
+    uint32_t record_size;
+    const void* records;
+    uint64_t count;
+    SaveSectionEncoding encoding;
+
+    template<typename Record> static SaveSection of(const SaveSectionType type, const std::vector<Record> &records, const SaveSectionEncoding encoding = RAW_ENCODING) {
+        static_assert(std::is_trivially_copyable_v<Record>);
+        return {type, sizeof(Record), records.data(), records.size(), encoding};
+    }
+};
+
+static_assert(std::is_trivially_copyable_v<SaveHeader> and std::is_trivially_copyable_v<SaveSectionEntry>);
+
+
+/**
+ * 64 bit checksum over four interleaved lanes of 8 byte words, in the style of xxHash64
+ * Not cryptographic, it only has to catch truncated and corrupted files
+ */
+[[nodiscard]] uint64_t save_checksum(const void* data, const size_t size) {
+    constexpr uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+    constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr uint64_t PRIME_3 = 0x165667B19E3779F9ULL;
+    const unsigned char* bytes = (const unsigned char*) data;
+    uint64_t lanes[4] = {PRIME_1 + PRIME_2, PRIME_2, 0, -PRIME_1};
+    size_t index = 0;
+    for (; index + 32 <= size; index += 32) {
+        for (unsigned int lane = 0; lane < 4; lane++) {
+            uint64_t word;
+            std::memcpy(&word, bytes + index + lane * 8, 8);
+            lanes[lane] = std::rotl(lanes[lane] + word * PRIME_2, 31) * PRIME_1;
+        }
+    }
+    uint64_t hash = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18) + size;
+    for (; index < size; index++) {
+        hash = std::rotl(hash ^ (bytes[index] * PRIME_3), 11) * PRIME_1;
+    }
+    hash ^= hash >> 33;
+    hash *= PRIME_2;
+    hash ^= hash >> 29;
+    hash *= PRIME_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+
+/**
+ * Read only view of a whole file, memory mapped where possible
+ * Falls back to reading the file into memory on platforms without mmap
+ */
+class MappedFile {
+private:
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::vector<unsigned char> buffer;
+
+public:
+    MappedFile() = default;
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#if !defined(_WIN32)
+        if (this->mapped) {
+            munmap((void*) this->data, this->size);
+        }
+#endif
+    }
+
+    /**
+     * @return Whether the file could be opened
+     */
+    bool open(const std::filesystem::path &path) {
+#if !defined(_WIN32)
+        const int descriptor = ::open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) {
+            return false;
+        }
+        struct stat status{};
+        if (fstat(descriptor, &status) != 0) {
+            close(descriptor);
+            return false;
+        }
+        this->size = (size_t) status.st_size;
+        if (this->size == 0) {
+            close(descriptor);
+            return true;
+        }
+        void* address = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        close(descriptor);
+        if (address == MAP_FAILED) {
+            return false;
+        }
+        madvise(address, this->size, MADV_SEQUENTIAL);
+        this->data = (const unsigned char*) address;
+        this->mapped = true;
+        return true;
+#else
+        std::ifstream file(path, std::ios::in | std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        this->buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        this->data = this->buffer.data();
+        this->size = this->buffer.size();
+        return true;
+#endif
+    }
+
+    [[nodiscard]] const unsigned char* get_data() const {
+        return this->data;
+    }
+
+    [[nodiscard]] size_t get_size() const {
+        return this->size;
+    }
+};
+
+
+[[nodiscard]] constexpr uint64_t align_save_offset(const uint64_t offset) {
+    return offset + (BINARY_SAVE_ALIGNMENT - offset % BINARY_SAVE_ALIGNMENT) % BINARY_SAVE_ALIGNMENT;
+}
+
+
+/**
+ * Write a binary save, see the layout at the top of this file
+ * Compressed sections that would not get smaller are stored raw
+ * @param path File to write
+ * @param sections Sections in the order they are written
+ * @param written Incremented for every record written, for progress reporting
+ * @return Whether everything was written
+ */
+bool write_binary_save(const std::filesystem::path &path, const std::vector<SaveSection> &sections, std::atomic<size_t> &written) {
+    std::vector<SaveSectionEntry> table;
+    std::vector<std::vector<unsigned char>> compressed(sections.size());
+    std::vector<const void*> stored(sections.size());
+    uint64_t offset = align_save_offset(sizeof(SaveHeader) + sections.size() * sizeof(SaveSectionEntry));
+    for (size_t index = 0; index < sections.size(); index++) {
+        const SaveSection &section = sections[index];
+        SaveSectionEntry entry{};
+        entry.type = section.type;
+        entry.record_size = section.record_size;
+        entry.offset = offset;
+        entry.count = section.count;
+        entry.encoding = RAW_ENCODING;
+        entry.stored_size = section.count * section.record_size;
+        stored[index] = section.records;
+        if (section.encoding == LZ_ENCODING) {
+            compressed[index] = lz_compress(section.records, entry.stored_size);
+            if (compressed[index].size() < entry.stored_size) {
+                entry.encoding = LZ_ENCODING;
+                entry.stored_size = compressed[index].size();
+                stored[index] = compressed[index].data();
+            }
+        }
+        entry.checksum = save_checksum(stored[index], entry.stored_size);
+        table.push_back(entry);
+        offset = align_save_offset(offset + entry.stored_size);
+    }
+
+    SaveHeader header{};
+    std::memcpy(header.magic, BINARY_SAVE_MAGIC, sizeof(header.magic));
+    header.version = BINARY_SAVE_VERSION;
+    header.section_count = (uint32_t) sections.size();
+    header.table_checksum = save_checksum(table.data(), table.size() * sizeof(SaveSectionEntry));
+
+    const char zeros[BINARY_SAVE_ALIGNMENT] = {};
+    std::ofstream file;
+    file.open(path, std::ios::out | std::ios::binary);
+    file.write((const char*) &header, sizeof(SaveHeader));
+    file.write((const char*) table.data(), (std::streamsize) (table.size() * sizeof(SaveSectionEntry)));
+    uint64_t position = sizeof(SaveHeader) + table.size() * sizeof(SaveSectionEntry);
+    for (size_t index = 0; index < sections.size(); index++) {
+        file.write(zeros, (std::streamsize) (table[index].offset - position));
+        file.write((const char*) stored[index], (std::streamsize) table[index].stored_size);
+        written.fetch_add(sections[index].count, std::memory_order_relaxed);
+        position = table[index].offset + table[index].stored_size;
+    }
+    file.close();
+    return !file.fail();
+}
+
+
+/**
+ * Memory maps a binary save and validates its header, section table and checksums
+ * Raw sections are then copied straight out of the mapping and compressed ones decompressed, nothing is parsed
+ */
+class BinarySaveReader {
+private:
+    MappedFile file;
+    std::string path;
+    std::vector<SaveSectionEntry> table;
+
+    /**
+     * Read the section table of either version into this->table
+     */
+    bool read_table(const SaveHeader &header) {
+        const size_t entry_size = header.version == 1 ? sizeof(SaveSectionEntryV1) : sizeof(SaveSectionEntry);
+        if (header.section_count > (this->file.get_size() - sizeof(SaveHeader)) / entry_size) {
+            this->log_error("section table is truncated");
+            return false;
+        }
+        const unsigned char* entries = this->file.get_data() + sizeof(SaveHeader);
+        if (save_checksum(entries, header.section_count * entry_size) != header.table_checksum) {
+            this->log_error("section table failed its checksum, it is corrupted");
+            return false;
+        }
+        this->table.resize(header.section_count);
+        if (header.version != 1) {
+            std::memcpy(this->table.data(), entries, header.section_count * entry_size);
+            return true;
+        }
+        for (uint32_t index = 0; index < header.section_count; index++) {
+            SaveSectionEntryV1 entry;
+            std::memcpy(&entry, entries + index * entry_size, entry_size);
+            this->table[index] = {entry.type, entry.record_size, entry.offset, entry.count, entry.checksum, RAW_ENCODING, 0, entry.count * entry.record_size};
+        }
+        return true;
+    }
+
+public:
+    BinarySaveReader() = default;
+
+    void log_error(const std::string &message) const {
+        Log::get_instance().log(Log::CRITICAL, "Binary Save", std::format("{}: {}", this->path, message));
+    }
+
+    /**
+     * @return Whether the stored bytes of a section match its checksum
+     */
+    [[nodiscard]] bool verify(const SaveSectionEntry &entry) const {
+        return save_checksum(this->file.get_data() + entry.offset, entry.stored_size) == entry.checksum;
+    }
+
+    /**
+     * @param verify_sections Whether to checksum every section, which reads the whole file. Without it only the header
+     * and section table are checked and the caller has to verify what it uses, see verify_section()
+     * @return Whether the file is an intact save of a supported version
+     */
+    bool open(const std::filesystem::path &_path, const bool verify_sections = true) {
+        this->path = _path.string();
+        if (!this->file.open(_path)) {
+            this->log_error("could not open file");
+            return false;
+        }
+        if (this->file.get_size() < sizeof(SaveHeader)) {
+            this->log_error("file is too short to be a save");
+            return false;
+        }
+        SaveHeader header;
+        std::memcpy(&header, this->file.get_data(), sizeof(SaveHeader));
+        if (std::memcmp(header.magic, BINARY_SAVE_MAGIC, sizeof(header.magic)) != 0) {
+            this->log_error("not a binary save");
+            return false;
+        }
+        if (header.version == 0 or header.version > BINARY_SAVE_VERSION) {
+            this->log_error(std::format("save version {} is not supported, this build reads up to version {}", header.version, BINARY_SAVE_VERSION));
+            return false;
+        }
+        if (!this->read_table(header)) {
+            return false;
+        }
+        for (const SaveSectionEntry &entry: this->table) {
+            const bool valid_size = entry.record_size != 0 and entry.count <= UINT64_MAX / entry.record_size and (entry.encoding == LZ_ENCODING or entry.stored_size == entry.count * entry.record_size);
+            if (!valid_size or entry.encoding > LZ_ENCODING) {
+                this->log_error(std::format("section {} has an invalid size or encoding", entry.type));
+                return false;
+            }
+            if (entry.offset > this->file.get_size() or entry.stored_size > this->file.get_size() - entry.offset) {
+                this->log_error(std::format("section {} runs past the end of the file, it is truncated", entry.type));
+                return false;
+            }
+            if (verify_sections and !this->verify(entry)) {
+                this->log_error(std::format("section {} failed its checksum, it is corrupted", entry.type));
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Checksum one section, for files opened without verifying their sections
+     * @return Whether the section is absent or intact, failures are logged
+     */
+    [[nodiscard]] bool verify_section(const SaveSectionType type) const {
+        for (const SaveSectionEntry &entry: this->table) {
+            if (entry.type == type and !this->verify(entry)) {
+                this->log_error(std::format("section {} failed its checksum, it is corrupted", entry.type));
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Point straight into the mapping at a raw section's records, nothing is copied or checked beyond the sizes
+     * The records stay valid as long as the reader
+     * @return Whether the section is absent (read as empty) or raw with records of this build's size
+     */
+    template<typename Record> bool view_section(const SaveSectionType type, const Record* &records, uint64_t &count) const {
+        static_assert(std::is_trivially_copyable_v<Record>);
+        records = nullptr;
+        count = 0;
+        for (const SaveSectionEntry &entry: this->table) {
+            if (entry.type != type) {
+                continue;
+            }
+            if (entry.record_size != sizeof(Record) or entry.encoding != RAW_ENCODING) {
+                this->log_error(std::format("section {} can't be viewed in place, it has {} byte records with encoding {}", entry.type, entry.record_size, entry.encoding));
+                return false;
+            }
+            records = (const Record*) (this->file.get_data() + entry.offset);
+            count = entry.count;
+            return true;
+        }
+        return true;
+    }
+
+    /**
+     * Copy a section's records out of the file, only call after open() succeeded
+     * A missing section is not an error, it is read as empty
+     * @return Whether the section is absent or was read completely
+     */
+    template<typename Record> bool read_section(const SaveSectionType type, std::vector<Record> &records) const {
+        static_assert(std::is_trivially_copyable_v<Record>);
+        records.clear();
+        for (const SaveSectionEntry &entry: this->table) {
+            if (entry.type != type) {
+                continue;
+            }
+            if (entry.record_size != sizeof(Record)) {
+                this->log_error(std::format("section {} has {} byte records, this build expects {}", entry.type, entry.record_size, sizeof(Record)));
+                return false;
+            }
+            if (entry.encoding == LZ_ENCODING and entry.count > entry.stored_size * 255 / sizeof(Record) + 1) {
+                this->log_error(std::format("section {} claims more records than its compressed size allows", entry.type));
+                return false;
+            }
+            records.resize(entry.count);
+            const unsigned char* stored = this->file.get_data() + entry.offset;
+            if (entry.encoding == RAW_ENCODING) {
+                std::memcpy((void*) records.data(), stored, entry.stored_size);
+                return true;
+            }
+            if (!lz_decompress(stored, entry.stored_size, (unsigned char*) records.data(), entry.count * sizeof(Record))) {
+                this->log_error(std::format("section {} could not be decompressed, it is corrupted", entry.type));
+                records.clear();
+                return false;
+            }
+            return true;
+        }
+        return true;
+    }
+
+    /**
+     * @return Whether the file has a section of this type
+     */
+    [[nodiscard]] bool has_section(const SaveSectionType type) const {
+        return std::any_of(this->table.begin(), this->table.end(), [type](const SaveSectionEntry &entry) {
+            return entry.type == type;
+        });
+    }
+};
@@ -21,17 +21,17 @@ public:
     }
     void wrap_position() {
         if (WRAP_POSITION) {
-            if (this->position.x > HALF_MAP_SIZE) {
-                this->position.x -= MAP_SIZE;
+            if (this->position.x > HALF_WORLD_SIZE) {
+                this->position.x -= WORLD_SIZE;
             }
-            else if (this->position.x < -HALF_MAP_SIZE) {
-                this->position.x += MAP_SIZE;
+            else if (this->position.x < -HALF_WORLD_SIZE) {
+                this->position.x += WORLD_SIZE;
             }
-            if (this->position.y > HALF_MAP_SIZE) {
-                this->position.y -= MAP_SIZE;
+            if (this->position.y > HALF_WORLD_SIZE) {
+                this->position.y -= WORLD_SIZE;
             }
-            else if (this->position.y < -HALF_MAP_SIZE) {
-                this->position.y += MAP_SIZE;
+            else if (this->position.y < -HALF_WORLD_SIZE) {
+                this->position.y += WORLD_SIZE;
             }
         }
     }
@@ -54,10 +54,10 @@ public:
     [[nodiscard]] float get_radius() const {
         return this->radius;
     }
-    [[nodiscard]] virtual Color get_color() {
+    [[nodiscard]] Color get_color() const {
         return WHITE;
     }
-    virtual void draw() {
+    void draw() const {
         DrawCircle((int) std::round(this->position.x), (int) std::round(this->position.y) , this->radius, this->get_color());
     }
 };
@@ -0,0 +1,122 @@
+#pragma once
+
+
+#include <chrono>
+#include <string>
+#include <format>
+
+
+#include "ThreadSafety.hpp"
+
+
+constexpr bool BRAIN_MEMOIZATION = false; // Skip the forward pass when a brain's inputs are bit for bit the same as last pass
+constexpr unsigned int BRAIN_CACHE_SAMPLE_PERIOD = 64; // Every this many passes is timed to estimate the time saved
+constexpr unsigned int BRAIN_CACHE_LOG_PERIOD = 1000; // Ticks between brain cache statistics logs
+
+
+/**
+ * Hit/miss counters of the brain cache
+ * Every thread counts into its own copy, see local(), which is added to the global totals once per tick
+ * Time saved is estimated from a sample of timed passes: hits * (average miss time - average hit time)
+ */
+class BrainCacheStatistics {
+private:
+    unsigned long passes_until_sample = 0;
+
+public:
+    unsigned long hits = 0;
+    unsigned long misses = 0;
+    unsigned long sampled_hits = 0;
+    unsigned long sampled_misses = 0;
+    double sampled_hit_seconds = 0;
+    double sampled_miss_seconds = 0;
+
+    /**
+     * Counters of the calling thread
+     */
+    [[nodiscard]] static BrainCacheStatistics& local() {
+        thread_local BrainCacheStatistics statistics;
+        return statistics;
+    }
+
+    /**
+     * Totals of every thread, updated by flush_local()
+     */
+    [[nodiscard]] static ThreadSafe<BrainCacheStatistics>& global() {
+        static ThreadSafe<BrainCacheStatistics> statistics;
+        return statistics;
+    }
+
+    /**
+     * Add the calling thread's counters to the global totals and reset them
+     */
+    static void flush_local() {
+        BrainCacheStatistics &statistics = BrainCacheStatistics::local();
+        ThreadSafe<BrainCacheStatistics> &totals = BrainCacheStatistics::global();
+        totals.manual_lock();
+        BrainCacheStatistics _totals = totals.unsafe_get_data();
+        _totals.add(statistics);
+        totals.unsafe_set_data(_totals);
+        totals.manual_unlock();
+        const unsigned long passes_until_sample = statistics.passes_until_sample;
+        statistics = BrainCacheStatistics();
+        statistics.passes_until_sample = passes_until_sample;
+    }
+
+    void add(const BrainCacheStatistics &other) {
+        this->hits += other.hits;
+        this->misses += other.misses;
+        this->sampled_hits += other.sampled_hits;
+        this->sampled_misses += other.sampled_misses;
+        this->sampled_hit_seconds += other.sampled_hit_seconds;
+        this->sampled_miss_seconds += other.sampled_miss_seconds;
+    }
+
+    /**
+     * Whether the next pass should be timed
+     */
+    [[nodiscard]] bool should_sample() {
+        if (this->passes_until_sample == 0) {
+            this->passes_until_sample = BRAIN_CACHE_SAMPLE_PERIOD;
+            return true;
+        }
+        this->passes_until_sample--;
+        return false;
+    }
+
+    void record_hit(const bool sampled, const std::chrono::steady_clock::time_point start) {
+        this->hits++;
+        if (sampled) {
+            this->sampled_hits++;
+            this->sampled_hit_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+    void record_miss(const bool sampled, const std::chrono::steady_clock::time_point start) {
+        this->misses++;
+        if (sampled) {
+            this->sampled_misses++;
+            this->sampled_miss_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+    [[nodiscard]] double get_hit_rate() const {
+        if (this->hits + this->misses == 0) {
+            return 0;
+        }
+        return (double) this->hits / (double) (this->hits + this->misses);
+    }
+
+    [[nodiscard]] double get_estimated_seconds_saved() const {
+        if (this->sampled_hits == 0 or this->sampled_misses == 0) {
+            return 0;
+        }
+        const double average_hit_seconds = this->sampled_hit_seconds / (double) this->sampled_hits;
+        const double average_miss_seconds = this->sampled_miss_seconds / (double) this->sampled_misses;
+        return (double) this->hits * (average_miss_seconds - average_hit_seconds);
+    }
+
+    [[nodiscard]] std::string to_string() const {
+        return std::format("Brain cache: {} hits, {} misses, {}% hit rate, ~{} ms saved", this->hits, this->misses, this->get_hit_rate() * 100.0, this->get_estimated_seconds_saved() * 1000.0);
+    }
+};
@@ -4,6 +4,11 @@
 #include <raylib.h>
 #include <utility>
 #include <cassert>
+#include <cstdint>
+#include <memory>
+#include <array>
+#include <algorithm>
+#include <vector>
 
 
 #include "DNA.hpp"
@@ -11,6 +16,7 @@
 #include "Egg.hpp"
 #include "Food.hpp"
 #include "Network.hpp"
+#include "NutrientField.hpp"
 
 
 typedef struct {
@@ -35,9 +41,103 @@ public:
     }
 };
 
+/**
+ * Flat copy of a cell's saved state, see Snapshot.hpp
+ * The genome is shared instead of copied, the brain's weights and biases come from it so only its values are copied
+ */
+class CellRecord {
+public:
+    unsigned long id;
+    float radius;
+    Vector2 position;
+    float energy;
+    float base_energy;
+    unsigned long age;
+    std::shared_ptr<DNA_t> dna;
+    std::array<float, Network_t::get_value_count()> brain_values;
+    Vector2 velocity;
+    float angle;
+    float health;
+    float waste;
+    float memory1;
+    float memory2;
+    float memory3;
+    bool want_lay_egg;
+    bool want_eat;
+    bool want_stab;
+    Sensor sensor;
+    Stomach stomach;
+
+    /**
+     * Same text format as a live Cell, with the brain written like Network's operator<<
+     */
+    friend std::ostream &operator<<(std::ostream &stream, const CellRecord &record) {
+        stream << record.id;
+        stream << "\n";
+        stream << record.radius;
+        stream << "\n";
+        stream << record.position.x;
+        stream << "\n";
+        stream << record.position.y;
+        stream << "\n";
+        stream << record.energy;
+        stream << "\n";
+        stream << record.base_energy;
+        stream << "\n";
+        stream << record.age;
+        stream << "\n";
+        stream << record.dna.get();
+        for (float value: record.brain_values) {
+            stream << value;
+            stream << "\n";
+        }
+        record.dna->export_parameters(stream);
+        stream << "\n";
+        stream << record.velocity.x;
+        stream << "\n";
+        stream << record.velocity.y;
+        stream << "\n";
+        stream << record.angle;
+        stream << "\n";
+        stream << record.health;
+        stream << "\n";
+        stream << record.energy;
+        stream << "\n";
+        stream << record.waste;
+        stream << "\n";
+        stream << record.memory1;
+        stream << "\n";
+        stream << record.memory2;
+        stream << "\n";
+        stream << record.memory3;
+        stream << "\n";
+        stream << record.want_lay_egg;
+        stream << "\n";
+        stream << record.want_eat;
+        stream << "\n";
+        stream << record.want_stab;
+        stream << "\n";
+        stream << record.sensor.hit_distance;
+        stream << "\n";
+        stream << record.sensor.hit_red;
+        stream << "\n";
+        stream << record.sensor.hit_green;
+        stream << "\n";
+        stream << record.sensor.hit_blue;
+        stream << "\n";
+        stream << record.stomach.plant_calories;
+        stream << "\n";
+        stream << record.stomach.meat_calories;
+        stream << "\n";
+        return stream;
+    }
+};
+
 class Cell: public Body {
+    friend class CellBatch;
+    friend class ColonyTracker;
 protected:
-    DNA_t* dna;
+    std::shared_ptr<DNA_t> dna;
     Network_t* brain;
     unsigned long age;
     Vector2 velocity;
@@ -54,14 +154,27 @@ protected:
     bool want_stab;
     Sensor sensor;
     Stomach stomach;
+    unsigned int timestep; // Ticks worth of simulation to advance this tick, see LevelOfDetail.hpp
+    float movement; // Decisions from the last think()
+    float strafe_movement;
+    float angular_velocity;
+    unsigned long parent_id = 0; // Cell that laid the egg it hatched from, 0 when unknown, not saved, see Lineage.hpp
+    unsigned long killer_id = 0; // Cell whose stab took the last of its health, 0 if it wasn't killed
+    uint64_t colony_bucket = 0; // Bucket it is listed in and its index there, see ColonyTracker
+    uint32_t colony_slot = 0;
+    // Found in the interaction pass, applied by resolve_targets()
+    std::vector<Cell*> stab_targets;
+    std::vector<Food*> food_targets;
+    std::vector<int> nutrient_targets;
 
 public:
 //    Cell() {}
 
     explicit Cell(Egg* egg) {
         this->id = get_new_id();
+        this->parent_id = egg->get_parent_id();
         this->dna = egg->get_dna();
-        this->brain = new Network_t(this->dna);
+        this->brain = new Network_t(this->dna.get());
         this->age = 0;
         this->waste = 0;
 ;       this->energy = egg->take_energy() - BASE_ENERGY;
@@ -80,72 +193,100 @@ public:
         this->want_stab = false;
         this->sensor = {0, 0, 0, 0};
         this->stomach = {0, 0};
+        this->timestep = 1;
+        this->movement = 0.0f;
+        this->strafe_movement = 0.0f;
+        this->angular_velocity = 0.0f;
         this->wrap_position();
     }
     
     explicit Cell(std::istream &stream) {
         stream >> this;
+        this->timestep = 1;
+        this->movement = 0.0f;
+        this->strafe_movement = 0.0f;
+        this->angular_velocity = 0.0f;
     }   
 
+    explicit Cell(const CellRecord &record) : Cell(record, new Network_t(record.dna.get())) {}
+
+    /**
+     * @param _brain Brain built from saved parameters, owned by the cell, its values are replaced by the record's
+     */
+    Cell(const CellRecord &record, Network_t* _brain) {
+        this->brain = _brain;
+        this->set_record(record);
+    }
+
     ~Cell() {
-        delete this->dna;
         delete this->brain;
     }
 
+    /**
+     * Take over a record's state, the brain is kept so the record must have the cell's genome
+     */
+    void set_record(const CellRecord &record) {
+        this->id = record.id;
+        this->radius = record.radius;
+        this->position = record.position;
+        this->energy = record.energy;
+        this->base_energy = record.base_energy;
+        this->age = record.age;
+        this->dna = record.dna;
+        this->brain->set_values(record.brain_values.data());
+        this->velocity = record.velocity;
+        this->angle = record.angle;
+        this->health = record.health;
+        this->waste = record.waste;
+        this->memory1 = record.memory1;
+        this->memory2 = record.memory2;
+        this->memory3 = record.memory3;
+        this->want_lay_egg = record.want_lay_egg;
+        this->want_eat = record.want_eat;
+        this->want_stab = record.want_stab;
+        this->sensor = record.sensor;
+        this->stomach = record.stomach;
+        this->killer_id = 0;
+        this->timestep = 1;
+        this->movement = 0.0f;
+        this->strafe_movement = 0.0f;
+        this->angular_velocity = 0.0f;
+    }
+
+    [[nodiscard]] CellRecord get_record() const {
+        CellRecord record;
+        this->copy_record(record);
+        return record;
+    }
+
+    /**
+     * Same as get_record(), into an existing record so the brain values are only copied once
+     */
+    void copy_record(CellRecord &record) const {
+        record.id = this->id;
+        record.radius = this->radius;
+        record.position = this->position;
+        record.energy = this->energy;
+        record.base_energy = this->base_energy;
+        record.age = this->age;
+        record.dna = this->dna;
+        std::copy(this->brain->get_values(), this->brain->get_values() + Network_t::get_value_count(), record.brain_values.begin());
+        record.velocity = this->velocity;
+        record.angle = this->angle;
+        record.health = this->health;
+        record.waste = this->waste;
+        record.memory1 = this->memory1;
+        record.memory2 = this->memory2;
+        record.memory3 = this->memory3;
+        record.want_lay_egg = this->want_lay_egg;
+        record.want_eat = this->want_eat;
+        record.want_stab = this->want_stab;
+        record.sensor = this->sensor;
+        record.stomach = this->stomach;
+    }
+
     friend std::ostream &operator<<(std::ostream &stream, const Cell* cell) {
-        stream << cell->id;
-        stream << "\n";
-        stream << cell->radius;
-        stream << "\n";
-        stream << cell->position.x;
-        stream << "\n";
-        stream << cell->position.y;
-        stream << "\n";
-        stream << cell->energy;
-        stream << "\n";
-        stream << cell->base_energy;
-        stream << "\n";
-        stream << cell->age;
-        stream << "\n";
-        stream << cell->dna;
-        stream << cell->brain;
-        stream << cell->velocity.x;
-        stream << "\n";
-        stream << cell->velocity.y;
-        stream << "\n";
-        stream << cell->angle;
-        stream << "\n";
-        stream << cell->health;
-        stream << "\n";
-        stream << cell->energy;
-        stream << "\n";
-        stream << cell->waste;
-        stream << "\n";
-        stream << cell->memory1;
-        stream << "\n";
-        stream << cell->memory2;
-        stream << "\n";
-        stream << cell->memory3;
-        stream << "\n";
-        stream << cell->want_lay_egg;
-        stream << "\n";
-        stream << cell->want_eat;
-        stream << "\n";
-        stream << cell->want_stab;
-        stream << "\n";
-        stream << cell->sensor.hit_distance;
-        stream << "\n";
-        stream << cell->sensor.hit_red;
-        stream << "\n";
-        stream << cell->sensor.hit_green;
-        stream << "\n";
-        stream << cell->sensor.hit_blue;
-        stream << "\n";
-        stream << cell->stomach.plant_calories;
-        stream << "\n";
-        stream << cell->stomach.meat_calories;
-        stream << "\n";
-        return stream;
+        return stream << cell->get_record();
     }
 
     friend std::istream &operator>>(std::istream &stream, Cell* cell) {
@@ -156,7 +297,7 @@ public:
         stream >> cell->energy;
         stream >> cell->base_energy;
         stream >> cell->age;
-        cell->dna = new DNA_t(stream);
+        cell->dna = std::make_shared<DNA_t>(stream);
         cell->brain = new Network_t(stream);
         stream >> cell->velocity.x;
         stream >> cell->velocity.y;
@@ -179,7 +320,10 @@ public:
         return stream;
     }
 
-    void tick() {
+    /**
+     * Run the brain and decode its outputs into this tick's decisions
+     */
+    void think() {
         this->brain->reset();
 
         this->brain->set_input(0, distance_to_hit_strength(this->sensor.hit_distance));
@@ -194,10 +338,9 @@ public:
 //        this->brain->print_output();
 
 
-        const float movement = (this->brain->get_output(0) - this->brain->get_output(1) / 2.0f) * this->dna->get_speed_multiplier() * SPEED_MULTIPLIER;
-        const float strafe_movement = (this->brain->get_output(2) - this->brain->get_output(3)) * this->dna->get_speed_multiplier() * SPEED_MULTIPLIER;
-        const float angular_velocity = this->brain->get_output(4) * SPEED_ANGULAR_MULTIPLIER - this->brain->get_output(5) * SPEED_ANGULAR_MULTIPLIER;
-        this->angle += angular_velocity * MOVEMENT_MULTIPLIER;
+        this->movement = (this->brain->get_output(0) - this->brain->get_output(1) / 2.0f) * this->dna->get_speed_multiplier() * SPEED_MULTIPLIER;
+        this->strafe_movement = (this->brain->get_output(2) - this->brain->get_output(3)) * this->dna->get_speed_multiplier() * SPEED_MULTIPLIER;
+        this->angular_velocity = this->brain->get_output(4) * SPEED_ANGULAR_MULTIPLIER - this->brain->get_output(5) * SPEED_ANGULAR_MULTIPLIER;
 
         this->memory1 = this->brain->get_output(6);
         this->memory2 = this->brain->get_output(7);
@@ -206,33 +349,47 @@ public:
         this->want_eat = this->brain->get_output(9) > WANT_EAT_THRESHOLD;
         this->want_lay_egg = this->brain->get_output(10) > WANT_EGG_THRESHOLD;
         this->want_stab = this->brain->get_output(11) > WANT_STAB_THRESHOLD;
+    }
+
+    /**
+     * Movement, digestion and energy costs for this tick's decisions
+     * CellBatch does the same thing for many cells at once
+     */
+    void act() {
+        const float timestep = (float) this->timestep;
+        this->angle += this->angular_velocity * MOVEMENT_MULTIPLIER * timestep;
 
         this->angle = wrap_angle(this->angle);
-        this->velocity.x = std::cos(this->angle) * movement * MOVEMENT_MULTIPLIER;
-        this->velocity.y = std::sin(this->angle) * movement * MOVEMENT_MULTIPLIER;
-        this->velocity.x += std::cos(this->angle + HALF_PI) * strafe_movement * MOVEMENT_MULTIPLIER;
-        this->velocity.y += std::sin(this->angle + HALF_PI) * strafe_movement * MOVEMENT_MULTIPLIER;
+        this->velocity.x = std::cos(this->angle) * this->movement * MOVEMENT_MULTIPLIER;
+        this->velocity.y = std::sin(this->angle) * this->movement * MOVEMENT_MULTIPLIER;
+        this->velocity.x += std::cos(this->angle + HALF_PI) * this->strafe_movement * MOVEMENT_MULTIPLIER;
+        this->velocity.y += std::sin(this->angle + HALF_PI) * this->strafe_movement * MOVEMENT_MULTIPLIER;
 
-        this->move(this->velocity);
-        this->digestion();
+        this->move({this->velocity.x * timestep, this->velocity.y * timestep});
+        this->digestion(timestep);
 
         if (this->want_stab) {
-            this->use_energy(STAB_COST_MULTIPLIER);
+            this->use_energy(STAB_COST_MULTIPLIER * timestep);
         }
-        this->use_energy(SIZE_PASSIVE_ENERGY_COST_MULTIPLIER * this->radius * this->radius);
-        this->use_energy(LINEAR_SPEED_ACTIVE_ENERGY_COST_MULTIPLIER * (std::abs(movement) + std::abs(strafe_movement)) * this->radius * this->radius);
-        this->use_energy(ANGULAR_SPEED_ACTIVE_ENERGY_COST_MULTIPLIER * std::abs(angular_velocity) * this->radius * this->radius);
+        this->use_energy(SIZE_PASSIVE_ENERGY_COST_MULTIPLIER * this->radius * this->radius * timestep);
+        this->use_energy(LINEAR_SPEED_ACTIVE_ENERGY_COST_MULTIPLIER * (std::abs(this->movement) + std::abs(this->strafe_movement)) * this->radius * this->radius * timestep);
+        this->use_energy(ANGULAR_SPEED_ACTIVE_ENERGY_COST_MULTIPLIER * std::abs(this->angular_velocity) * this->radius * this->radius * timestep);
         if (this->energy > this->dna->get_max_energy()) {
             this->use_energy(this->energy - this->dna->get_max_energy());
         }
-        this->age++;
+        this->age += this->timestep;
 //        printf("Health: %f, energy: %f, age: %lu\n", this->health, this->energy, this->age);
     }
 
-    void digestion() {
-        const float plant_digestion = std::min(this->stomach.plant_calories * this->dna->metabolism, this->stomach.plant_calories);
+    void tick() {
+        this->think();
+        this->act();
+    }
+
+    void digestion(const float timestep) {
+        const float plant_digestion = std::min(this->stomach.plant_calories * this->dna->metabolism * timestep, this->stomach.plant_calories);
         this->stomach.plant_calories -= plant_digestion;
-        const float meat_digestion = std::min(this->stomach.meat_calories * this->dna->metabolism, this->stomach.meat_calories);
+        const float meat_digestion = std::min(this->stomach.meat_calories * this->dna->metabolism * timestep, this->stomach.meat_calories);
         this->stomach.meat_calories -= meat_digestion;
         const float plant_energy = plant_digestion * PLANT_EFFICIENCY_COEFFICIENT * (1 - this->dna->diet);
         const float plant_waste = plant_digestion - plant_energy;
@@ -259,7 +416,11 @@ public:
     }
 
     void stab(Cell* other_cell) {
-        other_cell->health = std::max(other_cell->health - this->radius * this->radius * this->dna->diet * this->dna->diet * this->dna->diet * COMBAT_DAMAGE_MULTIPLIER, 0.0f);
+        const bool was_alive = other_cell->is_alive();
+        other_cell->health = std::max(other_cell->health - this->radius * this->radius * this->dna->diet * this->dna->diet * this->dna->diet * COMBAT_DAMAGE_MULTIPLIER * (float) this->timestep, 0.0f);
+        if (was_alive and other_cell->is_dead()) {
+            other_cell->killer_id = this->id;
+        }
     }
 
     [[nodiscard]] bool is_alive() const {
@@ -275,11 +436,56 @@ public:
             return nullptr;
         }
         this->use_energy(LAY_EGG_COST);
-        return new Egg(this->dna, this->take_energy(this->dna->egg_energy_transfer), this->position);
+        return new Egg(this->dna, this->take_energy(this->dna->egg_energy_transfer), this->position, this->id);
     }
 
     [[nodiscard]] bool should_lay_egg() const {
-        return this->want_lay_egg;
+        return this->want_lay_egg and this->timestep != 0;
+    }
+
+    void set_timestep(const unsigned int _timestep) {
+        this->timestep = _timestep;
+    }
+
+    [[nodiscard]] unsigned int get_timestep() const {
+        return this->timestep;
+    }
+
+    /**
+     * Remember what the interaction pass found for this cell to stab and eat, nothing changes until resolve_targets()
+     * so that the outcome doesn't depend on how cells are split between threads
+     */
+    void target_stab(Cell* other_cell) {
+        this->stab_targets.push_back(other_cell);
+    }
+
+    void target_food(Food* food) {
+        this->food_targets.push_back(food);
+    }
+
+    void target_nutrients(const int index) {
+        this->nutrient_targets.push_back(index);
+    }
+
+    /**
+     * Stab and eat everything targeted this tick, food that a cell earlier in the order already ate is gone
+     * Only call from one thread, in cell order
+     */
+    void resolve_targets(NutrientField &nutrients) {
+        for (Cell* other_cell: this->stab_targets) {
+            this->stab(other_cell);
+        }
+        for (Food* food: this->food_targets) {
+            if (!food->is_consumed()) {
+                this->consume(food);
+            }
+        }
+        for (const int index: this->nutrient_targets) {
+            this->consume_plant_calories(nutrients.take_calories(index));
+        }
+        this->stab_targets.clear();
+        this->food_targets.clear();
+        this->nutrient_targets.clear();
     }
 
     void consume(Food* food) {
@@ -292,6 +498,10 @@ public:
         food->consume();
     }
 
+    void consume_plant_calories(const float calories) {
+        this->stomach.plant_calories += calories;
+    }
+
     [[nodiscard]] float get_stomach_calories() const {
         return this->stomach.get_total_contents();
     }
@@ -315,7 +525,7 @@ public:
         this->waste += used_energy;
     }
 
-    [[nodiscard]] Color get_color() override {
+    [[nodiscard]] Color get_color() const {
         return this->dna->get_color();
     }
 
@@ -368,6 +578,22 @@ public:
         return this->dna->vision_range;
     }
 
+    [[nodiscard]] float get_angle() const {
+        return this->angle;
+    }
+
+    [[nodiscard]] const std::shared_ptr<DNA_t>& get_dna() const {
+        return this->dna;
+    }
+
+    [[nodiscard]] unsigned long get_parent_id() const {
+        return this->parent_id;
+    }
+
+    [[nodiscard]] unsigned long get_killer_id() const {
+        return this->killer_id;
+    }
+
     void cell_vision(const Sensor _center) {
         this->sensor = _center;
     }
@@ -386,6 +612,10 @@ public:
         return {this->position.x + std::cos(combined_angle) * magnitude, this->position.y + std::sin(combined_angle) * magnitude};
     }
 
+    [[nodiscard]] Vector2 get_direction() const {
+        return {std::cos(this->angle), std::sin(this->angle)};
+    }
+
     Vector2 sensor_ray(const float _angle) {
         return {this->position.x + std::cos(this->angle + _angle) * this->dna->vision_range, this->position.y + std::sin(this->angle + _angle) * this->dna->vision_range};
     }
@@ -404,18 +634,27 @@ public:
         return {true, (float) std::sqrt(std::pow(this->position.x + (t - dt) * dx - this->position.x, 2.0f) + std::pow(this->position.y + (t - dt) * dy - this->position.y, 2.0f))}; //this->get_vision_range() -
     }
 
-    void draw() override {
+    void draw() const {
+        this->draw(this->dna->get_color(255));
+    }
+
+    /**
+     * @param body_color Drawn instead of the genome color, the vision line keeps it
+     */
+    void draw(const Color body_color) const {
         DrawLineV(this->position, this->polar_offset(this->dna->vision_range, 0), this->dna->get_color(VISION_LINE_OPACITY));
         if (this->want_stab) {
             DrawLineEx(this->position, this->polar_offset(this->radius + STAB_REACH, 0), 1.0f, RED);
         }
-        DrawCircleV(this->position, this->radius, this->dna->get_color(255));
+        DrawCircleV(this->position, this->radius, body_color);
     }
 
     void draw_focus_info() {
         Vector2 draw_position = {(.02f * (float) GetScreenWidth()), (.02f * (float) GetScreenHeight())};
         DrawTextEx(GetFontDefault(), TextFormat("Color: (%.0f, %.0f, %.0f)", this->get_red(), this->get_green(), this->get_blue()), draw_position,FONT_SIZE, 1, WHITE);
         draw_position.y += 15;
+        DrawTextEx(GetFontDefault(), TextFormat("Id: %lu  Parent: %lu", this->id, this->parent_id), draw_position,FONT_SIZE, 1, WHITE);
+        draw_position.y += 15;
         DrawTextEx(GetFontDefault(), TextFormat("Health: %.2f / %.2f", this->health, this->dna->get_max_health()), draw_position,FONT_SIZE, 1, WHITE);
         draw_position.y += 15;
         DrawTextEx(GetFontDefault(), TextFormat("Energy: %.2f / %.2f", this->energy, this->dna->get_max_energy()), draw_position,FONT_SIZE, 1, WHITE);
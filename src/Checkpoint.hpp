@@ -0,0 +1,432 @@
+#pragma once
+
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <filesystem>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <format>
+#include <algorithm>
+
+
+#include "Snapshot.hpp"
+#include "BinarySave.hpp"
+#include "Logging.hpp"
+
+
+constexpr bool CHECKPOINT_CHAINS = true; // Autosaves append to a chain of keyframes and deltas instead of writing a full save each time
+constexpr unsigned int CHECKPOINT_KEYFRAME_PERIOD = 16; // Every this many checkpoints is a full keyframe, the ones between are deltas
+constexpr std::string CHECKPOINT_FILE_PREFIX = "checkpoint_";
+constexpr std::string CHECKPOINT_FILE_EXTENSION = ".bin";
+
+
+/*
+ * A checkpoint chain is a directory of binary saves (see BinarySave.hpp) named checkpoint_<sequence>.bin
+ *
+ * A keyframe holds every entity, like a normal binary save. A delta holds, per entity type:
+ *   <type>_DELTA_SECTION: records that are new or changed since the previous checkpoint. Changed records are XORed
+ *       with their previous version after the key, so unchanged fields become zero bytes that compress away
+ *   <type>_REMOVED_SECTION: keys of records that are gone
+ * A delta may also hold a full <type>_SECTION instead, when the change can't be expressed as a delta (duplicate keys
+ * or reordered records), which replaces that type entirely.
+ * Genomes are numbered from the keyframe on and every checkpoint only stores the genomes that are new to the chain.
+ * Every section is compressed, so the size of a delta tracks how much changed rather than the size of the world.
+ */
+
+
+class CheckpointRecord {
+public:
+    uint64_t sequence;
+    uint64_t keyframe_sequence; // Keyframe this checkpoint builds on, itself for keyframes
+    uint32_t first_genome; // Index of the first genome stored in this checkpoint
+    uint32_t has_nutrients;
+};
+
+class RemovedRecord {
+public:
+    uint64_t key;
+};
+
+
+/**
+ * Ordered list of keyed records as of the last checkpoint, on the writing side to diff against and on the reading
+ * side to apply deltas to
+ * Applying a delta keeps the surviving records in their order and appends new ones, which is how the simulation's
+ * containers change between ticks
+ */
+template<typename Record> class RecordChain {
+private:
+    std::vector<Record> records;
+    std::unordered_map<uint64_t, size_t> positions;
+
+    static void xor_after_key(Record &record, const Record &other) {
+        unsigned char* bytes = (unsigned char*) &record;
+        const unsigned char* other_bytes = (const unsigned char*) &other;
+        for (size_t index = Record::KEY_SIZE; index < sizeof(Record); index++) {
+            bytes[index] ^= other_bytes[index];
+        }
+    }
+
+public:
+    [[nodiscard]] const std::vector<Record>& get_records() const {
+        return this->records;
+    }
+
+    /**
+     * Replace every record
+     * @return Whether the keys are unique, deltas can only be applied to unique keys
+     */
+    bool set(const std::vector<Record> &_records) {
+        this->records = _records;
+        this->positions.clear();
+        this->positions.reserve(this->records.size());
+        bool unique = true;
+        for (size_t index = 0; index < this->records.size(); index++) {
+            unique = this->positions.emplace(this->records[index].get_key(), index).second and unique;
+        }
+        return unique;
+    }
+
+    /**
+     * Delta from the current records to next, see the chain layout at the top of this file
+     * @return Whether next can be expressed as a delta, if not it has to be stored in full
+     */
+    [[nodiscard]] bool diff(const std::vector<Record> &next, std::vector<Record> &changed, std::vector<RemovedRecord> &removed) const {
+        if (this->positions.size() != this->records.size()) {
+            return false;
+        }
+        changed.clear();
+        removed.clear();
+        std::vector<bool> survived(this->records.size(), false);
+        std::unordered_set<uint64_t> new_keys;
+        bool seen_new = false;
+        size_t next_position = 0;
+        for (const Record &record: next) {
+            const typename std::unordered_map<uint64_t, size_t>::const_iterator found = this->positions.find(record.get_key());
+            if (found == this->positions.end()) {
+                if (!new_keys.insert(record.get_key()).second) {
+                    return false;
+                }
+                seen_new = true;
+                changed.push_back(record);
+                continue;
+            }
+            // survivors have to keep their order and come before every new record
+            if (seen_new or found->second < next_position) {
+                return false;
+            }
+            next_position = found->second + 1;
+            survived[found->second] = true;
+            const Record &previous = this->records[found->second];
+            if (std::memcmp(&record, &previous, sizeof(Record)) != 0) {
+                Record &delta = changed.emplace_back(record);
+                RecordChain::xor_after_key(delta, previous);
+            }
+        }
+        for (size_t index = 0; index < this->records.size(); index++) {
+            if (!survived[index]) {
+                removed.push_back({this->records[index].get_key()});
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Apply a delta made by diff()
+     * @return Whether the delta matched the current records
+     */
+    [[nodiscard]] bool apply(const std::vector<Record> &changed, const std::vector<RemovedRecord> &removed) {
+        if (this->positions.size() != this->records.size()) {
+            return false;
+        }
+        std::vector<bool> keep(this->records.size(), true);
+        for (const RemovedRecord &record: removed) {
+            const typename std::unordered_map<uint64_t, size_t>::const_iterator found = this->positions.find(record.key);
+            if (found == this->positions.end()) {
+                return false;
+            }
+            keep[found->second] = false;
+        }
+        std::vector<Record> next;
+        next.reserve(this->records.size() + changed.size());
+        for (size_t index = 0; index < this->records.size(); index++) {
+            if (keep[index]) {
+                next.push_back(this->records[index]);
+            }
+        }
+        std::unordered_map<uint64_t, size_t> next_positions;
+        next_positions.reserve(next.size() + changed.size());
+        for (size_t index = 0; index < next.size(); index++) {
+            next_positions.emplace(next[index].get_key(), index);
+        }
+        for (const Record &record: changed) {
+            const typename std::unordered_map<uint64_t, size_t>::const_iterator found = next_positions.find(record.get_key());
+            if (found == next_positions.end()) {
+                next_positions.emplace(record.get_key(), next.size());
+                next.push_back(record);
+            }
+            else {
+                RecordChain::xor_after_key(next[found->second], record);
+            }
+        }
+        this->records = std::move(next);
+        this->positions = std::move(next_positions);
+        return true;
+    }
+};
+
+
+/**
+ * Path of a checkpoint in a chain directory
+ */
+[[nodiscard]] std::filesystem::path checkpoint_path(const std::filesystem::path &directory, const uint64_t sequence) {
+    return directory / std::format("{}{:06}{}", CHECKPOINT_FILE_PREFIX, sequence, CHECKPOINT_FILE_EXTENSION);
+}
+
+/**
+ * Sequence numbers of every checkpoint in a chain directory, ascending
+ */
+[[nodiscard]] std::vector<uint64_t> list_checkpoints(const std::filesystem::path &directory) {
+    std::vector<uint64_t> sequences;
+    std::error_code error;
+    for (const std::filesystem::directory_entry &entry: std::filesystem::directory_iterator(directory, error)) {
+        const std::string name = entry.path().filename().string();
+        if (!name.starts_with(CHECKPOINT_FILE_PREFIX) or !name.ends_with(CHECKPOINT_FILE_EXTENSION)) {
+            continue;
+        }
+        const std::string number = name.substr(CHECKPOINT_FILE_PREFIX.size(), name.size() - CHECKPOINT_FILE_PREFIX.size() - CHECKPOINT_FILE_EXTENSION.size());
+        if (number.empty() or !std::all_of(number.begin(), number.end(), ::isdigit)) {
+            continue;
+        }
+        sequences.push_back(std::stoull(number));
+    }
+    std::sort(sequences.begin(), sequences.end());
+    return sequences;
+}
+
+
+/**
+ * Appends checkpoints to a chain directory, remembering what the last one held so the next can be a delta
+ * Nothing is remembered from a checkpoint that failed to write, the next one is a keyframe instead
+ */
+class CheckpointWriter {
+private:
+    std::filesystem::path directory;
+    uint64_t sequence = 0;
+    uint64_t keyframe_sequence = 0;
+    bool force_keyframe = true;
+    uint32_t genome_count = 0; // Genomes stored since the keyframe
+    // Genomes referenced by the last checkpoint, holding them keeps their addresses from being reused by new genomes
+    std::unordered_map<const DNA_t*, std::pair<uint32_t, std::shared_ptr<DNA_t>>> genome_indices;
+    RecordChain<CellBinaryRecord> cells;
+    RecordChain<EggBinaryRecord> eggs;
+    RecordChain<FoodBinaryRecord> plants;
+    RecordChain<FoodBinaryRecord> meats;
+    RecordChain<NutrientBinaryRecord> nutrients;
+    uint64_t last_size = 0;
+    bool last_was_keyframe = false;
+
+    /**
+     * Sections for one entity type, in full or as a delta
+     */
+    template<typename Record> static void add_sections(std::vector<SaveSection> &sections, const RecordChain<Record> &chain, const bool keyframe, const std::vector<Record> &records,
+                                                       std::vector<Record> &changed, std::vector<RemovedRecord> &removed,
+                                                       const SaveSectionType full_type, const SaveSectionType delta_type, const SaveSectionType removed_type) {
+        if (keyframe or !chain.diff(records, changed, removed)) {
+            sections.push_back(SaveSection::of(full_type, records, LZ_ENCODING));
+            return;
+        }
+        sections.push_back(SaveSection::of(delta_type, changed, LZ_ENCODING));
+        sections.push_back(SaveSection::of(removed_type, removed, LZ_ENCODING));
+    }
+
+public:
+    explicit CheckpointWriter(std::filesystem::path _directory): directory(std::move(_directory)) {    }
+
+    /**
+     * Write the next checkpoint of the chain, fsynced and renamed into place so a crash never leaves a partial one
+     * @param written Incremented for every record written, for progress reporting
+     * @return Whether the checkpoint was written
+     */
+    bool write(const Snapshot &snapshot, std::atomic<size_t> &written) {
+        const bool keyframe = this->force_keyframe or this->sequence - this->keyframe_sequence >= CHECKPOINT_KEYFRAME_PERIOD;
+        uint32_t _genome_count = keyframe ? 0 : this->genome_count;
+        const uint32_t first_genome = _genome_count;
+        std::unordered_map<const DNA_t*, std::pair<uint32_t, std::shared_ptr<DNA_t>>> _genome_indices;
+        SnapshotRecords records;
+        snapshot.to_records(records, [&](const std::shared_ptr<DNA_t> &dna) {
+            const auto current = _genome_indices.find(dna.get());
+            if (current != _genome_indices.end()) {
+                return current->second.first;
+            }
+            const auto previous = this->genome_indices.find(dna.get());
+            if (!keyframe and previous != this->genome_indices.end()) {
+                _genome_indices.emplace(dna.get(), previous->second);
+                return previous->second.first;
+            }
+            dna->export_genes(records.genomes.emplace_back().genes);
+            _genome_indices.emplace(dna.get(), std::make_pair(_genome_count, dna));
+            return _genome_count++;
+        });
+
+        const std::vector<CheckpointRecord> info = {{this->sequence, keyframe ? this->sequence : this->keyframe_sequence, first_genome, records.has_nutrients}};
+        std::vector<SaveSection> sections = {
+                SaveSection::of(CHECKPOINT_SECTION, info),
+                SaveSection::of(GENOME_SECTION, records.genomes, LZ_ENCODING)
+        };
+        std::vector<CellBinaryRecord> changed_cells;
+        std::vector<EggBinaryRecord> changed_eggs;
+        std::vector<FoodBinaryRecord> changed_plants;
+        std::vector<FoodBinaryRecord> changed_meats;
+        std::vector<NutrientBinaryRecord> changed_nutrients;
+        std::vector<RemovedRecord> removed[5];
+        CheckpointWriter::add_sections(sections, this->cells, keyframe, records.cells, changed_cells, removed[0], CELL_SECTION, CELL_DELTA_SECTION, CELL_REMOVED_SECTION);
+        CheckpointWriter::add_sections(sections, this->eggs, keyframe, records.eggs, changed_eggs, removed[1], EGG_SECTION, EGG_DELTA_SECTION, EGG_REMOVED_SECTION);
+        CheckpointWriter::add_sections(sections, this->plants, keyframe, records.plants, changed_plants, removed[2], PLANT_SECTION, PLANT_DELTA_SECTION, PLANT_REMOVED_SECTION);
+        CheckpointWriter::add_sections(sections, this->meats, keyframe, records.meats, changed_meats, removed[3], MEAT_SECTION, MEAT_DELTA_SECTION, MEAT_REMOVED_SECTION);
+        CheckpointWriter::add_sections(sections, this->nutrients, keyframe, records.nutrients, changed_nutrients, removed[4], NUTRIENT_SECTION, NUTRIENT_DELTA_SECTION, NUTRIENT_REMOVED_SECTION);
+        std::vector<SimulationStateRecord> state;
+        std::vector<char> random_state;
+        snapshot.add_state_sections(sections, state, random_state); // small, so every checkpoint has the full state
+
+        std::error_code error;
+        std::filesystem::create_directories(this->directory, error);
+        const std::filesystem::path path = checkpoint_path(this->directory, this->sequence);
+        const std::filesystem::path temporary_path = this->directory / ("." + path.filename().string() + ".partial");
+        bool saved = !error and write_binary_save(temporary_path, sections, written) and sync_path(temporary_path);
+        if (saved) {
+            std::filesystem::rename(temporary_path, path, error);
+            saved = !error;
+        }
+        if (!saved) {
+            std::filesystem::remove(temporary_path, error);
+            this->force_keyframe = true;
+            return false;
+        }
+        // a stale manifest only makes the catalog show older numbers, so it doesn't fail the checkpoint
+        snapshot.write_manifest(this->directory, CHAIN_SAVE_FORMAT, this->sequence + 1);
+        sync_path(this->directory);
+
+        this->last_size = std::filesystem::file_size(path, error);
+        this->last_was_keyframe = keyframe;
+        if (keyframe) {
+            this->keyframe_sequence = this->sequence;
+        }
+        this->sequence++;
+        this->force_keyframe = false;
+        this->genome_count = _genome_count;
+        this->genome_indices = std::move(_genome_indices);
+        // duplicate keys make diff() fall back to full sections for that type
+        this->cells.set(records.cells);
+        this->eggs.set(records.eggs);
+        this->plants.set(records.plants);
+        this->meats.set(records.meats);
+        this->nutrients.set(records.nutrients);
+        return true;
+    }
+
+    [[nodiscard]] const std::filesystem::path& get_directory() const {
+        return this->directory;
+    }
+
+    /**
+     * Size in bytes of the last checkpoint written
+     */
+    [[nodiscard]] uint64_t get_last_size() const {
+        return this->last_size;
+    }
+
+    [[nodiscard]] bool was_last_keyframe() const {
+        return this->last_was_keyframe;
+    }
+};
+
+
+/**
+ * Read one entity type of a checkpoint into its chain
+ * @return Whether the sections were valid and matched the chain
+ */
+template<typename Record> [[nodiscard]] bool apply_checkpoint_sections(const BinarySaveReader &reader, RecordChain<Record> &chain, const SaveSectionType full_type, const SaveSectionType delta_type, const SaveSectionType removed_type) {
+    std::vector<Record> records;
+    if (reader.has_section(full_type)) {
+        if (!reader.read_section(full_type, records)) {
+            return false;
+        }
+        chain.set(records);
+        return true;
+    }
+    std::vector<RemovedRecord> removed;
+    if (!reader.read_section(delta_type, records) or !reader.read_section(removed_type, removed)) {
+        return false;
+    }
+    if (!chain.apply(records, removed)) {
+        reader.log_error(std::format("section {} does not match the checkpoint before it", delta_type));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Rebuild the world as of a checkpoint by reading its keyframe and applying every delta after it
+ * @param directory Chain directory
+ * @param sequence Checkpoint to materialize
+ * @param snapshot Filled with the world at that checkpoint
+ * @return Whether every checkpoint needed was present and intact, failures are logged
+ */
+[[nodiscard]] bool materialize_checkpoint(const std::filesystem::path &directory, const uint64_t sequence, Snapshot &snapshot) {
+    std::vector<CheckpointRecord> info;
+    {
+        BinarySaveReader reader;
+        if (!reader.open(checkpoint_path(directory, sequence)) or !reader.read_section(CHECKPOINT_SECTION, info)) {
+            return false;
+        }
+        if (info.size() != 1 or info[0].sequence != sequence or info[0].keyframe_sequence > sequence) {
+            reader.log_error("not a checkpoint of this chain");
+            return false;
+        }
+    }
+
+    SnapshotRecords records;
+    RecordChain<CellBinaryRecord> cells;
+    RecordChain<EggBinaryRecord> eggs;
+    RecordChain<FoodBinaryRecord> plants;
+    RecordChain<FoodBinaryRecord> meats;
+    RecordChain<NutrientBinaryRecord> nutrients;
+    const uint64_t keyframe_sequence = info[0].keyframe_sequence;
+    for (uint64_t _sequence = keyframe_sequence; _sequence <= sequence; _sequence++) {
+        BinarySaveReader reader;
+        if (!reader.open(checkpoint_path(directory, _sequence)) or !reader.read_section(CHECKPOINT_SECTION, info)) {
+            return false;
+        }
+        if (info.size() != 1 or info[0].sequence != _sequence or info[0].keyframe_sequence != keyframe_sequence or info[0].first_genome != records.genomes.size()) {
+            reader.log_error(std::format("does not follow checkpoint {} of the chain", _sequence - 1));
+            return false;
+        }
+        std::vector<GenomeBinaryRecord> genomes;
+        if (!reader.read_section(GENOME_SECTION, genomes)) {
+            return false;
+        }
+        records.genomes.insert(records.genomes.end(), genomes.begin(), genomes.end());
+        if (!apply_checkpoint_sections(reader, cells, CELL_SECTION, CELL_DELTA_SECTION, CELL_REMOVED_SECTION)
+                or !apply_checkpoint_sections(reader, eggs, EGG_SECTION, EGG_DELTA_SECTION, EGG_REMOVED_SECTION)
+                or !apply_checkpoint_sections(reader, plants, PLANT_SECTION, PLANT_DELTA_SECTION, PLANT_REMOVED_SECTION)
+                or !apply_checkpoint_sections(reader, meats, MEAT_SECTION, MEAT_DELTA_SECTION, MEAT_REMOVED_SECTION)
+                or !apply_checkpoint_sections(reader, nutrients, NUTRIENT_SECTION, NUTRIENT_DELTA_SECTION, NUTRIENT_REMOVED_SECTION)) {
+            return false;
+        }
+        records.has_nutrients = info[0].has_nutrients;
+        if (_sequence == sequence and !Snapshot::read_state_sections(reader, snapshot)) {
+            return false;
+        }
+    }
+    records.cells = cells.get_records();
+    records.eggs = eggs.get_records();
+    records.plants = plants.get_records();
+    records.meats = meats.get_records();
+    records.nutrients = nutrients.get_records();
+    return Snapshot::from_records(records, snapshot);
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+
+#include <unordered_map>
+#include <vector>
+#include <list>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+
+#include "Constants.hpp"
+#include "Food.hpp"
+
+
+constexpr unsigned int FOOD_COALESCE_PERIOD = 100; // Ticks between coalescing passes
+constexpr float FOOD_COALESCE_BUCKET_SIZE = 20.0f; // Smallest bucket width, widened to the largest food diameter of each pass
+
+
+/**
+ * Merges overlapping food of the same type so long runs keep a bounded food count
+ * A pass copies the food at the end of a tick and looks for overlaps on its own thread while the next tick runs, the
+ * clear() of that tick only applies the merges found to the food that still overlaps. The copy is scanned in id order,
+ * so a run resumed from a save taken in between finds the same merges (see Simulation::resume_coalescing()).
+ * Food is bucketed on a coarse grid at least as wide as the largest food and only compared against the 3x3 buckets
+ * around it, so no overlap is missed. Food that grows past that in a pass is caught by the next one.
+ * The larger item absorbs the smaller one and keeps its position, so region bookkeeping never goes stale
+ */
+class FoodCoalescer {
+private:
+    class FoodSample {
+    public:
+        FoodRecord record; // Merged into during the scan, consumed once absorbed
+        Food* food; // Only dereferenced by finish_pass(), food is not freed before the end of the pass
+    };
+
+    class Merge {
+    public:
+        Food* target;
+        Food* source;
+    };
+
+    std::vector<FoodSample> samples; // Only touched by the scanning thread while it runs
+    std::vector<Merge> merges; // In the order they were found
+    std::unordered_map<std::uint64_t, std::vector<uint32_t>> buckets; // Indices into samples
+    float bucket_size = FOOD_COALESCE_BUCKET_SIZE;
+    std::thread scan_thread;
+    double residual_calories = 0; // Rounding error of the merges not handed back to food yet, food calories + residual is conserved
+    unsigned long merge_count = 0;
+
+    [[nodiscard]] std::int32_t bucket_coordinate(const float position) const {
+        return (std::int32_t) std::floor(position / this->bucket_size);
+    }
+
+    [[nodiscard]] static std::uint64_t bucket_key(const std::int32_t bucket_x, const std::int32_t bucket_y) {
+        return ((std::uint64_t) (std::uint32_t) bucket_x << 32) | (std::uint64_t) (std::uint32_t) bucket_y;
+    }
+
+    [[nodiscard]] static bool overlaps(const Vector2 position, const float radius, const Vector2 other_position, const float other_radius) {
+        const float dx = wrap_delta(other_position.x - position.x);
+        const float dy = wrap_delta(other_position.y - position.y);
+        const float reach = radius + other_radius;
+        return dx * dx + dy * dy < reach * reach;
+    }
+
+    /**
+     * Move all calories of source into target
+     * The rounding error of the float sum is computed exactly (Fast2Sum) and kept in the residual, target then takes
+     * back as much of the residual as its calories can represent, so the residual never grows past half an ulp of food
+     */
+    void merge(Food* target, Food* source) {
+        const float target_calories = target->get_calories();
+        const float source_calories = source->take_calories();
+        const float sum = target_calories + source_calories;
+        const float larger = std::abs(target_calories) >= std::abs(source_calories) ? target_calories : source_calories;
+        const float smaller = std::abs(target_calories) >= std::abs(source_calories) ? source_calories : target_calories;
+        this->residual_calories += (double) ((larger - sum) + smaller);
+        // exact, the residual is far smaller than sum
+        const float returned = (sum + (float) this->residual_calories) - sum;
+        this->residual_calories -= (double) returned;
+
+        target->add_calories(source_calories);
+        target->add_calories(returned);
+        target->update_radius();
+        source->consume();
+        this->merge_count++;
+    }
+
+    /**
+     * Find an unabsorbed sample of the same type that overlaps with the sample in the 3x3 buckets around it
+     * @return Its index, -1 if there is none
+     */
+    [[nodiscard]] int find_overlap(const FoodRecord &food, const std::int32_t bucket_x, const std::int32_t bucket_y) const {
+        for (std::int32_t neighbor_y = bucket_y - 1; neighbor_y <= bucket_y + 1; neighbor_y++) {
+            for (std::int32_t neighbor_x = bucket_x - 1; neighbor_x <= bucket_x + 1; neighbor_x++) {
+                const auto bucket = this->buckets.find(FoodCoalescer::bucket_key(neighbor_x, neighbor_y));
+                if (bucket == this->buckets.end()) {
+                    continue;
+                }
+                for (const uint32_t other_index: bucket->second) {
+                    const FoodRecord &other_food = this->samples[other_index].record;
+                    if (other_food.consumed or other_food.food_type != food.food_type) {
+                        continue;
+                    }
+                    if (FoodCoalescer::overlaps(food.position, food.radius, other_food.position, other_food.radius)) {
+                        return (int) other_index;
+                    }
+                }
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * Find the merges of a pass on the copied food, runs on the scanning thread
+     * Samples are visited once in id order, each one merges with the first overlapping sample left from earlier or
+     * is remembered for later ones. Whichever of the two survives stays in its bucket, so one item can take in several
+     * neighbors in a pass, while absorbed items are gone for the rest of it. Overlaps that only appear through a merge
+     * with a sample visited before it are left to the next pass.
+     */
+    void scan() {
+        std::sort(this->samples.begin(), this->samples.end(), [](const FoodSample &sample, const FoodSample &other_sample) {
+            return sample.record.id < other_sample.record.id;
+        });
+        // overlapping food is at most two of the largest radii apart
+        float largest_radius = 0.0f;
+        for (const FoodSample &sample: this->samples) {
+            largest_radius = std::max(largest_radius, sample.record.radius);
+        }
+        this->bucket_size = std::max(FOOD_COALESCE_BUCKET_SIZE, 2.0f * largest_radius);
+        this->buckets.clear();
+        for (uint32_t index = 0; index < (uint32_t) this->samples.size(); index++) {
+            const FoodRecord &food = this->samples[index].record;
+            const std::int32_t bucket_x = this->bucket_coordinate(food.position.x);
+            const std::int32_t bucket_y = this->bucket_coordinate(food.position.y);
+            const int other_index = this->find_overlap(food, bucket_x, bucket_y);
+            if (other_index == -1) {
+                this->buckets[FoodCoalescer::bucket_key(bucket_x, bucket_y)].push_back(index);
+                continue;
+            }
+            const bool absorbed = this->samples[other_index].record.calories >= food.calories;
+            FoodSample &target = absorbed ? this->samples[other_index] : this->samples[index];
+            FoodSample &source = absorbed ? this->samples[index] : this->samples[other_index];
+            target.record.calories += source.record.calories;
+            target.record.radius = std::sqrt(target.record.calories / 4.0f);
+            source.record.consumed = true;
+            this->merges.push_back({target.food, source.food});
+            if (!absorbed) {
+                this->buckets[FoodCoalescer::bucket_key(bucket_x, bucket_y)].push_back(index);
+            }
+        }
+    }
+
+public:
+    unsigned int ticks_since_pass = 0;
+
+    FoodCoalescer() = default;
+
+    FoodCoalescer(const FoodCoalescer&) = delete;
+    FoodCoalescer& operator=(const FoodCoalescer&) = delete;
+
+    ~FoodCoalescer() {
+        this->cancel_pass();
+    }
+
+    /**
+     * Copy the food and start looking for overlaps on another thread, only call between ticks without a pass running
+     */
+    void start_pass(const std::list<Food*> &foods) {
+        this->samples.clear();
+        this->merges.clear();
+        this->samples.reserve(foods.size());
+        for (Food* food: foods) {
+            if (!food->is_consumed()) {
+                this->samples.push_back({food->get_record(), food});
+            }
+        }
+        this->scan_thread = std::thread([this]() {
+            this->scan();
+        });
+    }
+
+    /**
+     * Wait for the scan and merge whatever it found that is still unconsumed and overlapping, food may have been
+     * eaten or moved since it was copied
+     * Does nothing without a pass running
+     */
+    void finish_pass() {
+        if (!this->scan_thread.joinable()) {
+            return;
+        }
+        this->scan_thread.join();
+        for (const Merge &found: this->merges) {
+            if (found.target->is_consumed() or found.source->is_consumed()) {
+                continue;
+            }
+            if (FoodCoalescer::overlaps(found.target->get_position(), found.target->get_radius(), found.source->get_position(), found.source->get_radius())) {
+                this->merge(found.target, found.source);
+            }
+        }
+        this->merges.clear();
+    }
+
+    /**
+     * Drop a running pass without touching any food, before food is freed
+     */
+    void cancel_pass() {
+        if (this->scan_thread.joinable()) {
+            this->scan_thread.join();
+        }
+        this->merges.clear();
+    }
+
+    /**
+     * Continue the totals of a loaded run
+     */
+    void restore_totals(const double _residual_calories, const unsigned long _merge_count) {
+        this->residual_calories = _residual_calories;
+        this->merge_count = _merge_count;
+    }
+
+    [[nodiscard]] double get_residual_calories() const {
+        return this->residual_calories;
+    }
+
+    [[nodiscard]] unsigned long get_merge_count() const {
+        return this->merge_count;
+    }
+};
@@ -0,0 +1,338 @@
+#pragma once
+
+
+#include <raylib.h>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+
+#include "Constants.hpp"
+#include "Cell.hpp"
+
+
+constexpr bool COLONY_TRACKING = true; // Find colonies of cells every COLONY_PERIOD ticks, see ColonyTracker
+constexpr unsigned int COLONY_PERIOD = 10; // Ticks between colony passes
+constexpr float COLONY_LINK_DISTANCE = 40.0f; // Cells closer than this, center to center, share a colony unless chosen on the command line
+constexpr unsigned int COLONY_MINIMUM_SIZE = 3; // Smaller groups count as loners
+
+
+/**
+ * Cells connected by chains of cells closer than the link distance
+ */
+class Colony {
+public:
+    uint32_t size;
+    Vector2 centroid;
+    float radius; // Root mean square distance of its cells from the centroid
+};
+
+
+/**
+ * Finds colonies as the connected components of cells within the link distance of each other
+ * Cells are kept in buckets of the link distance, updated as cells are born, die and cross into another bucket, so
+ * between passes a tick only compares each cell's bucket with the one it is listed in.
+ * A pass joins cells with union-find, comparing each bucket only with itself and the 3x3 buckets around it.
+ * Union-find can't split a component when cells drift apart or die, so every pass starts from singletons and only
+ * the buckets carry over.
+ */
+class ColonyTracker {
+private:
+    class Bucket {
+    public:
+        std::vector<Cell*> cells;
+        uint32_t first = 0; // Union-find index of its first cell during a pass
+    };
+
+    std::unordered_map<std::uint64_t, Bucket> buckets;
+    float link_distance;
+    float bucket_size;
+    std::int32_t wrapped_bucket_count = 0; // Buckets per side of a wrapped world, 0 when it doesn't wrap
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> sizes;
+    std::vector<Cell*> members; // By union-find index
+    std::vector<Colony> colonies; // Largest first
+    uint32_t loner_count = 0;
+    unsigned long pass_tick = 0;
+
+    [[nodiscard]] std::int32_t bucket_coordinate(const float position) const {
+        const std::int32_t coordinate = (std::int32_t) std::floor((position + HALF_WORLD_SIZE) / this->bucket_size);
+        if (this->wrapped_bucket_count == 0) {
+            return coordinate;
+        }
+        return ((coordinate % this->wrapped_bucket_count) + this->wrapped_bucket_count) % this->wrapped_bucket_count;
+    }
+
+    [[nodiscard]] std::uint64_t bucket_key(std::int32_t bucket_x, std::int32_t bucket_y) const {
+        if (this->wrapped_bucket_count != 0) {
+            bucket_x = ((bucket_x % this->wrapped_bucket_count) + this->wrapped_bucket_count) % this->wrapped_bucket_count;
+            bucket_y = ((bucket_y % this->wrapped_bucket_count) + this->wrapped_bucket_count) % this->wrapped_bucket_count;
+        }
+        return ((std::uint64_t) (std::uint32_t) bucket_x << 32) | (std::uint64_t) (std::uint32_t) bucket_y;
+    }
+
+    [[nodiscard]] std::uint64_t bucket_of(const Cell* cell) const {
+        return this->bucket_key(this->bucket_coordinate(cell->get_x_position()), this->bucket_coordinate(cell->get_y_position()));
+    }
+
+    void insert(Cell* cell, const std::uint64_t key) {
+        std::vector<Cell*> &bucket_cells = this->buckets[key].cells;
+        cell->colony_bucket = key;
+        cell->colony_slot = (uint32_t) bucket_cells.size();
+        bucket_cells.push_back(cell);
+    }
+
+    void erase(const Cell* cell) {
+        const auto bucket = this->buckets.find(cell->colony_bucket);
+        std::vector<Cell*> &bucket_cells = bucket->second.cells;
+        Cell* moved = bucket_cells.back();
+        bucket_cells[cell->colony_slot] = moved;
+        moved->colony_slot = cell->colony_slot;
+        bucket_cells.pop_back();
+        if (bucket_cells.empty()) {
+            this->buckets.erase(bucket);
+        }
+    }
+
+    [[nodiscard]] bool linked(const Cell* cell, const Cell* other_cell) const {
+        const float dx = wrap_delta(other_cell->get_x_position() - cell->get_x_position());
+        const float dy = wrap_delta(other_cell->get_y_position() - cell->get_y_position());
+        return dx * dx + dy * dy < this->link_distance * this->link_distance;
+    }
+
+    [[nodiscard]] uint32_t find(uint32_t index) {
+        while (this->parents[index] != index) {
+            this->parents[index] = this->parents[this->parents[index]]; // path halving
+            index = this->parents[index];
+        }
+        return index;
+    }
+
+    void unite(const uint32_t index, const uint32_t other_index) {
+        uint32_t root = this->find(index);
+        uint32_t other_root = this->find(other_index);
+        if (root == other_root) {
+            return;
+        }
+        if (this->sizes[root] < this->sizes[other_root]) {
+            std::swap(root, other_root);
+        }
+        this->parents[other_root] = root;
+        this->sizes[root] += this->sizes[other_root];
+    }
+
+    /**
+     * Join the linked cells of two buckets, or of one bucket with itself
+     */
+    void unite_buckets(const Bucket &bucket, const Bucket &other_bucket) {
+        const bool same = &bucket == &other_bucket;
+        for (uint32_t slot = 0; slot < bucket.cells.size(); slot++) {
+            for (uint32_t other_slot = same ? slot + 1 : 0; other_slot < other_bucket.cells.size(); other_slot++) {
+                if (this->linked(bucket.cells[slot], other_bucket.cells[other_slot])) {
+                    this->unite(bucket.first + slot, other_bucket.first + other_slot);
+                }
+            }
+        }
+    }
+
+    void size_buckets(const float distance) {
+        this->link_distance = distance;
+        if (WRAP_POSITION) {
+            // whole buckets across the world, so the buckets on both sides of the edge are neighbors
+            this->wrapped_bucket_count = std::max((std::int32_t) (WORLD_SIZE / distance), (std::int32_t) 1);
+            this->bucket_size = WORLD_SIZE / (float) this->wrapped_bucket_count;
+        }
+        else {
+            this->bucket_size = distance;
+        }
+    }
+
+public:
+    unsigned int ticks_since_pass = 0;
+
+    ColonyTracker() {
+        this->size_buckets(COLONY_LINK_DISTANCE);
+    }
+
+    /**
+     * @param distance Cells closer than this share a colony, the buckets are rebuilt around it
+     */
+    void set_link_distance(const float distance, const std::vector<Cell*> &cells) {
+        this->size_buckets(distance);
+        this->rebuild(cells);
+    }
+
+    [[nodiscard]] float get_link_distance() const {
+        return this->link_distance;
+    }
+
+    /**
+     * Start tracking a cell that joined the population
+     */
+    void add(Cell* cell) {
+        this->insert(cell, this->bucket_of(cell));
+    }
+
+    /**
+     * Stop tracking a cell, before it leaves the population
+     */
+    void remove(const Cell* cell) {
+        this->erase(cell);
+    }
+
+    /**
+     * Move the cells that crossed into another bucket since the last call
+     */
+    void update(const std::vector<Cell*> &cells) {
+        for (Cell* cell: cells) {
+            const std::uint64_t key = this->bucket_of(cell);
+            if (key != cell->colony_bucket) {
+                this->erase(cell);
+                this->insert(cell, key);
+            }
+        }
+    }
+
+    /**
+     * Track a whole population from scratch, the cells listed before don't have to exist anymore
+     */
+    void rebuild(const std::vector<Cell*> &cells) {
+        this->buckets.clear();
+        for (Cell* cell: cells) {
+            this->add(cell);
+        }
+    }
+
+    /**
+     * Find the colonies of the tracked cells
+     * @param tick Current tick, see get_pass_tick()
+     */
+    void find_colonies(const unsigned long tick) {
+        this->ticks_since_pass = 0;
+        this->pass_tick = tick;
+        this->members.clear();
+        for (auto &[key, bucket]: this->buckets) {
+            bucket.first = (uint32_t) this->members.size();
+            this->members.insert(this->members.end(), bucket.cells.begin(), bucket.cells.end());
+        }
+        this->parents.resize(this->members.size());
+        for (uint32_t index = 0; index < this->members.size(); index++) {
+            this->parents[index] = index;
+        }
+        this->sizes.assign(this->members.size(), 1);
+
+        // each pair of neighboring buckets once, through the bucket on its left or below
+        constexpr std::int32_t NEIGHBORS[4][2] = {{1, -1}, {1, 0}, {1, 1}, {0, 1}};
+        for (const auto &[key, bucket]: this->buckets) {
+            this->unite_buckets(bucket, bucket);
+            const std::int32_t bucket_x = (std::int32_t) (std::uint32_t) (key >> 32);
+            const std::int32_t bucket_y = (std::int32_t) (std::uint32_t) key;
+            for (const auto &neighbor: NEIGHBORS) {
+                const auto other_bucket = this->buckets.find(this->bucket_key(bucket_x + neighbor[0], bucket_y + neighbor[1]));
+                if (other_bucket != this->buckets.end() and &other_bucket->second != &bucket) {
+                    this->unite_buckets(bucket, other_bucket->second);
+                }
+            }
+        }
+
+        // offsets are taken from the first cell of each component, so a colony across the edge of a wrapped world stays whole
+        this->colonies.clear();
+        this->loner_count = 0;
+        std::vector<int32_t> colony_indices(this->members.size(), -1);
+        std::vector<Vector2> origins;
+        std::vector<double> sums;
+        for (uint32_t index = 0; index < this->members.size(); index++) {
+            const uint32_t root = this->find(index);
+            if (this->sizes[root] < COLONY_MINIMUM_SIZE) {
+                this->loner_count++;
+                continue;
+            }
+            if (colony_indices[root] < 0) {
+                colony_indices[root] = (int32_t) this->colonies.size();
+                this->colonies.push_back({this->sizes[root], {0.0f, 0.0f}, 0.0f});
+                origins.push_back(this->members[index]->get_position());
+                sums.insert(sums.end(), 3, 0.0);
+            }
+            const int32_t colony = colony_indices[root];
+            const Vector2 position = this->members[index]->get_position();
+            const double dx = wrap_delta(position.x - origins[colony].x);
+            const double dy = wrap_delta(position.y - origins[colony].y);
+            sums[colony * 3] += dx;
+            sums[colony * 3 + 1] += dy;
+            sums[colony * 3 + 2] += dx * dx + dy * dy;
+        }
+        for (size_t colony = 0; colony < this->colonies.size(); colony++) {
+            const double size = this->colonies[colony].size;
+            const double mean_x = sums[colony * 3] / size;
+            const double mean_y = sums[colony * 3 + 1] / size;
+            this->colonies[colony].centroid = {wrap_delta(origins[colony].x + (float) mean_x), wrap_delta(origins[colony].y + (float) mean_y)};
+            this->colonies[colony].radius = (float) std::sqrt(std::max(sums[colony * 3 + 2] / size - mean_x * mean_x - mean_y * mean_y, 0.0));
+        }
+        std::sort(this->colonies.begin(), this->colonies.end(), [](const Colony &colony, const Colony &other_colony) {
+            return colony.size > other_colony.size;
+        });
+    }
+
+    /**
+     * Colonies of the last pass, largest first
+     */
+    [[nodiscard]] const std::vector<Colony>& get_colonies() const {
+        return this->colonies;
+    }
+
+    /**
+     * Cells in groups smaller than COLONY_MINIMUM_SIZE at the last pass
+     */
+    [[nodiscard]] uint32_t get_loner_count() const {
+        return this->loner_count;
+    }
+
+    [[nodiscard]] unsigned long get_pass_tick() const {
+        return this->pass_tick;
+    }
+
+    /**
+     * Whether every cell is listed in the bucket of its position, and nothing else is listed
+     */
+    [[nodiscard]] bool verify(const std::vector<Cell*> &cells) const {
+        size_t listed = 0;
+        for (const auto &[key, bucket]: this->buckets) {
+            listed += bucket.cells.size();
+        }
+        if (listed != cells.size()) {
+            return false;
+        }
+        for (const Cell* cell: cells) {
+            const auto bucket = this->buckets.find(cell->colony_bucket);
+            if (cell->colony_bucket != this->bucket_of(cell) or bucket == this->buckets.end() or cell->colony_slot >= bucket->second.cells.size() or bucket->second.cells[cell->colony_slot] != cell) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Outline and size of every colony, in world coordinates
+     */
+    void draw() const {
+        for (const Colony &colony: this->colonies) {
+            DrawCircleLinesV(colony.centroid, std::max(colony.radius * 2.0f, this->link_distance), SKYBLUE);
+            DrawTextEx(GetFontDefault(), TextFormat("%u", colony.size), colony.centroid, FONT_SIZE * 2, 1, SKYBLUE);
+        }
+    }
+
+    /**
+     * Colony count and the largest colonies, in the bottom left corner
+     */
+    void draw_summary() const {
+        Vector2 position = {10.0f, (float) GetScreenHeight() - 85.0f};
+        DrawTextEx(GetFontDefault(), TextFormat("%zu colonies, %u loners at tick %lu", this->colonies.size(), this->loner_count, this->pass_tick), position, FONT_SIZE, 1, WHITE);
+        for (size_t colony = 0; colony < std::min(this->colonies.size(), (size_t) 4); colony++) {
+            position.y += 15;
+            const Colony &shown = this->colonies[colony];
+            DrawTextEx(GetFontDefault(), TextFormat("%u cells around (%.0f, %.0f)", shown.size, shown.centroid.x, shown.centroid.y), position, FONT_SIZE, 1, GRAY);
+        }
+    }
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+
+/*
+ * Small LZ77 block codec in the style of LZ4, used to compress save sections
+ *
+ * A block is a list of sequences, each:
+ *   token: high 4 bits literal count, low 4 bits match length - LZ_MIN_MATCH (15 means more length bytes follow)
+ *   extra literal count bytes, 255 means another byte follows
+ *   literals
+ *   2 byte little endian match offset
+ *   extra match length bytes, 255 means another byte follows
+ * The last sequence ends after its literals and has no match.
+ * The decompressed size is not stored in the block, the caller keeps it.
+ */
+
+
+constexpr unsigned int LZ_HASH_BITS = 16;
+constexpr size_t LZ_MIN_MATCH = 4;
+constexpr size_t LZ_MAX_OFFSET = 65535;
+constexpr unsigned int LZ_SKIP_SHIFT = 6; // Incompressible data is skipped faster the longer no match was found
+
+
+[[nodiscard]] uint32_t lz_read_word(const unsigned char* bytes) {
+    uint32_t word;
+    std::memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+[[nodiscard]] uint32_t lz_hash(const uint32_t word) {
+    return (word * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+void lz_write_length(std::vector<unsigned char> &output, size_t length) {
+    while (length >= 255) {
+        output.push_back(255);
+        length -= 255;
+    }
+    output.push_back((unsigned char) length);
+}
+
+void lz_write_sequence(std::vector<unsigned char> &output, const unsigned char* literals, const size_t literal_count, const size_t offset, const size_t match_length) {
+    const size_t extra_match_length = match_length - LZ_MIN_MATCH;
+    unsigned char &token = output.emplace_back(0);
+    token = (unsigned char) ((std::min(literal_count, (size_t) 15) << 4) | std::min(extra_match_length, (size_t) 15));
+    if (literal_count >= 15) {
+        lz_write_length(output, literal_count - 15);
+    }
+    output.insert(output.end(), literals, literals + literal_count);
+    output.push_back((unsigned char) (offset & 0xFF));
+    output.push_back((unsigned char) (offset >> 8));
+    if (extra_match_length >= 15) {
+        lz_write_length(output, extra_match_length - 15);
+    }
+}
+
+/**
+ * Compress a block
+ * @return Compressed block, can be slightly larger than the input for incompressible data
+ */
+[[nodiscard]] std::vector<unsigned char> lz_compress(const void* data, const size_t size) {
+    const unsigned char* source = (const unsigned char*) data;
+    std::vector<unsigned char> output;
+    output.reserve(size / 2 + 16);
+    std::vector<size_t> table(1 << LZ_HASH_BITS, SIZE_MAX); // full positions, so blocks of 4 GB and more are compressed too
+
+    size_t anchor = 0;
+    size_t position = 0;
+    while (position + LZ_MIN_MATCH <= size) {
+        const uint32_t word = lz_read_word(source + position);
+        const uint32_t hash = lz_hash(word);
+        const size_t candidate = table[hash];
+        table[hash] = position;
+        if (candidate == SIZE_MAX or position - candidate > LZ_MAX_OFFSET or lz_read_word(source + candidate) != word) {
+            position += 1 + ((position - anchor) >> LZ_SKIP_SHIFT);
+            continue;
+        }
+        size_t match_length = LZ_MIN_MATCH;
+        while (position + match_length < size and source[candidate + match_length] == source[position + match_length]) {
+            match_length++;
+        }
+        lz_write_sequence(output, source + anchor, position - anchor, position - candidate, match_length);
+        position += match_length;
+        anchor = position;
+    }
+
+    // last literals, without a match
+    const size_t literal_count = size - anchor;
+    output.push_back((unsigned char) (std::min(literal_count, (size_t) 15) << 4));
+    if (literal_count >= 15) {
+        lz_write_length(output, literal_count - 15);
+    }
+    output.insert(output.end(), source + anchor, source + size);
+    return output;
+}
+
+/**
+ * Read an extra length, see the block layout at the top of this file
+ * @return Whether the input had enough bytes
+ */
+[[nodiscard]] bool lz_read_length(const unsigned char* source, const size_t source_size, size_t &position, size_t &length) {
+    while (true) {
+        if (position >= source_size) {
+            return false;
+        }
+        const unsigned char byte = source[position++];
+        length += byte;
+        if (byte != 255) {
+            return true;
+        }
+    }
+}
+
+/**
+ * Decompress a block, every offset and length is bounds checked so corrupt input can't write out of bounds
+ * @param destination_size Exact decompressed size
+ * @return Whether the block was valid and decompressed to exactly destination_size bytes
+ */
+[[nodiscard]] bool lz_decompress(const unsigned char* source, const size_t source_size, unsigned char* destination, const size_t destination_size) {
+    size_t input = 0;
+    size_t output = 0;
+    while (input < source_size) {
+        const unsigned char token = source[input++];
+        size_t literal_count = token >> 4;
+        if (literal_count == 15 and !lz_read_length(source, source_size, input, literal_count)) {
+            return false;
+        }
+        if (literal_count > source_size - input or literal_count > destination_size - output) {
+            return false;
+        }
+        std::memcpy(destination + output, source + input, literal_count);
+        input += literal_count;
+        output += literal_count;
+        if (input == source_size) {
+            break;
+        }
+
+        if (source_size - input < 2) {
+            return false;
+        }
+        const size_t offset = source[input] | (source[input + 1] << 8);
+        input += 2;
+        size_t match_length = token & 15;
+        if (match_length == 15 and !lz_read_length(source, source_size, input, match_length)) {
+            return false;
+        }
+        match_length += LZ_MIN_MATCH;
+        if (offset == 0 or offset > output or match_length > destination_size - output) {
+            return false;
+        }
+        const unsigned char* match = destination + output - offset;
+        if (offset >= match_length) {
+            std::memcpy(destination + output, match, match_length);
+        }
+        else {
+            // overlapping match, repeats the last offset bytes
+            for (size_t index = 0; index < match_length; index++) {
+                destination[output + index] = match[index];
+            }
+        }
+        output += match_length;
+    }
+    return output == destination_size;
+}
@@ -4,6 +4,7 @@
 #include <raylib.h>
 #include <random>
 #include <chrono>
+#include <cmath>
 #include "Activation.hpp"
 
 constexpr float MAP_SIZE = 10000;
@@ -74,7 +75,43 @@ constexpr float BASE_ENERGY = 5.0f;
 std::normal_distribution<float> shit_offset(55.0f, 30.0f);
 constexpr float POSITION_DISTANCE = 1000.0f;
 std::normal_distribution<float> random_originish(0.0f, POSITION_DISTANCE);
-constexpr bool WRAP_POSITION = false;
+
+constexpr bool TOROIDAL_WORLD = false; // Large wrapped world split into regions that sleep while empty (see Region.hpp)
+constexpr float WORLD_SIZE = TOROIDAL_WORLD ? MAP_SIZE * 10.0f : MAP_SIZE;
+constexpr float HALF_WORLD_SIZE = WORLD_SIZE / 2.0f;
+constexpr bool WRAP_POSITION = TOROIDAL_WORLD;
+
+/**
+ * Shortest signed displacement along one axis
+ * On a wrapped world this picks the closest image across the edge
+ * @param delta Raw displacement
+ * @return Wrapped displacement
+ */
+[[nodiscard]] float wrap_delta(float delta) {
+    if (WRAP_POSITION) {
+        if (delta > HALF_WORLD_SIZE) {
+            delta -= WORLD_SIZE;
+        }
+        else if (delta < -HALF_WORLD_SIZE) {
+            delta += WORLD_SIZE;
+        }
+    }
+    return delta;
+}
+
+/**
+ * Whether something has drifted too far from the origin and should be put back near it
+ * Never true on a wrapped world
+ */
+[[nodiscard]] bool is_too_far(const Vector2 position) {
+    if (WRAP_POSITION) {
+        return false; // nothing can leave a wrapped world
+    }
+    const float distance = std::sqrt((position.x * position.x) + (position.y * position.y));
+    return distance > POSITION_DISTANCE * 2.5f;
+}
+
+constexpr bool NUTRIENT_FIELD_PLANTS = false; // Store plant calories on a dense grid instead of individual Plant objects (see NutrientField.hpp)
 
 const int FONT_SIZE = 10;
 
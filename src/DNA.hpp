@@ -6,6 +6,7 @@
 #include <vector>
 #include <random>
 #include <array>
+#include <algorithm>
 
 
 #include "Constants.hpp"
@@ -15,8 +16,8 @@ class Range {
 public:
     float min;
     float max;
-    Range(const float _min, const float _max): min(_min), max(_max) {    }
-    [[nodiscard]] float get_average() const {
+    constexpr Range(const float _min, const float _max): min(_min), max(_max) {    }
+    [[nodiscard]] constexpr float get_average() const {
         return (this->min + this->max) / 2;
     }
     [[nodiscard]] float validate(const float value) const {
@@ -42,7 +43,7 @@ const Range SPEED_RANGE = Range(0.1f, 1.0f);
 std::normal_distribution<float> random_speed(0.5f, 0.25f);
 std::normal_distribution<float> speed_mutation(0.0f, 0.001f * MUTATION_MULTIPLIER);
 
-const Range VISION_RANGE = Range(0.1f, 500.0f);
+constexpr Range VISION_RANGE = Range(0.1f, 500.0f);
 std::normal_distribution<float> random_vision_range(100.0f, 30.0f);
 std::normal_distribution<float> vision_range_mutation(0.0f, 0.0025f * MUTATION_MULTIPLIER);
 
@@ -108,6 +109,15 @@ public:
     float weights[weight_count()];
     float biases[neuron_count()];
 
+    // Derived from the traits above, cached since they are needed every tick
+    float max_health;
+    float max_energy;
+
+    void update_derived() {
+        this->max_health = this->radius * this->radius * RADIUS_MAX_HEALTH_CONVERSION_MULTIPLIER;
+        this->max_energy = this->radius * this->radius * RADIUS_MAX_ENERGY_CONVERSION_MULTIPLIER;
+    }
+
     DNA(bool _1, bool _2) {
         this->radius = RADIUS_RANGE.validate(random_radius(RNG));
         this->diet = DIET_RANGE.validate(random_diet(RNG));
@@ -126,11 +136,21 @@ public:
         for (unsigned short bias_index = 0; bias_index < neuron_count(); bias_index++) {
             this->biases[bias_index] = random_bias(RNG);
         }
+        this->update_derived();
     }
 
     explicit DNA(std::istream &stream) {
         stream >> this;
+        this->update_derived();
     }
+    /**
+     * @param genes Traits, weights and biases in the order of export_genes()
+     */
+    explicit DNA(const float* genes) {
+        this->import_genes(genes);
+        this->update_derived();
+    }
+
     explicit DNA(DNA<INPUT_COUNT, LAYER_SIZE, LAYER_SIZE, OUTPUT_COUNT>* parent) {
         this->radius = RADIUS_RANGE.validate(parent->radius + radius_mutation(RNG));
         this->diet = DIET_RANGE.validate(parent->diet + diet_mutation(RNG));
@@ -149,6 +169,7 @@ public:
         for (unsigned short bias_index = 0; bias_index < neuron_count(); bias_index++) {
             this->biases[bias_index] = parent->biases[bias_index] + bias_mutation(RNG);
         }
+        this->update_derived();
     }
 
     ~DNA() {}
@@ -163,6 +184,37 @@ public:
             stream << "\n";
         }
     }
+    /**
+     * Number of floats written by export_genes()
+     */
+    [[nodiscard]] constexpr static unsigned short gene_count() {
+        return 9 + weight_count() + neuron_count();
+    }
+
+    /**
+     * Copy every trait, weight and bias into a flat array of gene_count() floats, used by binary saves
+     */
+    void export_genes(float* genes) const {
+        const float traits[9] = {this->radius, this->diet, this->speed, this->vision_range, this->egg_energy_transfer, this->metabolism, this->red, this->green, this->blue};
+        std::copy(traits, traits + 9, genes);
+        std::copy(this->weights, this->weights + weight_count(), genes + 9);
+        std::copy(this->biases, this->biases + neuron_count(), genes + 9 + weight_count());
+    }
+
+    void import_genes(const float* genes) {
+        this->radius = genes[0];
+        this->diet = genes[1];
+        this->speed = genes[2];
+        this->vision_range = genes[3];
+        this->egg_energy_transfer = genes[4];
+        this->metabolism = genes[5];
+        this->red = genes[6];
+        this->green = genes[7];
+        this->blue = genes[8];
+        std::copy(genes + 9, genes + 9 + weight_count(), this->weights);
+        std::copy(genes + 9 + weight_count(), genes + gene_count(), this->biases);
+    }
+
     void import_parameters(std::istream &stream) {
         for (float &weight: this->weights) {
             stream >> weight;
@@ -210,11 +262,11 @@ public:
     }
 
     [[nodiscard]] float get_max_health() const {
-        return this->radius * this->radius * RADIUS_MAX_HEALTH_CONVERSION_MULTIPLIER;
+        return this->max_health;
     }
 
     [[nodiscard]] float get_max_energy() const {
-        return this->radius * this->radius * RADIUS_MAX_ENERGY_CONVERSION_MULTIPLIER;
+        return this->max_energy;
     }
 
     [[nodiscard]] Color get_color() const {
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <memory>
+
 #include "Body.hpp"
 #include "DNA.hpp"
 
@@ -7,12 +9,48 @@
 constexpr unsigned int HATCH_AGE = 500;
 
 
+/**
+ * Flat copy of an egg's saved state, the genome is shared instead of copied, see Snapshot.hpp
+ */
+class EggRecord {
+public:
+    unsigned long id;
+    float radius;
+    Vector2 position;
+    float energy;
+    unsigned int age;
+    bool hatched;
+    std::shared_ptr<DNA_t> dna;
+
+    friend std::ostream &operator<<(std::ostream &stream, const EggRecord &record) {
+        stream << record.id;
+        stream << "\n";
+        stream << record.radius;
+        stream << "\n";
+        stream << record.position.x;
+        stream << "\n";
+        stream << record.position.y;
+        stream << "\n";
+        stream << record.energy;
+        stream << "\n";
+        stream << record.age;
+        stream << "\n";
+        stream << record.hatched;
+        stream << "\n";
+        stream << record.dna.get();
+        stream << "\n";
+        return stream;
+    }
+};
+
+
 class Egg: public Body {
 private:
     unsigned int age;
     float energy;
     bool hatched;
-    DNA<INPUT_COUNT, LAYER_SIZE, LAYER_SIZE, OUTPUT_COUNT>* dna;
+    std::shared_ptr<DNA_t> dna; // Shared with the parent and the cell that hatches, genomes are never modified after construction
+    unsigned long parent_id = 0; // Cell that laid it, 0 when unknown, not saved, see Lineage.hpp
 public:
 //    Egg() {}
 
@@ -31,15 +69,26 @@ public:
         stream >> this;
     }
 
-    Egg(DNA<INPUT_COUNT, LAYER_SIZE, LAYER_SIZE, OUTPUT_COUNT>* _dna, const float _energy, const Vector2 _position) {
+    explicit Egg(const EggRecord &record) {
+        this->id = record.id;
+        this->radius = record.radius;
+        this->position = record.position;
+        this->energy = record.energy;
+        this->age = record.age;
+        this->hatched = record.hatched;
+        this->dna = record.dna;
+    }
+
+    Egg(std::shared_ptr<DNA_t> _dna, const float _energy, const Vector2 _position, const unsigned long _parent_id) {
         this->id = get_new_id();
+        this->parent_id = _parent_id;
         this->radius = 1;
         this->position.x = _position.x;
         this->position.y = _position.y;
         this->energy = _energy;
         this->age = 0;
         this->hatched = false;
-        this->dna = _dna;
+        this->dna = std::move(_dna);
         this->wrap_position();
     }
 
@@ -51,32 +100,18 @@ public:
         this->energy = _energy;
         this->age = 0;
         this->hatched = false;
-        this->dna = new DNA<INPUT_COUNT, LAYER_SIZE, LAYER_SIZE, OUTPUT_COUNT>(false, false);
+        this->dna = std::make_shared<DNA_t>(false, false);
         this->wrap_position();
     }
 
-    ~Egg() {
-        // actually don't delete dna since it needs to be passed on to cell, no point in copying it
+    ~Egg() = default;
+
+    [[nodiscard]] EggRecord get_record() const {
+        return {this->id, this->radius, this->position, this->energy, this->age, this->hatched, this->dna};
     }
 
     friend std::ostream &operator<<(std::ostream &stream, const Egg* egg) {
-        stream << egg->id;
-        stream << "\n";
-        stream << egg->radius;
-        stream << "\n";
-        stream << egg->position.x;
-        stream << "\n";
-        stream << egg->position.y;
-        stream << "\n";
-        stream << egg->energy;
-        stream << "\n";
-        stream << egg->age;
-        stream << "\n";
-        stream << egg->hatched;
-        stream << "\n";
-        stream << egg->dna;
-        stream << "\n";
-        return stream;
+        return stream << egg->get_record();
     }
     friend std::istream &operator>>(std::istream &stream, Egg* egg) {
         stream >> egg->id;
@@ -86,7 +121,7 @@ public:
         stream >> egg->energy;
         stream >> egg->age;
         stream >> egg->hatched;
-        egg->dna = new DNA_t(stream);
+        egg->dna = std::make_shared<DNA_t>(stream);
         return stream;
     }
 
@@ -102,11 +137,15 @@ public:
         this->hatched = true;
     }
 
-    void tick() {
-        this->age++;
+    void tick(const unsigned int timestep) {
+        this->age += timestep;
+    }
+
+    [[nodiscard]] unsigned long get_parent_id() const {
+        return this->parent_id;
     }
 
-    DNA<INPUT_COUNT, LAYER_SIZE, LAYER_SIZE, OUTPUT_COUNT>* get_dna() {
+    [[nodiscard]] const std::shared_ptr<DNA_t>& get_dna() const {
         return this->dna;
     }
 
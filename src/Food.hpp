@@ -6,6 +6,7 @@
 
 
 #include <raylib.h>
+#include <iostream>
 
 
 enum FoodType {
@@ -13,28 +14,72 @@ enum FoodType {
     MEAT
 };
 
-class Food: public Body {
-protected:
+/**
+ * Per food type data, indexed by FoodType
+ * Looked up with the type tag instead of going through virtual calls in the interaction and render loops, about half
+ * the time per food, see tests/FoodLayoutBench.cpp
+ */
+constexpr float FOOD_SENSOR_COLORS[2][3] = {
+        {0.0f, 255.0f, 0.0f}, // PLANT
+        {255.0f, 0.0f, 0.0f} // MEAT
+};
+constexpr Color FOOD_DRAW_COLORS[2] = {
+        GREEN, // PLANT
+        RED // MEAT
+};
+
+/**
+ * Flat copy of a food's saved state, see Snapshot.hpp
+ */
+class FoodRecord {
+public:
+    unsigned long id;
+    float radius;
+    Vector2 position;
     float calories;
     bool consumed;
-public:
-    virtual ~Food() = default;
+    FoodType food_type;
 
-    friend std::ostream &operator<<(std::ostream &stream, const Food* food) {
-        stream << food->id;
+    friend std::ostream &operator<<(std::ostream &stream, const FoodRecord &record) {
+        stream << record.id;
         stream << "\n";
-        stream << food->radius;
+        stream << record.radius;
         stream << "\n";
-        stream << food->position.x;
+        stream << record.position.x;
         stream << "\n";
-        stream << food->position.y;
+        stream << record.position.y;
         stream << "\n";
-        stream << food->calories;
+        stream << record.calories;
         stream << "\n";
-        stream << food->consumed;
+        stream << record.consumed;
         stream << "\n";
         return stream;
     }
+};
+
+class Food: public Body {
+protected:
+    FoodType food_type;
+    float calories;
+    bool consumed;
+public:
+    virtual ~Food() = default;
+
+    void set_record(const FoodRecord &record) {
+        this->id = record.id;
+        this->radius = record.radius;
+        this->position = record.position;
+        this->calories = record.calories;
+        this->consumed = record.consumed;
+    }
+
+    [[nodiscard]] FoodRecord get_record() const {
+        return {this->id, this->radius, this->position, this->calories, this->consumed, this->food_type};
+    }
+
+    friend std::ostream &operator<<(std::ostream &stream, const Food* food) {
+        return stream << food->get_record();
+    }
     friend std::istream &operator>>(std::istream &stream, Food* food) {
         stream >> food->id;
         stream >> food->radius;
@@ -44,8 +89,8 @@ public:
         stream >> food->consumed;
         return stream;
     }
-    [[nodiscard]] virtual FoodType get_food_type() const {
-        return PLANT;
+    [[nodiscard]] FoodType get_food_type() const {
+        return this->food_type;
     }
 
     [[nodiscard]] float get_calories() const {
@@ -63,14 +108,17 @@ public:
     }
 
     [[nodiscard]] bool is_too_far() const {
-        const float distance = std::sqrt((this->position.x * this->position.x) + (this->position.y * this->position.y));
-        return distance > POSITION_DISTANCE * 2.5f;
+        return ::is_too_far(this->position);
     }
 
     void add_calories(const float _calories) {
         this->calories += _calories;
     }
 
+    void update_radius() {
+        this->radius = std::sqrt(this->calories / 4.0f);
+    }
+
     void consume() {
         this->consumed = true;
     }
@@ -79,77 +127,67 @@ public:
         this->position.y = _position.y;
     }
 
-    virtual float get_red() = 0;
-    virtual float get_green() = 0;
-    virtual float get_blue() = 0;
+    [[nodiscard]] float get_red() const {
+        return FOOD_SENSOR_COLORS[this->food_type][0];
+    }
+    [[nodiscard]] float get_green() const {
+        return FOOD_SENSOR_COLORS[this->food_type][1];
+    }
+    [[nodiscard]] float get_blue() const {
+        return FOOD_SENSOR_COLORS[this->food_type][2];
+    }
+
+    [[nodiscard]] Color get_color() const {
+        return FOOD_DRAW_COLORS[this->food_type];
+    }
+
+    void draw() const {
+        DrawCircle((int) std::round(this->position.x), (int) std::round(this->position.y) , this->radius, this->get_color());
+    }
 };
 
 class Plant: public Food {
 public:
     explicit Plant(std::istream &stream) {
+        this->food_type = PLANT;
         stream >> this;
     }
+    explicit Plant(const FoodRecord &record) {
+        this->food_type = PLANT;
+        this->set_record(record);
+    }
     ~Plant() override = default;
     Plant(const float _calories, const Vector2 _position) {
+        this->food_type = PLANT;
         this->id = get_new_id();
         this->calories = _calories;
-        this->radius = std::sqrt(this->calories / 4.0f);
+        this->update_radius();
         this->position.x = _position.x;
         this->position.y = _position.y;
         this->consumed = false;
         this->wrap_position();
     }
-
-    [[nodiscard]] FoodType get_food_type() const override {
-        return PLANT;
-    }
-
-    Color get_color() override {
-        return GREEN;
-    }
-
-    [[nodiscard]] float get_red() override {
-        return 0.0f;
-    }
-    [[nodiscard]] float get_blue() override {
-        return 0.0f;
-    }
-    [[nodiscard]] float get_green() override {
-        return 255.0f;
-    }
 };
 
 class Meat: public Food {
 public:
     explicit Meat(std::istream &stream) {
+        this->food_type = MEAT;
         stream >> this;
     }
+    explicit Meat(const FoodRecord &record) {
+        this->food_type = MEAT;
+        this->set_record(record);
+    }
     ~Meat() override = default;
     Meat(const float _calories, const Vector2 _position) {
+        this->food_type = MEAT;
         this->id = get_new_id();
-        this->id = Body::id_count;
         this->calories = _calories;
-        this->radius = std::sqrt(this->calories / 4.0f);
+        this->update_radius();
         this->position.x = _position.x;
         this->position.y = _position.y;
         this->consumed = false;
         this->wrap_position();
     }
-
-    [[nodiscard]] FoodType get_food_type() const override {
-        return MEAT;
-    }
-
-    Color get_color() override {
-        return RED;
-    }
-    [[nodiscard]] float get_red() override {
-        return 255.0f;
-    }
-    [[nodiscard]] float get_blue() override {
-        return 0.0f;
-    }
-    [[nodiscard]] float get_green() override {
-        return 0.0f;
-    }
 };
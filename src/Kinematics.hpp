@@ -0,0 +1,163 @@
+#pragma once
+
+
+#include <vector>
+#include <cmath>
+#include <array>
+
+
+#include "Constants.hpp"
+#include "Cell.hpp"
+#include "SimdMath.hpp"
+
+
+constexpr bool BATCHED_CELL_UPDATE = true; // Run movement, digestion and energy costs over packed arrays instead of per cell
+
+
+/**
+ * Structure of arrays copy of the per-tick cell state
+ * gather() after Cell::think(), update() once for the whole batch, then scatter() back into the cells
+ * Matches Cell::act() within float rounding (sincos error and the energy costs being summed before they are spent)
+ */
+class CellBatch {
+private:
+    std::vector<Cell*> cells;
+    std::vector<float> timestep;
+    std::vector<float> angle;
+    std::vector<float> angular_velocity;
+    std::vector<float> movement;
+    std::vector<float> strafe_movement;
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> velocity_x;
+    std::vector<float> velocity_y;
+    std::vector<float> plant_calories;
+    std::vector<float> meat_calories;
+    std::vector<float> energy;
+    std::vector<float> waste;
+    std::vector<float> health;
+    std::vector<float> metabolism;
+    std::vector<float> diet;
+    std::vector<float> radius_squared;
+    std::vector<float> max_energy;
+    std::vector<float> stab_cost;
+    std::vector<float> sines;
+    std::vector<float> cosines;
+
+    [[nodiscard]] std::array<std::vector<float>*, 21> arrays() {
+        return {&this->timestep, &this->angle, &this->angular_velocity, &this->movement, &this->strafe_movement,
+                &this->x, &this->y, &this->velocity_x, &this->velocity_y, &this->plant_calories, &this->meat_calories,
+                &this->energy, &this->waste, &this->health, &this->metabolism, &this->diet, &this->radius_squared,
+                &this->max_energy, &this->stab_cost, &this->sines, &this->cosines};
+    }
+
+public:
+    void clear() {
+        this->cells.clear();
+        for (std::vector<float>* array: this->arrays()) {
+            array->clear();
+        }
+    }
+
+    /**
+     * Copy a cell's state into the batch, best done right after Cell::think() while the cell is still in cache
+     */
+    void gather(Cell* cell) {
+        this->cells.push_back(cell);
+        this->timestep.push_back((float) cell->timestep);
+        this->angle.push_back(cell->angle);
+        this->angular_velocity.push_back(cell->angular_velocity);
+        this->movement.push_back(cell->movement);
+        this->strafe_movement.push_back(cell->strafe_movement);
+        this->x.push_back(cell->position.x);
+        this->y.push_back(cell->position.y);
+        this->plant_calories.push_back(cell->stomach.plant_calories);
+        this->meat_calories.push_back(cell->stomach.meat_calories);
+        this->energy.push_back(cell->energy);
+        this->waste.push_back(cell->waste);
+        this->health.push_back(cell->health);
+        this->metabolism.push_back(cell->dna->metabolism);
+        this->diet.push_back(cell->dna->diet);
+        this->radius_squared.push_back(cell->radius * cell->radius);
+        this->max_energy.push_back(cell->dna->get_max_energy());
+        this->stab_cost.push_back(cell->want_stab ? STAB_COST_MULTIPLIER : 0.0f);
+    }
+
+    /**
+     * Advance every gathered cell, the equivalent of Cell::act()
+     */
+    void update() {
+        const size_t count = this->cells.size();
+        this->velocity_x.resize(count);
+        this->velocity_y.resize(count);
+        this->sines.resize(count);
+        this->cosines.resize(count);
+
+        for (size_t index = 0; index < count; index++) {
+            float _angle = this->angle[index] + this->angular_velocity[index] * MOVEMENT_MULTIPLIER * this->timestep[index];
+            _angle = _angle > TAU ? _angle - TAU : _angle;
+            _angle = _angle < -TAU ? _angle + TAU : _angle;
+            this->angle[index] = _angle;
+        }
+
+        batch_sincos(this->angle.data(), this->sines.data(), this->cosines.data(), count);
+
+        for (size_t index = 0; index < count; index++) {
+            const float dt = this->timestep[index];
+            // cos(angle + pi/2) = -sin(angle), sin(angle + pi/2) = cos(angle)
+            const float _velocity_x = this->cosines[index] * this->movement[index] * MOVEMENT_MULTIPLIER - this->sines[index] * this->strafe_movement[index] * MOVEMENT_MULTIPLIER;
+            const float _velocity_y = this->sines[index] * this->movement[index] * MOVEMENT_MULTIPLIER + this->cosines[index] * this->strafe_movement[index] * MOVEMENT_MULTIPLIER;
+            this->velocity_x[index] = _velocity_x;
+            this->velocity_y[index] = _velocity_y;
+            this->x[index] += _velocity_x * dt;
+            this->y[index] += _velocity_y * dt;
+
+            // digestion
+            const float plant_digestion = std::min(this->plant_calories[index] * this->metabolism[index] * dt, this->plant_calories[index]);
+            const float meat_digestion = std::min(this->meat_calories[index] * this->metabolism[index] * dt, this->meat_calories[index]);
+            this->plant_calories[index] -= plant_digestion;
+            this->meat_calories[index] -= meat_digestion;
+            const float plant_energy = plant_digestion * PLANT_EFFICIENCY_COEFFICIENT * (1 - this->diet[index]);
+            const float meat_energy = meat_digestion * MEAT_EFFICIENCY_COEFFICIENT * this->diet[index];
+            float _energy = this->energy[index] + plant_energy + meat_energy;
+            float _waste = this->waste[index] + (plant_digestion - plant_energy) + (meat_digestion - meat_energy);
+            const float digestion_surplus = std::max(_energy - this->max_energy[index], 0.0f);
+            _energy -= digestion_surplus;
+            _waste += digestion_surplus;
+
+            // every cost at once, spending more than there is turns the debt into damage like Cell::use_energy()
+            const float cost = (this->stab_cost[index]
+                    + SIZE_PASSIVE_ENERGY_COST_MULTIPLIER * this->radius_squared[index]
+                    + LINEAR_SPEED_ACTIVE_ENERGY_COST_MULTIPLIER * (std::abs(this->movement[index]) + std::abs(this->strafe_movement[index])) * this->radius_squared[index]
+                    + ANGULAR_SPEED_ACTIVE_ENERGY_COST_MULTIPLIER * std::abs(this->angular_velocity[index]) * this->radius_squared[index]) * dt;
+            const float spent = std::min(cost, _energy);
+            const float energy_debt = cost - spent;
+            this->health[index] = std::max(this->health[index] - energy_debt * ENERGY_DEBT_DAMAGE_MULTIPLIER, 0.0f);
+            _energy -= spent;
+            _waste += spent;
+
+            const float surplus = std::max(_energy - this->max_energy[index], 0.0f);
+            this->energy[index] = _energy - surplus;
+            this->waste[index] = _waste + surplus;
+        }
+    }
+
+    /**
+     * Write the results of update() back into the cells
+     */
+    void scatter() {
+        for (size_t index = 0; index < this->cells.size(); index++) {
+            Cell* cell = this->cells[index];
+            cell->angle = this->angle[index];
+            cell->velocity = {this->velocity_x[index], this->velocity_y[index]};
+            cell->position = {this->x[index], this->y[index]};
+            cell->wrap_position();
+            cell->stomach.plant_calories = this->plant_calories[index];
+            cell->stomach.meat_calories = this->meat_calories[index];
+            cell->energy = this->energy[index];
+            cell->waste = this->waste[index];
+            cell->health = this->health[index];
+            cell->age += cell->timestep;
+        }
+    }
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+
+#include "Constants.hpp"
+
+
+constexpr bool LOD_SIMULATION = false; // Simulate bodies far from the camera at a reduced tick rate
+constexpr unsigned int LOD_TICK_INTERVAL = 4; // Far bodies update every this many ticks
+constexpr float LOD_FULL_DETAIL_DISTANCE = 1500.0f; // Bodies closer than this to the camera always update every tick
+
+
+/**
+ * Level of detail scheduling
+ *
+ * Far from the camera, a body only updates on one out of every LOD_TICK_INTERVAL ticks (staggered by id so the load
+ * stays even) and then advances LOD_TICK_INTERVAL ticks worth of time at once: movement, turning, digestion, every
+ * energy cost, stab damage, age and egg age are all multiplied by the timestep. Near the camera the timestep is always 1
+ * and the simulation is exactly the same as without LOD.
+ *
+ * Energy bookkeeping:
+ * Every scaled quantity only moves energy between pools that already exist (stomach -> energy + waste, energy -> waste,
+ * health loss from energy debt) so nothing is created or destroyed, the closed energy system stays closed.
+ * What is approximated is the rate:
+ *  - Digestion takes min(metabolism * timestep, 1) of the stomach instead of 1 - (1 - metabolism)^timestep,
+ *    slightly faster than full rate for the same number of ticks
+ *  - The max energy cap is applied once per update instead of every tick, so a far cell can't bank energy it would
+ *    have lost between updates but might lose a little more than it would have
+ *  - Brain decisions, vision and eating happen once per update, so far cells react LOD_TICK_INTERVAL times slower
+ *  - Bodies crossing the LOD_FULL_DETAIL_DISTANCE boundary can gain or lose up to LOD_TICK_INTERVAL - 1 ticks
+ */
+class LevelOfDetail {
+public:
+    [[nodiscard]] static bool is_far(const Vector2 position, const Vector2 focus) {
+        const float dx = wrap_delta(position.x - focus.x);
+        const float dy = wrap_delta(position.y - focus.y);
+        return dx * dx + dy * dy > LOD_FULL_DETAIL_DISTANCE * LOD_FULL_DETAIL_DISTANCE;
+    }
+
+    /**
+     * How many ticks worth of simulation a body advances this tick
+     * @param id Body id, used to stagger far bodies across ticks
+     * @param position Body position
+     * @param focus Camera target
+     * @param tick Current tick
+     * @return 1 at full detail, LOD_TICK_INTERVAL on a far body's update tick, 0 when a far body skips this tick
+     */
+    [[nodiscard]] static unsigned int timestep(const unsigned long id, const Vector2 position, const Vector2 focus, const unsigned long tick) {
+        if (!LOD_SIMULATION) {
+            return 1;
+        }
+        if (!LevelOfDetail::is_far(position, focus)) {
+            return 1;
+        }
+        if ((tick + id) % LOD_TICK_INTERVAL == 0) {
+            return LOD_TICK_INTERVAL;
+        }
+        return 0;
+    }
+};
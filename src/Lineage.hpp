@@ -0,0 +1,439 @@
+#pragma once
+
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <unordered_map>
+#include <algorithm>
+#include <mutex>
+#include <semaphore>
+#include <format>
+#include <type_traits>
+
+
+#include "Subsystem.hpp"
+#include "BinarySave.hpp"
+#include "Logging.hpp"
+
+
+constexpr uint32_t LINEAGE_VERSION = 1; // Bump whenever LineageEvent or LineageIndexEntry change
+constexpr char LINEAGE_MAGIC[8] = {'M', 'E', 'A', 'T', 'L', 'I', 'N', 'E'};
+constexpr char LINEAGE_INDEX_MAGIC[8] = {'M', 'E', 'A', 'T', 'L', 'I', 'D', 'X'};
+constexpr std::string LINEAGE_INDEX_EXTENSION = ".idx";
+constexpr size_t LINEAGE_BLOCK_EVENTS = 4096; // Events buffered before they are handed to the writer, one index entry each
+
+
+/*
+ * Lineage logs record every birth and death as fixed size events, appended in the order they happen, so the family
+ * tree of any cell can be rebuilt after the run. A second file next to the log (LINEAGE_INDEX_EXTENSION) holds one
+ * LineageIndexEntry per block of events with the range of ids born and died in it.
+ * New entities get the highest id yet, so births are logged in id order and a birth is found through the index by
+ * scanning a single block. Rewinding (see Rewind.hpp) hands out ids again, a later birth of an id wins over an
+ * earlier one.
+ */
+
+
+enum LineageEventType: uint32_t {
+    EGG_LAID, // subject: the egg, other: the cell that laid it
+    HATCHED, // subject: the new cell, other: the egg it hatched from
+    DIED // subject: the cell, other: the cell whose stab killed it, 0 if it starved
+};
+
+class LineageEvent {
+public:
+    uint64_t tick;
+    uint64_t subject;
+    uint64_t other;
+    uint32_t type;
+    uint32_t padding;
+
+    [[nodiscard]] bool is_birth() const {
+        return this->type == EGG_LAID or this->type == HATCHED;
+    }
+};
+
+class LineageFileHeader {
+public:
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+};
+
+/**
+ * What one block of events holds, ranges are empty (minimum above maximum) when there is nothing of a kind
+ */
+class LineageIndexEntry {
+public:
+    uint64_t first_event;
+    uint64_t event_count;
+    uint64_t first_tick;
+    uint64_t last_tick;
+    uint64_t min_birth;
+    uint64_t max_birth;
+    uint64_t min_death;
+    uint64_t max_death;
+
+    [[nodiscard]] static LineageIndexEntry describe(const LineageEvent* events, const uint64_t first_event, const uint64_t event_count) {
+        LineageIndexEntry entry{first_event, event_count, UINT64_MAX, 0, UINT64_MAX, 0, UINT64_MAX, 0};
+        for (uint64_t index = 0; index < event_count; index++) {
+            const LineageEvent &event = events[index];
+            entry.first_tick = std::min(entry.first_tick, event.tick);
+            entry.last_tick = std::max(entry.last_tick, event.tick);
+            uint64_t &minimum = event.is_birth() ? entry.min_birth : entry.min_death;
+            uint64_t &maximum = event.is_birth() ? entry.max_birth : entry.max_death;
+            minimum = std::min(minimum, event.subject);
+            maximum = std::max(maximum, event.subject);
+        }
+        return entry;
+    }
+};
+
+static_assert(std::is_trivially_copyable_v<LineageEvent> and sizeof(LineageEvent) == 32);
+static_assert(std::is_trivially_copyable_v<LineageIndexEntry> and std::is_trivially_copyable_v<LineageFileHeader>);
+
+
+[[nodiscard]] std::filesystem::path lineage_index_path(const std::filesystem::path &path) {
+    return path.string() + LINEAGE_INDEX_EXTENSION;
+}
+
+/**
+ * @return Number of whole records after a valid header, -1 if the file doesn't start with one
+ */
+[[nodiscard]] int64_t count_lineage_records(const unsigned char* data, const size_t size, const char (&magic)[8], const uint32_t record_size) {
+    if (size < sizeof(LineageFileHeader)) {
+        return -1;
+    }
+    LineageFileHeader header;
+    std::memcpy(&header, data, sizeof(LineageFileHeader));
+    if (std::memcmp(header.magic, magic, sizeof(header.magic)) != 0 or header.version != LINEAGE_VERSION or header.record_size != record_size) {
+        return -1;
+    }
+    return (int64_t) ((size - sizeof(LineageFileHeader)) / record_size);
+}
+
+
+/**
+ * Appends the simulation's births and deaths to a lineage log on its own thread
+ * The simulation thread fills a block with record() and only hands full blocks over, so logging an event costs a
+ * store into the block. Births and deaths all happen between the parallel passes, in produce() and clear(), so a
+ * single block on the simulation thread takes every event.
+ */
+class LineageSubsystem: public Subsystem {
+private:
+    std::filesystem::path path;
+    std::ofstream events_file;
+    std::ofstream index_file;
+    uint64_t event_count = 0; // Written so far, including earlier runs
+    bool is_open = false; // Only touched by this subsystem's thread
+
+    std::vector<LineageEvent> block; // Only touched by the simulation thread
+    std::mutex pending_lock;
+    std::vector<std::vector<LineageEvent>> pending; // Full blocks, not written yet
+    std::counting_semaphore<> write_notifier{0};
+
+    /**
+     * Continue an existing log, dropping a partly written event and indexing events that lost their index entry
+     * @return Whether the log and its index can be appended to
+     */
+    bool recover() {
+        LineageIndexEntry tail;
+        uint64_t kept_entries = 0;
+        {
+            MappedFile events;
+            MappedFile index;
+            if (!events.open(this->path) or !index.open(lineage_index_path(this->path))) {
+                return false;
+            }
+            const int64_t record_count = count_lineage_records(events.get_data(), events.get_size(), LINEAGE_MAGIC, sizeof(LineageEvent));
+            const int64_t entry_count = count_lineage_records(index.get_data(), index.get_size(), LINEAGE_INDEX_MAGIC, sizeof(LineageIndexEntry));
+            if (record_count < 0 or entry_count < 0) {
+                return false;
+            }
+            this->event_count = (uint64_t) record_count;
+            const LineageIndexEntry* entries = (const LineageIndexEntry*) (index.get_data() + sizeof(LineageFileHeader));
+            uint64_t indexed_events = 0;
+            while ((int64_t) kept_entries < entry_count and entries[kept_entries].first_event == indexed_events and entries[kept_entries].event_count <= this->event_count - indexed_events) {
+                indexed_events += entries[kept_entries].event_count;
+                kept_entries++;
+            }
+            const LineageEvent* unindexed = (const LineageEvent*) (events.get_data() + sizeof(LineageFileHeader)) + indexed_events;
+            tail = LineageIndexEntry::describe(unindexed, indexed_events, this->event_count - indexed_events);
+        }
+
+        std::error_code error;
+        std::filesystem::resize_file(this->path, sizeof(LineageFileHeader) + this->event_count * sizeof(LineageEvent), error);
+        if (!error) {
+            std::filesystem::resize_file(lineage_index_path(this->path), sizeof(LineageFileHeader) + kept_entries * sizeof(LineageIndexEntry), error);
+        }
+        if (error) {
+            return false;
+        }
+        this->events_file.open(this->path, std::ios::out | std::ios::binary | std::ios::app);
+        this->index_file.open(lineage_index_path(this->path), std::ios::out | std::ios::binary | std::ios::app);
+        if (tail.event_count > 0) {
+            this->index_file.write((const char*) &tail, sizeof(LineageIndexEntry));
+            this->index_file.flush();
+        }
+        return true;
+    }
+
+    static void create(std::ofstream &file, const std::filesystem::path &path, const char (&magic)[8], const uint32_t record_size) {
+        LineageFileHeader header{};
+        std::memcpy(header.magic, magic, sizeof(header.magic));
+        header.version = LINEAGE_VERSION;
+        header.record_size = record_size;
+        file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        file.write((const char*) &header, sizeof(LineageFileHeader));
+        file.flush();
+    }
+
+    void init() override {
+        std::error_code error;
+        if (std::filesystem::exists(this->path, error)) {
+            this->is_open = this->recover();
+        }
+        else {
+            LineageSubsystem::create(this->events_file, this->path, LINEAGE_MAGIC, sizeof(LineageEvent));
+            LineageSubsystem::create(this->index_file, lineage_index_path(this->path), LINEAGE_INDEX_MAGIC, sizeof(LineageIndexEntry));
+            this->is_open = true;
+        }
+        this->is_open = this->is_open and this->events_file.good() and this->index_file.good();
+        if (!this->is_open) {
+            this->log(Log::CRITICAL, std::format("Lineage log {} can't be written, or exists and is not a lineage log of this version, nothing is logged", this->path.string()));
+        }
+    }
+
+    void update() override {
+        this->write_notifier.acquire();
+        this->write_pending();
+    }
+
+    void write_pending() {
+        std::vector<std::vector<LineageEvent>> blocks;
+        {
+            std::lock_guard<std::mutex> guard(this->pending_lock);
+            blocks.swap(this->pending);
+        }
+        if (!this->is_open or blocks.empty()) {
+            return;
+        }
+        for (const std::vector<LineageEvent> &events: blocks) {
+            const LineageIndexEntry entry = LineageIndexEntry::describe(events.data(), this->event_count, events.size());
+            this->events_file.write((const char*) events.data(), (std::streamsize) (events.size() * sizeof(LineageEvent)));
+            this->index_file.write((const char*) &entry, sizeof(LineageIndexEntry));
+            this->event_count += events.size();
+        }
+        // the index is flushed last so it never points past the events
+        this->events_file.flush();
+        this->index_file.flush();
+        if (!this->events_file.good() or !this->index_file.good()) {
+            this->log(Log::CRITICAL, std::format("Writing lineage log {} failed, logging stopped", this->path.string()));
+            this->is_open = false;
+        }
+    }
+
+    void on_shutdown() override {
+        this->write_pending(); // blocks handed over right before shutting down, see flush()
+    }
+
+    void on_panic() override {
+
+    }
+
+    void signal_shutdown() override {
+        this->should_shutdown.store(true);
+
+        //release all semaphores
+        this->write_notifier.release();
+    }
+
+    void signal_panic() override {
+        this->should_panic.store(true);
+
+        //release all semaphores
+        this->write_notifier.release();
+    }
+
+    [[nodiscard]] constexpr float warning_loop_second_threshold() const override {
+        return -1; // Disabled, waits for blocks
+    }
+
+    [[nodiscard]] constexpr float critical_loop_second_threshold() const override {
+        return -1; // Disabled, waits for blocks
+    }
+
+public:
+    /**
+     * @param path Log to append to, created with its index when missing
+     */
+    explicit LineageSubsystem(std::filesystem::path path): path(std::move(path)) {
+        this->block.reserve(LINEAGE_BLOCK_EVENTS);
+    }
+
+    ~LineageSubsystem() = default;
+
+    /**
+     * Log an event, only call from the simulation thread
+     */
+    void record(const LineageEventType type, const uint64_t tick, const uint64_t subject, const uint64_t other) {
+        this->block.push_back({tick, subject, other, type, 0});
+        if (this->block.size() >= LINEAGE_BLOCK_EVENTS) {
+            this->flush();
+        }
+    }
+
+    /**
+     * Hand the events logged so far to the writer, call from the simulation thread before shutting down
+     */
+    void flush() {
+        if (this->block.empty()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(this->pending_lock);
+            this->pending.push_back(std::move(this->block));
+        }
+        this->block = {};
+        this->block.reserve(LINEAGE_BLOCK_EVENTS);
+        this->write_notifier.release();
+    }
+
+    [[nodiscard]] constexpr std::string id() const override {
+        return "Lineage Subsystem";
+    }
+};
+
+
+/**
+ * Answers questions about a lineage log without reading all of it
+ * The log is memory mapped and only the index is read up front, lookups scan the blocks the index points them to.
+ */
+class LineageReader {
+private:
+    MappedFile events_file;
+    std::vector<LineageIndexEntry> index;
+    const LineageEvent* events = nullptr;
+    uint64_t event_count = 0;
+
+    /**
+     * Newest event about a subject
+     * @param birth Whether to look for its birth or its death
+     */
+    [[nodiscard]] bool find(const uint64_t subject, const bool birth, LineageEvent &found) const {
+        for (auto entry = this->index.rbegin(); entry != this->index.rend(); entry++) {
+            const bool in_range = birth ? entry->min_birth <= subject and subject <= entry->max_birth : entry->min_death <= subject and subject <= entry->max_death;
+            if (!in_range) {
+                continue;
+            }
+            for (uint64_t index = entry->first_event + entry->event_count; index > entry->first_event; index--) {
+                const LineageEvent &event = this->events[index - 1];
+                if (event.subject == subject and event.is_birth() == birth) {
+                    found = event;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+public:
+    /**
+     * @return Whether the file is a lineage log, events without an intact index entry are indexed here
+     */
+    bool open(const std::filesystem::path &path) {
+        if (!this->events_file.open(path)) {
+            return false;
+        }
+        const int64_t record_count = count_lineage_records(this->events_file.get_data(), this->events_file.get_size(), LINEAGE_MAGIC, sizeof(LineageEvent));
+        if (record_count < 0) {
+            return false;
+        }
+        this->event_count = (uint64_t) record_count;
+        this->events = (const LineageEvent*) (this->events_file.get_data() + sizeof(LineageFileHeader));
+
+        MappedFile index_file;
+        uint64_t indexed_events = 0;
+        if (index_file.open(lineage_index_path(path))) {
+            const int64_t entry_count = count_lineage_records(index_file.get_data(), index_file.get_size(), LINEAGE_INDEX_MAGIC, sizeof(LineageIndexEntry));
+            const LineageIndexEntry* entries = (const LineageIndexEntry*) (index_file.get_data() + sizeof(LineageFileHeader));
+            for (int64_t entry = 0; entry < entry_count; entry++) {
+                if (entries[entry].first_event != indexed_events or entries[entry].event_count > this->event_count - indexed_events) {
+                    break;
+                }
+                this->index.push_back(entries[entry]);
+                indexed_events += entries[entry].event_count;
+            }
+        }
+        for (uint64_t first = indexed_events; first < this->event_count; first += LINEAGE_BLOCK_EVENTS) {
+            const uint64_t count = std::min((uint64_t) LINEAGE_BLOCK_EVENTS, this->event_count - first);
+            this->index.push_back(LineageIndexEntry::describe(this->events + first, first, count));
+        }
+        return true;
+    }
+
+    [[nodiscard]] bool find_birth(const uint64_t subject, LineageEvent &birth) const {
+        return this->find(subject, true, birth);
+    }
+
+    [[nodiscard]] bool find_death(const uint64_t subject, LineageEvent &death) const {
+        return this->find(subject, false, death);
+    }
+
+    /**
+     * Births from a cell or egg back to the first ancestor the log knows of, the subject's own birth first
+     * Alternates between hatching and laying, every step goes to a lower id so the walk always ends
+     */
+    [[nodiscard]] std::vector<LineageEvent> ancestry(uint64_t subject) const {
+        std::vector<LineageEvent> births;
+        LineageEvent birth;
+        while (subject != 0 and this->find_birth(subject, birth)) {
+            births.push_back(birth);
+            subject = birth.other;
+        }
+        return births;
+    }
+
+    /**
+     * Stream every birth and death below an ancestor in the order they happened
+     * Reads the log once from the ancestor's birth on, memory grows with the size of the family, not of the log
+     * @param visit Called with each event and the generation of its subject, the ancestor being generation 0 and
+     * eggs counting as the generation of the cell that laid them
+     */
+    template<typename Visit> void descendants(const uint64_t ancestor, Visit visit) const {
+        std::unordered_map<uint64_t, uint32_t> generations{{ancestor, 0}};
+        LineageEvent birth;
+        uint64_t start = 0;
+        if (this->find_birth(ancestor, birth)) {
+            for (const LineageIndexEntry &entry: this->index) {
+                if (entry.min_birth <= ancestor and ancestor <= entry.max_birth) {
+                    start = entry.first_event;
+                }
+            }
+        }
+        for (uint64_t index = start; index < this->event_count; index++) {
+            const LineageEvent &event = this->events[index];
+            if (event.is_birth()) {
+                const auto parent = generations.find(event.other);
+                if (parent != generations.end() and event.subject != ancestor) {
+                    const uint32_t generation = parent->second + (event.type == HATCHED ? 1 : 0);
+                    generations[event.subject] = generation;
+                    visit(event, generation);
+                }
+            }
+            else if (event.subject != ancestor) {
+                const auto member = generations.find(event.subject);
+                if (member != generations.end()) {
+                    visit(event, member->second);
+                }
+            }
+        }
+    }
+
+    [[nodiscard]] uint64_t get_event_count() const {
+        return this->event_count;
+    }
+};
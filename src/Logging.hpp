@@ -4,14 +4,29 @@
 #include <iostream>
 #include <chrono>
 #include <mutex>
-#include <queue>
-#include <fstream>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <tuple>
+#include <type_traits>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
 #include <format>
 
 
 #include "ManagerSignals.hpp"
 
 
+constexpr size_t LOG_RING_SIZE = 256 * 1024; // Bytes of records each logging thread can have waiting to be written, see Log::Logger for what happens beyond
+constexpr size_t LOG_MAXIMUM_PAYLOAD = 4096; // Bytes of arguments per record, longer strings are cut short
+constexpr size_t LOG_RECORD_ALIGNMENT = 16;
+
+
 namespace Log {
     /**
      * All logs are written to a log file
@@ -72,48 +87,267 @@ namespace Log {
         return "UNKNOWN";
     }
 
+    [[nodiscard]] bool is_written_to_console(const LogLevel log_level) {
+        return log_level == PANIC or log_level == CRITICAL or log_level == DEBUG;
+    }
+
+    /**
+     * Turns the payload of a record back into its arguments and formats them
+     */
+    using PayloadFormatter = std::string (*)(std::string_view format, const std::byte* payload);
+
+    /**
+     * Fixed part of a record in a LogRing, the arguments follow it
+     * Records are only formatted by the logging thread, the logging call just copies its arguments.
+     */
+    class RecordHeader {
+    public:
+        uint32_t size; // Of the whole record, a multiple of LOG_RECORD_ALIGNMENT
+        bool padding; // Fills the end of the ring when a record didn't fit there, only size is set
+        uint8_t log_level;
+        uint16_t source;
+        std::chrono::system_clock::time_point timestamp;
+        PayloadFormatter formatter;
+        const char* format; // Static, format strings are checked at compile time
+        uint32_t format_size;
+    };
+
+    /**
+     * How an argument is stored in a record
+     * Strings are copied with their length and read back as string views into the record, everything else is copied
+     * as it is.
+     */
+    template<typename Argument> class ArgumentCoder {
+    public:
+        static constexpr bool is_string = std::is_convertible_v<const Argument&, std::string_view> and !std::is_arithmetic_v<Argument>;
+        static_assert(is_string or std::is_trivially_copyable_v<Argument>, "Deferred log arguments are copied into the log ring, format other types before logging them");
+        using Stored = std::conditional_t<is_string, std::string_view, Argument>;
+
+        /**
+         * @param budget String bytes still allowed in the record, strings beyond it are cut short
+         */
+        [[nodiscard]] static size_t size(const Argument &argument, size_t &budget) {
+            if constexpr (is_string) {
+                const size_t length = std::min(std::string_view(argument).size(), budget);
+                budget -= length;
+                return sizeof(uint32_t) + length;
+            }
+            else {
+                return sizeof(Argument);
+            }
+        }
+
+        /**
+         * @param length Bytes of the string that fit, from size()
+         * @return Past the written argument
+         */
+        static std::byte* write(std::byte* destination, const Argument &argument, const size_t length) {
+            if constexpr (is_string) {
+                const uint32_t stored_length = (uint32_t) length;
+                std::memcpy(destination, &stored_length, sizeof(uint32_t));
+                std::memcpy(destination + sizeof(uint32_t), std::string_view(argument).data(), length);
+                return destination + sizeof(uint32_t) + length;
+            }
+            else {
+                std::memcpy(destination, &argument, sizeof(Argument));
+                return destination + sizeof(Argument);
+            }
+        }
+
+        static const std::byte* read(const std::byte* source, Stored &argument) {
+            if constexpr (is_string) {
+                uint32_t length;
+                std::memcpy(&length, source, sizeof(uint32_t));
+                argument = std::string_view((const char*) source + sizeof(uint32_t), length);
+                return source + sizeof(uint32_t) + length;
+            }
+            else {
+                std::memcpy(&argument, source, sizeof(Argument));
+                return source + sizeof(Argument);
+            }
+        }
+    };
+
+    template<typename... Arguments> std::string format_payload(const std::string_view format, const std::byte* payload) {
+        std::tuple<typename ArgumentCoder<Arguments>::Stored...> arguments;
+        std::apply([&payload](auto&... stored) {
+            ((payload = ArgumentCoder<Arguments>::read(payload, stored)), ...);
+        }, arguments);
+        return std::apply([&format](auto&... stored) {
+            return std::vformat(format, std::make_format_args(stored...));
+        }, arguments);
+    }
+
     /**
-     * A single log message
+     * Records of one logging thread, written by it and read by the logging subsystem without locks
+     * Positions only ever grow, the record at a position is at position % LOG_RING_SIZE.
      */
-    class Message {
+    class LogRing {
+    private:
+        std::unique_ptr<std::byte[]> bytes;
+        alignas(64) std::atomic<uint64_t> head = 0; // Written by the logging thread
+        alignas(64) std::atomic<uint64_t> tail = 0; // Written by the logging subsystem
+
     public:
-        const LogLevel log_level;
-        const std::string source;
-        const std::chrono::time_point<std::chrono::system_clock> timestamp;
-        const std::string log_info;
+        LogRing(): bytes(new std::byte[LOG_RING_SIZE]) {    }
+
+        /**
+         * Make room for a record, only from the thread owning the ring
+         * @param size Multiple of LOG_RECORD_ALIGNMENT
+         * @return Where to write the record, nullptr if the ring is full
+         */
+        [[nodiscard]] std::byte* reserve(const size_t size) {
+            uint64_t position = this->head.load(std::memory_order_relaxed);
+            const size_t offset = position % LOG_RING_SIZE;
+            const size_t skipped = offset + size > LOG_RING_SIZE ? LOG_RING_SIZE - offset : 0; // records never wrap around
+            if (position + skipped + size - this->tail.load(std::memory_order_acquire) > LOG_RING_SIZE) {
+                return nullptr;
+            }
+            if (skipped > 0) {
+                RecordHeader* padding = (RecordHeader*) (this->bytes.get() + offset);
+                padding->size = (uint32_t) skipped;
+                padding->padding = true;
+                position += skipped;
+                this->head.store(position, std::memory_order_release);
+            }
+            return this->bytes.get() + position % LOG_RING_SIZE;
+        }
+
+        /**
+         * Hand the reserved record to the logging subsystem
+         */
+        void commit(const size_t size) {
+            this->head.store(this->head.load(std::memory_order_relaxed) + size, std::memory_order_release);
+        }
+
+        /**
+         * Visit every committed record and free its space, only from the logging subsystem
+         */
+        template<typename Visitor> void drain(Visitor &&visit) {
+            uint64_t position = this->tail.load(std::memory_order_relaxed);
+            const uint64_t end = this->head.load(std::memory_order_acquire);
+            while (position < end) {
+                const RecordHeader* header = (const RecordHeader*) (this->bytes.get() + position % LOG_RING_SIZE);
+                if (!header->padding) {
+                    visit(*header, (const std::byte*) (header + 1));
+                }
+                position += header->size;
+            }
+            this->tail.store(position, std::memory_order_release);
+        }
+    };
 
-        Message(const LogLevel log_level, std::string source, std::string log_info): log_level(log_level), source(std::move(source)), timestamp(std::chrono::system_clock::now()), log_info(std::move(log_info)) {     }
+    /**
+     * Log that didn't fit into its thread's ring, formatted right away
+     */
+    class OverflowRecord {
+    public:
+        LogLevel log_level;
+        uint16_t source;
+        std::chrono::system_clock::time_point timestamp;
+        std::string log_info;
+    };
 
-        ~Message() = default;
+    /**
+     * Hashes std::string and std::string_view alike, so sources are looked up without building a string
+     */
+    class SourceHash {
+    public:
+        using is_transparent = void;
 
-        [[nodiscard]] std::string get_string() const {
-            return std::format("[{}] {} at {} -> {}\n", log_level_as_string(this->log_level), this->source, this->timestamp, this->log_info);
+        [[nodiscard]] size_t operator()(const std::string_view source) const {
+            return std::hash<std::string_view>()(source);
         }
     };
 
     /**
      * It logs
+     * Every thread that logs gets a LogRing of its own, so logging threads never wait on each other or on the file.
+     * A logging call copies its level, source id, timestamp and arguments into its ring, the logging subsystem formats
+     * and writes them later. Formatting the console line of DEBUG, CRITICAL and PANIC logs is the only work done
+     * right away.
+     * A thread that logs faster than its ring is written falls back to formatting its logs into a locked overflow
+     * list, so bursts cost more but no log is lost.
      */
     class Logger {
     private:
         std::mutex console_lock;
-        std::mutex pending_logs_lock;
-        std::queue<Message> pending_logs;
+        std::mutex rings_lock; // Only to add rings and sources
+        std::vector<std::unique_ptr<LogRing>> rings;
+        std::vector<std::string> sources;
+        std::unordered_map<std::string, uint16_t, SourceHash, std::equal_to<>> source_ids;
+        std::mutex overflow_lock;
+        std::vector<OverflowRecord> overflow;
+        std::atomic<bool> pending = false; // Set by the first log after the logging subsystem looked
 
         Logger() = default;
         ~Logger() = default;
 
-        /**
-         * Write and remove the first log in the queue
-         * @param file Log file
-         */
-        void write_front_log(std::ofstream &file) {
-            file << this->pending_logs.front().get_string();
-            this->pending_logs.pop();
+        [[nodiscard]] LogRing& get_ring() {
+            thread_local LogRing* ring = nullptr;
+            if (ring == nullptr) {
+                std::lock_guard<std::mutex> guard(this->rings_lock);
+                ring = this->rings.emplace_back(std::make_unique<LogRing>()).get();
+            }
+            return *ring;
+        }
+
+        [[nodiscard]] uint16_t get_source_id(const std::string_view source_name) {
+            thread_local std::unordered_map<std::string, uint16_t, SourceHash, std::equal_to<>> known_sources;
+            const auto known = known_sources.find(source_name);
+            if (known != known_sources.end()) {
+                return known->second;
+            }
+            std::lock_guard<std::mutex> guard(this->rings_lock);
+            auto [source, inserted] = this->source_ids.try_emplace(std::string(source_name), (uint16_t) this->sources.size());
+            if (inserted) {
+                this->sources.emplace_back(source_name);
+            }
+            known_sources.emplace(std::string(source_name), source->second);
+            return source->second;
+        }
+
+        template<typename... Arguments> void enqueue(const LogLevel log_level, const std::string_view source_name, const std::string_view format, const Arguments&... arguments) {
+            size_t budget = LOG_MAXIMUM_PAYLOAD;
+            const size_t lengths[] = {ArgumentCoder<Arguments>::size(arguments, budget)..., 0};
+            size_t payload_size = 0;
+            for (const size_t length: lengths) {
+                payload_size += length;
+            }
+            const size_t size = (sizeof(RecordHeader) + payload_size + LOG_RECORD_ALIGNMENT - 1) / LOG_RECORD_ALIGNMENT * LOG_RECORD_ALIGNMENT;
+            LogRing &ring = this->get_ring();
+            std::byte* record = ring.reserve(size);
+            if (record != nullptr) {
+                RecordHeader* header = (RecordHeader*) record;
+                header->size = (uint32_t) size;
+                header->padding = false;
+                header->log_level = (uint8_t) log_level;
+                header->source = this->get_source_id(source_name);
+                header->timestamp = std::chrono::system_clock::now();
+                header->formatter = &format_payload<Arguments...>;
+                header->format = format.data();
+                header->format_size = (uint32_t) format.size();
+                std::byte* payload = record + sizeof(RecordHeader);
+                size_t index = 0;
+                ((payload = ArgumentCoder<Arguments>::write(payload, arguments, lengths[index] - (ArgumentCoder<Arguments>::is_string ? sizeof(uint32_t) : 0)), index++), ...);
+                ring.commit(size);
+            }
+            else {
+                OverflowRecord overflowed{log_level, this->get_source_id(source_name), std::chrono::system_clock::now(), std::vformat(format, std::make_format_args(arguments...))};
+                std::lock_guard<std::mutex> guard(this->overflow_lock);
+                this->overflow.push_back(std::move(overflowed));
+            }
+            if (!this->pending.exchange(true, std::memory_order_acq_rel)) {
+                this->pending.notify_one();
+            }
+        }
+
+        void write_to_console(const LogLevel log_level, const std::string_view source_name, const std::string_view log_info) {
+            std::lock_guard<std::mutex> guard(this->console_lock);
+            std::cout << std::format("[{}] {} -> {}\n", log_level_as_string(log_level), source_name, log_info);
         }
 
     public:
-        static std::binary_semaphore log_notifier;
         /**
          * Get singleton instance
          */
@@ -130,37 +364,82 @@ namespace Log {
          * @param source_name Identify where the log is coming from
          * @param log_info Information to log
          */
-        void log(const LogLevel log_level, const std::string& source_name, const std::string& log_info) {
-            if (log_level == PANIC or log_level == CRITICAL or log_level == DEBUG) {
-                std::cout << std::format("[{}] {} -> {}\n", log_level_as_string(log_level), source_name,  log_info);
+        void log(const LogLevel log_level, const std::string_view source_name, const std::string& log_info) {
+            if (is_written_to_console(log_level)) {
+                this->write_to_console(log_level, source_name, log_info);
+            }
+            this->enqueue(log_level, source_name, "{}", log_info);
+            if (log_level == PANIC) {
+                ManagerSignals::control.request_panic();
+            }
+        }
+
+        /**
+         * Same as log(...) above, but the arguments are only formatted by the logging subsystem
+         * Strings and trivially copyable values can be passed, strings are copied up to LOG_MAXIMUM_PAYLOAD bytes.
+         * @param format Checked at compile time, string literals only
+         */
+        template<typename... Arguments> void log(const LogLevel log_level, const std::string_view source_name, std::format_string<Arguments...> format, const Arguments&... arguments) {
+            if (is_written_to_console(log_level)) {
+                this->write_to_console(log_level, source_name, std::vformat(format.get(), std::make_format_args(arguments...)));
             }
-            this->pending_logs_lock.lock();
-            this->pending_logs.emplace(log_level, source_name, log_info);
-            this->pending_logs_lock.unlock();
-            Log::Logger::log_notifier.release();
+            this->enqueue(log_level, source_name, format.get(), arguments...);
             if (log_level == PANIC) {
-                ManagerSignals::panic.set_data(true);
+                ManagerSignals::control.request_panic();
             }
         }
 
         /**
-         * Write all queued log messages to log file
-         * @param file Log file
+         * Block until something was logged since the last call, or wake() was called
+         */
+        void wait() {
+            this->pending.wait(false, std::memory_order_acquire);
+            this->pending.store(false, std::memory_order_release);
+        }
+
+        /**
+         * Let wait() return, for shutting down
+         */
+        void wake() {
+            this->pending.store(true, std::memory_order_release);
+            this->pending.notify_one();
+        }
+
+        /**
+         * Format every waiting record in timestamp order and free its space
+         * @param text Formatted lines are appended to it
          */
-        void write_log_queue(const std::string &log_path) {
-            this->pending_logs_lock.lock();
-            if (!this->pending_logs.empty()) {
-                std::ofstream file;
-                file.open(log_path, std::ios::app);
-                while (true) {
-                    this->write_front_log(file);
-                    if (this->pending_logs.empty()) {
-                        break;
-                    }
+        void drain(std::string &text) {
+            std::vector<OverflowRecord> overflowed;
+            {
+                std::lock_guard<std::mutex> guard(this->overflow_lock);
+                overflowed.swap(this->overflow);
+            }
+            std::vector<LogRing*> current_rings;
+            std::vector<std::string> current_sources;
+            {
+                std::lock_guard<std::mutex> guard(this->rings_lock);
+                for (const std::unique_ptr<LogRing> &ring: this->rings) {
+                    current_rings.push_back(ring.get());
                 }
-                file.close();
+                current_sources = this->sources;
+            }
+            std::vector<std::pair<std::chrono::system_clock::time_point, std::string>> lines;
+            for (LogRing* ring: current_rings) {
+                ring->drain([&lines, &current_sources](const RecordHeader &header, const std::byte* payload) {
+                    const std::string log_info = header.formatter(std::string_view(header.format, header.format_size), payload);
+                    lines.emplace_back(header.timestamp, std::format("[{}] {} at {} -> {}\n", log_level_as_string((LogLevel) header.log_level), current_sources[header.source], header.timestamp, log_info));
+                });
+            }
+            for (const OverflowRecord &record: overflowed) {
+                lines.emplace_back(record.timestamp, std::format("[{}] {} at {} -> {}\n", log_level_as_string(record.log_level), current_sources[record.source], record.timestamp, record.log_info));
+            }
+            std::stable_sort(lines.begin(), lines.end(), [](const auto &line, const auto &other_line) {
+                return line.first < other_line.first;
+            });
+            for (const auto &line: lines) {
+                text += line.second;
             }
-            this->pending_logs_lock.unlock();
         }
 
         Logger(Logger const&) = delete;
@@ -169,9 +448,7 @@ namespace Log {
         Logger& operator=(Logger &&) = delete;
     };
 
-    std::binary_semaphore Logger::log_notifier{0};
-
     [[nodiscard]] Logger& get_instance() {
         return Logger::get_instance();
     }
-}
\ No newline at end of file
+}
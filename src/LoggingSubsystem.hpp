@@ -2,6 +2,8 @@
 
 
 #include <filesystem>
+#include <fstream>
+#include <string>
 
 
 #include "Subsystem.hpp"
@@ -10,39 +12,54 @@
 
 constexpr std::string LOG_PATH = "logs";
 
+/**
+ * Formats and writes the records of every logging thread, see Log::Logger
+ */
 class LoggingSubsystem: public Subsystem {
 private:
     std::string log_path;
+    std::ofstream file; // Open for the whole run
 
     void init() override {
         std::filesystem::create_directory(LOG_PATH);
         this->log_path = std::format("{}/log_at_{}.txt", LOG_PATH, std::chrono::system_clock::now());
+        this->file.open(this->log_path, std::ios::app);
     }
+
     void update() override {
-        Log::Logger::log_notifier.acquire();
-        Log::get_instance().write_log_queue(this->log_path);
+        Log::get_instance().wait();
+        this->write_pending();
+    }
+
+    void write_pending() {
+        std::string text;
+        Log::get_instance().drain(text);
+        if (!text.empty()) {
+            this->file << text;
+            this->file.flush(); // one write per batch, a crash only loses what wasn't logged yet
+        }
     }
 
     void on_shutdown() override {
-        Log::get_instance().write_log_queue(this->log_path);
+        this->write_pending();
     }
 
     void on_panic() override {
-        Log::get_instance().write_log_queue(this->log_path);
+        this->write_pending();
     };
 
     void signal_shutdown() override {
-        this->should_shutdown.set_data(true);
+        this->should_shutdown.store(true);
 
         //release all semaphores
-        Log::Logger::log_notifier.release();
+        Log::get_instance().wake();
     }
 
     void signal_panic() override {
-        this->should_panic.set_data(true);
+        this->should_panic.store(true);
 
         //release all semaphores
-        Log::Logger::log_notifier.release();
+        Log::get_instance().wake();
     }
 
     [[nodiscard]] constexpr float warning_loop_second_threshold() const override {
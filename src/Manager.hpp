@@ -11,11 +11,17 @@
 #include "PartialProcessingSubsystem.hpp"
 #include "Subsystem.hpp"
 #include "LoggingSubsystem.hpp"
+#include "SaveSubsystem.hpp"
 #include "Cell.hpp"
 #include "Constants.hpp"
 #include "Render.hpp"
 #include "ManagerSignals.hpp"
 #include "Simulation.hpp"
+#include "SaveCatalog.hpp"
+#include "Rewind.hpp"
+#include "Lineage.hpp"
+#include "Telemetry.hpp"
+#include "Species.hpp"
 
 constexpr unsigned int RECOMMENDED_THREAD_COUNT = 4;
 constexpr unsigned int MINIMUM_THREAD_COUNT = 4;
@@ -24,6 +30,22 @@ constexpr unsigned int TICKS_PER_RENDER = 1;
 constexpr bool AUTO_SAVE = true;
 constexpr float AUTO_SAVE_PERIOD = 60.0f * 30.0f; // 30 minutes
 
+/**
+ * What a run writes besides its saves, nothing when a path is empty
+ */
+class RunOptions {
+public:
+    std::string replay_path; // Replay to record every tick to, see Replay.hpp
+    std::string lineage_path; // Lineage log to append births and deaths to, see Lineage.hpp
+    std::string telemetry_path; // CSV file to write population aggregates to, see Telemetry.hpp
+    unsigned long telemetry_period = TELEMETRY_PERIOD; // Ticks between telemetry rows
+    float colony_distance = COLONY_LINK_DISTANCE; // Cells closer than this share a colony, see Colony.hpp
+    unsigned long step_ticks = 0; // Start paused and run this many ticks, see Control
+    unsigned long fast_forward_ticks = 0; // Start by running this many ticks without rendering them
+    unsigned long run_until_tick = 0; // Pause once the simulation gets here, 0 for never
+    bool exact_resume = false; // Finish loading the save before the first tick, so the run matches an uninterrupted one
+};
+
 class Manager {
 private:
     enum class Stage {
@@ -34,8 +56,13 @@ private:
 
     std::shared_ptr<LoggingSubsystem> logging_subsystem;
     std::shared_ptr<RenderSubsystem> render_subsystem;
+    std::shared_ptr<SaveSubsystem> save_subsystem;
+    std::shared_ptr<LineageSubsystem> lineage_subsystem; // Only while logging lineage
+    std::shared_ptr<TelemetrySubsystem> telemetry_subsystem; // Only while recording telemetry
+    TelemetryRow telemetry_row{}; // Gathered in a sampled tick, submitted once the tick is timed
+    std::shared_ptr<SpeciesSubsystem> species_subsystem; // Only with SPECIES_CLUSTERING
+    unsigned long next_species_tick = 0;
 
-    bool paused;
     bool has_shutdown;
     unsigned int available_threads;
     unsigned int partial_processor_count;
@@ -43,13 +70,20 @@ private:
     std::stack<std::shared_ptr<Subsystem>> subsystems;
     std::vector<std::shared_ptr<PartialProcessingSubsystem>> partial_processors;
 
-    Simulation simulation = Simulation("saves/unstable95");
+    Simulation simulation;
+    std::unique_ptr<ReplayRecorder> recorder; // Only while recording a replay
+    std::string lineage_path;
+    std::string telemetry_path;
+    unsigned long telemetry_period;
+    RewindBuffer rewind_buffer;
+    unsigned long start_step_ticks;
+    unsigned long start_fast_forward_ticks;
+    unsigned long start_run_until_tick;
+    bool exact_resume;
 
     void initialize() {
-        ManagerSignals::shutdown.set_data(false);
-        ManagerSignals::panic.set_data(false);
-        this->paused = false;
-        Body::id_count = 0;
+        ManagerSignals::control.reset();
+        this->apply_start_commands();
 
         this->check_threads();
         this->partial_processor_count = this->available_threads - 1;
@@ -58,22 +92,76 @@ private:
         this->subsystems.push(this->logging_subsystem);
         this->logging_subsystem->run_thread();
 
-        this->render_subsystem = std::make_shared<RenderSubsystem>(this->simulation.get_cells(), this->simulation.get_eggs(), this->simulation.get_foods());
+        this->save_subsystem = std::make_shared<SaveSubsystem>();
+        this->subsystems.push(this->save_subsystem);
+        this->save_subsystem->run_thread();
+
+        if (!this->lineage_path.empty()) {
+            this->lineage_subsystem = std::make_shared<LineageSubsystem>(this->lineage_path);
+            this->subsystems.push(this->lineage_subsystem);
+            this->lineage_subsystem->run_thread();
+            this->simulation.set_lineage(this->lineage_subsystem.get());
+        }
+
+        if (!this->telemetry_path.empty()) {
+            this->telemetry_subsystem = std::make_shared<TelemetrySubsystem>(this->telemetry_path);
+            this->subsystems.push(this->telemetry_subsystem);
+            this->telemetry_subsystem->run_thread();
+        }
+
+        if (SPECIES_CLUSTERING) {
+            this->species_subsystem = std::make_shared<SpeciesSubsystem>();
+            this->subsystems.push(this->species_subsystem);
+            this->species_subsystem->run_thread();
+        }
+
+        this->render_subsystem = std::make_shared<RenderSubsystem>(this->simulation.get_cells(), this->simulation.get_eggs(), this->simulation.get_foods(), this->simulation.get_nutrients());
+        this->render_subsystem->set_traits(&this->simulation.get_traits());
+        this->render_subsystem->set_species(this->species_subsystem.get());
+        if (COLONY_TRACKING) {
+            this->render_subsystem->set_colonies(&this->simulation.get_colonies());
+        }
         this->subsystems.push(this->render_subsystem);
         this->render_subsystem->run_thread();
 
 //        this->simulation.setup_environment();
-//        this->simulation = Simulation("saves/unstable95");
         for (unsigned int thread_index = 0; thread_index < this->partial_processor_count; thread_index++) {
-            std::shared_ptr<PartialProcessingSubsystem> partial_processor = std::make_shared<PartialProcessingSubsystem>(thread_index, this->partial_processor_count, this->simulation.get_cells(), this->simulation.get_eggs(), this->simulation.get_foods());
+            std::shared_ptr<PartialProcessingSubsystem> partial_processor = std::make_shared<PartialProcessingSubsystem>(thread_index, this->partial_processor_count, this->simulation);
             this->subsystems.push(partial_processor);
             this->partial_processors.push_back(partial_processor);
             this->subsystems.top()->run_thread();
         }
 
+        if (this->exact_resume and this->simulation.is_loading()) {
+            this->simulation.finish_loading();
+            Log::get_instance().log(Log::REGULAR, Manager::id(), "Finished loading before the first tick for an exact resume");
+        }
+
+        if (BRAIN_PRUNING) {
+            Log::get_instance().log(Log::REGULAR, Manager::id(), std::format("Sparse brain kernel is used below {} weight density", BRAIN_SPARSE_DENSITY_THRESHOLD));
+        }
         Log::get_instance().log(Log::REGULAR, Manager::id(), "Initialized all subsystems");
     }
 
+    /**
+     * Step, fast forward and run until as given on the command line
+     */
+    void apply_start_commands() {
+        Control &control = ManagerSignals::control;
+        if (this->start_run_until_tick != 0) {
+            if (this->start_run_until_tick <= this->simulation.get_tick_count()) {
+                Log::get_instance().log(Log::WARNING, Manager::id(), "Run until tick {} is already behind tick {}, starting paused", this->start_run_until_tick, this->simulation.get_tick_count());
+            }
+            control.run_until(this->start_run_until_tick);
+        }
+        if (this->start_step_ticks != 0) {
+            control.step(this->start_step_ticks);
+        }
+        if (this->start_fast_forward_ticks != 0) {
+            control.fast_forward(this->start_fast_forward_ticks);
+        }
+    }
+
     void check_threads() {
         this->available_threads = std::thread::hardware_concurrency();
         if (this->available_threads < MINIMUM_THREAD_COUNT) {
@@ -89,6 +177,9 @@ private:
             return;
         }
         Log::get_instance().log(Log::REGULAR, Manager::id(), "Starting shutdown process");
+        if (this->lineage_subsystem != nullptr) {
+            this->lineage_subsystem->flush(); // the last events are still on this thread
+        }
         while (!this->subsystems.empty()) {
             this->subsystems.top()->signal_shutdown();
             this->subsystems.top()->thread_join();
@@ -111,8 +202,20 @@ private:
     }
 
 public:
-    Manager() {
+    /**
+     * @param save_path Save directory to load, see SaveCatalog::resolve()
+     */
+    explicit Manager(const std::string &save_path, const RunOptions &options = {}): simulation(save_path), lineage_path(options.lineage_path), telemetry_path(options.telemetry_path), telemetry_period(std::max(options.telemetry_period, 1ul)), start_step_ticks(options.step_ticks), start_fast_forward_ticks(options.fast_forward_ticks), start_run_until_tick(options.run_until_tick), exact_resume(options.exact_resume) {
         this->has_shutdown = false;
+        if (COLONY_TRACKING and options.colony_distance != COLONY_LINK_DISTANCE) {
+            this->simulation.set_colony_distance(options.colony_distance);
+        }
+        if (!options.replay_path.empty()) {
+            this->recorder = std::make_unique<ReplayRecorder>();
+            if (!this->recorder->open(options.replay_path)) {
+                this->recorder.reset();
+            }
+        }
     }
 
     ~Manager() {
@@ -126,48 +229,162 @@ public:
         std::chrono::system_clock::time_point last_save_time = std::chrono::high_resolution_clock::now();
 
         unsigned long ticks = 0;
+        unsigned long ticks_since_row = 0;
+        float seconds_since_row = 0.0f;
         this->initialize();
         while (true) {
             const std::chrono::system_clock::time_point start = std::chrono::high_resolution_clock::now();
-            if (AUTO_SAVE and !this->paused and ((float)(std::chrono::duration_cast<std::chrono::nanoseconds>(start - last_save_time).count())) / 1e9f>= AUTO_SAVE_PERIOD) {
-                this->simulation.save();
+            Control &control = ManagerSignals::control;
+            if (AUTO_SAVE and !control.is_paused() and ((float)(std::chrono::duration_cast<std::chrono::nanoseconds>(start - last_save_time).count())) / 1e9f>= AUTO_SAVE_PERIOD) {
+                this->save_subsystem->request_save(this->simulation.capture_snapshot());
                 last_save_time = start;
             }
 
-            if (ManagerSignals::panic.get_data()) {
+            if (control.should_panic()) {
                 this->panic();
                 return;
             }
-            if (ManagerSignals::shutdown.get_data()) {
+            if (control.should_shutdown()) {
                 this->shutdown();
                 return;
             }
 
-            if (!this->render_subsystem->paused.get_data()) {
+            const LoopCommand command = control.next_loop(this->simulation.get_tick_count());
+            const bool ticking = command.tick;
+            if (ticking) {
+                this->simulation.begin_tick(this->render_subsystem->focus.get_data());
+                this->simulation.set_sampling(this->telemetry_subsystem != nullptr and this->simulation.get_tick_count() % this->telemetry_period == 0);
                 this->tick();
+                if (this->simulation.is_sampling()) {
+                    this->gather_telemetry();
+                }
                 this->simulation.produce();
                 this->simulation.clear();
+                if (this->recorder != nullptr) {
+                    this->recorder->record(this->simulation.get_tick_count(), this->simulation.get_cells(), this->simulation.get_eggs(), this->simulation.get_foods());
+                }
+                if (VERIFY_TRAIT_STATISTICS and this->simulation.get_tick_count() % TRAIT_VERIFY_PERIOD == 0) {
+                    this->simulation.verify_traits();
+                }
+                if (BRAIN_MEMOIZATION and this->simulation.get_tick_count() % BRAIN_CACHE_LOG_PERIOD == 0) {
+                    Log::get_instance().log(Log::REGULAR, Manager::id(), BrainCacheStatistics::global().get_data().to_string());
+                }
             }
 
-            if (IsKeyPressed(KEY_K)) {
-                simulation.save();
+            if (command.save) {
+                this->save_subsystem->request_save(this->simulation.capture_snapshot());
             }
 
-            if ((ticks % TICKS_PER_RENDER) == 0) {
+            if (REWIND and command.rewind_steps > 0) {
+                this->rewind(command.rewind_steps);
+            }
+
+            if ((ticks % TICKS_PER_RENDER) == 0 and command.render) {
                 this->render_subsystem->render_notifier.release(); // yes it is pointless to use a separate render thread like this
+                this->capture_rewind_point(false); // only reads the world, so it is taken while the render thread draws it
+                this->submit_species();
                 this->render_subsystem->finished_render_notifier.acquire(); // but eventually i will allow it to render while doing interactions
             }
+            else {
+                this->capture_rewind_point(true); // nothing to hide it behind, the processing threads copy the cells next tick
+                this->submit_species();
+            }
 
-            const std::chrono::system_clock::time_point end = std::chrono::high_resolution_clock::now();
-            const float update_time = std::max(((float)(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count())) / 1e9f, 1e-9f);
-            const float updates_per_second = 1.0f / update_time;
-            printf("Updates Per Sec: %f\n", updates_per_second);
+            if (ticking and this->telemetry_subsystem != nullptr) {
+                const std::chrono::system_clock::time_point end = std::chrono::high_resolution_clock::now();
+                seconds_since_row += ((float)(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count())) / 1e9f;
+                ticks_since_row++;
+                if (this->simulation.is_sampling()) {
+                    this->telemetry_row.ticks_per_second = (float) ticks_since_row / std::max(seconds_since_row, 1e-9f);
+                    this->telemetry_subsystem->submit(this->telemetry_row);
+                    ticks_since_row = 0;
+                    seconds_since_row = 0.0f;
+                }
+            }
             ticks++;
         }
 
     }
 
 
+    /**
+     * Merge what the partial processors gathered in the interaction pass, before produce() and clear() change the world
+     */
+    void gather_telemetry() {
+        this->telemetry_row = TelemetryRow{};
+        this->telemetry_row.tick = this->simulation.get_tick_count();
+        for (const std::shared_ptr<PartialProcessingSubsystem> &partial_processor: this->partial_processors) {
+            this->telemetry_row.sample.merge(partial_processor->get_sample());
+        }
+        this->telemetry_row.sample.coalesce_residual = this->simulation.get_coalescer().get_residual_calories();
+        const TraitStatistics &traits = this->simulation.get_traits();
+        this->telemetry_row.sample.diet = traits.get_moments(DIET_TRAIT);
+        this->telemetry_row.sample.radius = traits.get_moments(RADIUS_TRAIT);
+        this->telemetry_row.sample.speed = traits.get_moments(SPEED_TRAIT);
+        this->telemetry_row.sample.vision = traits.get_moments(VISION_TRAIT);
+        if (this->species_subsystem != nullptr) {
+            const std::shared_ptr<const SpeciesLabels> labels = this->species_subsystem->get_labels();
+            this->telemetry_row.sample.species_count = labels == nullptr ? 0 : labels->species.size();
+        }
+        if (COLONY_TRACKING) {
+            const ColonyTracker &colonies = this->simulation.get_colonies();
+            this->telemetry_row.colony_tick = colonies.get_pass_tick();
+            this->telemetry_row.colonies = colonies.get_colonies();
+            this->telemetry_row.loner_count = colonies.get_loner_count();
+        }
+    }
+
+    /**
+     * Take a rewind point when one is due, see RewindBuffer
+     * @param background Leave copying the cells to the processing threads in the next tick, see RewindBuffer::begin_capture()
+     */
+    void capture_rewind_point(const bool background) {
+        if (!REWIND or this->simulation.is_loading() or !this->rewind_buffer.is_due(this->simulation.get_tick_count())) {
+            return;
+        }
+        if (background) {
+            this->rewind_buffer.begin_capture(this->simulation);
+        }
+        else {
+            this->rewind_buffer.capture(this->simulation);
+        }
+    }
+
+    /**
+     * Hand a snapshot to the species clustering when a run is due and the last one has finished
+     * The latest rewind point is reused, so clustering costs the simulation nothing unless rewinding is off.
+     */
+    void submit_species() {
+        if (this->species_subsystem == nullptr or this->simulation.is_loading() or this->simulation.get_tick_count() < this->next_species_tick or this->species_subsystem->is_busy()) {
+            return;
+        }
+        std::shared_ptr<const Snapshot> snapshot = REWIND ? this->rewind_buffer.get_latest() : nullptr;
+        if (snapshot == nullptr) {
+            snapshot = this->simulation.capture_snapshot();
+        }
+        if (this->species_subsystem->submit(snapshot)) {
+            this->next_species_tick = this->simulation.get_tick_count() + SPECIES_PERIOD;
+        }
+    }
+
+    /**
+     * Go back to an earlier rewind point and continue from there
+     * @param steps Rewind points to go back
+     */
+    void rewind(const unsigned int steps) {
+        this->rewind_buffer.finish_capture(this->simulation);
+        const std::shared_ptr<const Snapshot> snapshot = this->rewind_buffer.take(steps, this->simulation.get_tick_count());
+        if (snapshot == nullptr) {
+            Log::get_instance().log(Log::WARNING, Manager::id(), "No rewind point to go back to");
+            return;
+        }
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        this->simulation.rewind(*snapshot);
+        this->next_species_tick = 0;
+        const float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        Log::get_instance().log(Log::REGULAR, Manager::id(), std::format("Rewound to tick {} in {} ms, {} rewind points left spanning {} ticks", snapshot->tick_count, milliseconds, this->rewind_buffer.get_point_count(), this->rewind_buffer.get_span()));
+    }
+
     void tick() {
         for (const std::shared_ptr<PartialProcessingSubsystem> &partial_processor: this->partial_processors) {
             partial_processor->do_interaction_notifier.release();
@@ -175,6 +392,10 @@ public:
         for (const std::shared_ptr<PartialProcessingSubsystem> &partial_processor: this->partial_processors) {
             partial_processor->interaction_completion_notifier.acquire();
         }
+        if constexpr (REWIND) {
+            this->rewind_buffer.finish_capture(this->simulation);
+        }
+        this->simulation.resolve_interactions();
 
         for (const std::shared_ptr<PartialProcessingSubsystem> &partial_processor: this->partial_processors) {
             partial_processor->do_tick_notifier.release();
@@ -1,8 +1,202 @@
 #pragma once
 
-#include "ThreadSafety.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+
+constexpr unsigned long FAST_FORWARD_RENDER_PERIOD = 250; // Ticks between frames while fast forwarding, keeps the window responsive
+
+
+/**
+ * What the manager does in one loop, see Control::next_loop()
+ */
+class LoopCommand {
+public:
+    bool tick;
+    bool render;
+    bool save; // Save a snapshot after this loop's tick
+    unsigned int rewind_steps; // Rewind points to go back by after this loop's tick, 0 for none
+};
+
+/**
+ * Lock-free control block shared by the manager, the subsystems and the input handling
+ * Everything is a plain atomic, so polling it every loop never takes a lock. Commands can be given from any thread,
+ * only the manager thread takes ticks from them through next_loop().
+ */
+class Control {
+private:
+    std::atomic<bool> shutdown = false;
+    std::atomic<bool> panic = false;
+    std::atomic<bool> paused = false;
+    std::atomic<uint64_t> step_ticks = 0; // Left to run while paused
+    std::atomic<uint64_t> fast_forward_ticks = 0; // Left to run without rendering them
+    std::atomic<uint64_t> run_until_tick = 0; // Pause once reached, 0 for none
+    std::atomic<uint64_t> tick = 0; // Last tick seen by next_loop(), for commands relative to it
+    std::atomic<bool> save_requested = false; // Taken by the next loop only
+    std::atomic<unsigned int> rewind_steps = 0; // Taken by the next loop only, presses in between add up
+
+    /**
+     * Count a command down by one, commands may be cancelled from another thread meanwhile
+     * @return Whether there was one left
+     */
+    static bool take_one(std::atomic<uint64_t> &counter) {
+        uint64_t left = counter.load(std::memory_order_relaxed);
+        while (left > 0 and !counter.compare_exchange_weak(left, left - 1, std::memory_order_relaxed)) {
+
+        }
+        return left > 0;
+    }
+
+public:
+    /**
+     * Clear every signal and command, before subsystems are started
+     */
+    void reset() {
+        this->shutdown.store(false);
+        this->panic.store(false);
+        this->paused.store(false);
+        this->step_ticks.store(0);
+        this->fast_forward_ticks.store(0);
+        this->run_until_tick.store(0);
+        this->tick.store(0);
+        this->save_requested.store(false);
+        this->rewind_steps.store(0);
+    }
+
+    /**
+     * Shut down at the earliest convenience
+     */
+    void request_shutdown() {
+        this->shutdown.store(true, std::memory_order_release);
+    }
+
+    /**
+     * Shut down immediately, see Log::PANIC
+     */
+    void request_panic() {
+        this->panic.store(true, std::memory_order_release);
+    }
+
+    [[nodiscard]] bool should_shutdown() const {
+        return this->shutdown.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] bool should_panic() const {
+        return this->panic.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] bool is_paused() const {
+        return this->paused.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Pause or resume, resuming drops the ticks still left to step
+     */
+    void toggle_pause() {
+        bool was_paused = this->paused.load(std::memory_order_relaxed);
+        while (!this->paused.compare_exchange_weak(was_paused, !was_paused, std::memory_order_relaxed)) {
+
+        }
+        if (was_paused) {
+            this->step_ticks.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Pause and run this many ticks on top of those still left to step
+     */
+    void step(const uint64_t ticks) {
+        this->paused.store(true, std::memory_order_relaxed);
+        this->step_ticks.fetch_add(ticks, std::memory_order_relaxed);
+    }
+
+    /**
+     * Run this many ticks without rendering them, paused or not
+     * Only every FAST_FORWARD_RENDER_PERIOD-th tick is rendered.
+     */
+    void fast_forward(const uint64_t ticks) {
+        this->fast_forward_ticks.fetch_add(ticks, std::memory_order_relaxed);
+    }
+
+    /**
+     * Fast forward this many ticks, or stop fast forwarding if it already is
+     */
+    void toggle_fast_forward(const uint64_t ticks) {
+        if (this->fast_forward_ticks.exchange(0, std::memory_order_relaxed) == 0) {
+            this->fast_forward(ticks);
+        }
+    }
+
+    [[nodiscard]] bool is_fast_forwarding() const {
+        return this->fast_forward_ticks.load(std::memory_order_relaxed) > 0;
+    }
+
+    /**
+     * Resume and pause again once the simulation reaches the tick
+     * @param _tick 0 cancels
+     */
+    void run_until(const uint64_t _tick) {
+        this->run_until_tick.store(_tick, std::memory_order_relaxed);
+        if (_tick != 0) {
+            this->paused.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Run until the next multiple of the interval past the last tick
+     */
+    void run_until_next(const uint64_t interval) {
+        this->run_until((this->tick.load(std::memory_order_relaxed) / interval + 1) * interval);
+    }
+
+    /**
+     * Save a snapshot once, in the next loop
+     */
+    void request_save() {
+        this->save_requested.store(true, std::memory_order_relaxed);
+    }
+
+    /**
+     * Go back this many rewind points once, in the next loop
+     */
+    void request_rewind(const unsigned int steps) {
+        this->rewind_steps.fetch_add(steps, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] uint64_t get_run_until_tick() const {
+        return this->run_until_tick.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Take what to do this loop, only from the manager thread
+     * Reaching the run until tick pauses and drops whatever was left to step or fast forward. Save and rewind requests
+     * are handed out to one loop only, however many ticks that loop runs through.
+     * @param _tick Tick count the loop would run next
+     */
+    [[nodiscard]] LoopCommand next_loop(const uint64_t _tick) {
+        this->tick.store(_tick, std::memory_order_relaxed);
+        const bool save = this->save_requested.exchange(false, std::memory_order_relaxed);
+        const unsigned int _rewind_steps = this->rewind_steps.exchange(0, std::memory_order_relaxed);
+        uint64_t target = this->run_until_tick.load(std::memory_order_relaxed);
+        if (target != 0 and _tick >= target) {
+            this->run_until_tick.compare_exchange_strong(target, 0, std::memory_order_relaxed);
+            this->paused.store(true, std::memory_order_relaxed);
+            this->step_ticks.store(0, std::memory_order_relaxed);
+            this->fast_forward_ticks.store(0, std::memory_order_relaxed);
+            return {false, true, save, _rewind_steps};
+        }
+        if (Control::take_one(this->fast_forward_ticks)) {
+            return {true, _tick % FAST_FORWARD_RENDER_PERIOD == 0, save, _rewind_steps};
+        }
+        if (Control::take_one(this->step_ticks)) {
+            return {true, true, save, _rewind_steps};
+        }
+        return {!this->paused.load(std::memory_order_relaxed), true, save, _rewind_steps};
+    }
+};
+
 
 namespace ManagerSignals {
-    static ThreadSafe<bool> shutdown;
-    static ThreadSafe<bool> panic;
-}
\ No newline at end of file
+    inline Control control;
+}
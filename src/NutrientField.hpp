@@ -0,0 +1,182 @@
+#pragma once
+
+
+#include <atomic>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+
+#include "Constants.hpp"
+
+
+constexpr int NUTRIENT_FIELD_RESOLUTION = 1000; // Grid cells per side, covering the whole world
+constexpr float NUTRIENT_CELL_SIZE = WORLD_SIZE / (float) NUTRIENT_FIELD_RESOLUTION;
+constexpr float NUTRIENT_VISIBILITY_THRESHOLD = 1.0f; // Calories a patch needs before vision rays see it
+constexpr float NUTRIENT_FULL_CALORIES = 50.0f; // Calories at which a patch is drawn fully opaque
+
+
+/**
+ * Dense grid of plant calories
+ * Waste is deposited into the grid cell under it and cells eat whole grid cells,
+ * so plant heavy worlds cost O(grid) no matter how much waste is produced
+ * Calories only ever move between the grid and stomachs, nothing is created or lost
+ * The grid is only allocated with NUTRIENT_FIELD_PLANTS, without it the field is empty and must not be used
+ */
+class NutrientField {
+private:
+    std::vector<std::atomic<float>> calories;
+
+    [[nodiscard]] static int coordinate(const float position) {
+        const int _coordinate = (int) std::floor((position + HALF_WORLD_SIZE) / NUTRIENT_CELL_SIZE);
+        if (WRAP_POSITION) {
+            return ((_coordinate % NUTRIENT_FIELD_RESOLUTION) + NUTRIENT_FIELD_RESOLUTION) % NUTRIENT_FIELD_RESOLUTION;
+        }
+        return std::clamp(_coordinate, 0, NUTRIENT_FIELD_RESOLUTION - 1);
+    }
+
+public:
+    NutrientField(): calories(NUTRIENT_FIELD_PLANTS ? NutrientField::size() : 0) {    }
+
+    [[nodiscard]] static int index_at(const Vector2 position) {
+        return NutrientField::coordinate(position.y) * NUTRIENT_FIELD_RESOLUTION + NutrientField::coordinate(position.x);
+    }
+
+    [[nodiscard]] static Vector2 position_of(const int index) {
+        return {((float) (index % NUTRIENT_FIELD_RESOLUTION) + 0.5f) * NUTRIENT_CELL_SIZE - HALF_WORLD_SIZE,
+                ((float) (index / NUTRIENT_FIELD_RESOLUTION) + 0.5f) * NUTRIENT_CELL_SIZE - HALF_WORLD_SIZE};
+    }
+
+    [[nodiscard]] static constexpr int size() {
+        return NUTRIENT_FIELD_RESOLUTION * NUTRIENT_FIELD_RESOLUTION;
+    }
+
+    void deposit(const Vector2 position, const float _calories) {
+        this->calories[NutrientField::index_at(position)].fetch_add(_calories, std::memory_order_relaxed);
+    }
+
+    void deposit(const int index, const float _calories) {
+        this->calories[index].fetch_add(_calories, std::memory_order_relaxed);
+    }
+
+    /**
+     * Empty every grid cell
+     */
+    void clear() {
+        for (std::atomic<float> &_calories: this->calories) {
+            _calories.store(0.0f, std::memory_order_relaxed);
+        }
+    }
+
+    [[nodiscard]] float get_calories(const int index) const {
+        return this->calories[index].load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] float get_calories_at(const Vector2 position) const {
+        return this->get_calories(NutrientField::index_at(position));
+    }
+
+    /**
+     * Empty the grid cell under a position
+     * Safe to call from several threads at once, each calorie is only ever taken once
+     * @return Calories taken
+     */
+    [[nodiscard]] float take_calories_at(const Vector2 position) {
+        return this->take_calories(NutrientField::index_at(position));
+    }
+
+    [[nodiscard]] float take_calories(const int index) {
+        return this->calories[index].exchange(0.0f, std::memory_order_relaxed);
+    }
+
+    /**
+     * Walk a ray through the grid and find the first visible patch
+     * @param start Ray origin
+     * @param direction Unit direction
+     * @param min_distance Start this far out, so a cell does not see the patch under its own body
+     * @param max_distance Only look this far
+     * @return Distance to the first visible patch or a negative value if there is none
+     */
+    [[nodiscard]] float sample_ray(const Vector2 start, const Vector2 direction, const float min_distance, const float max_distance) const {
+        for (float distance = min_distance; distance < max_distance; distance += NUTRIENT_CELL_SIZE) {
+            const Vector2 sample_position = {start.x + direction.x * distance, start.y + direction.y * distance};
+            if (this->get_calories_at(sample_position) >= NUTRIENT_VISIBILITY_THRESHOLD) {
+                return distance;
+            }
+        }
+        return -1.0f;
+    }
+
+    [[nodiscard]] double get_total_calories() const {
+        return this->get_total_calories(0, (int) this->calories.size());
+    }
+
+    /**
+     * Calories of the grid cells [first, last), so threads can each add up a share of the field
+     */
+    [[nodiscard]] double get_total_calories(const int first, const int last) const {
+        double total = 0;
+        for (int index = first; index < last; index++) {
+            total += this->calories[index].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    /**
+     * Only non-empty grid cells are written
+     */
+    friend std::ostream &operator<<(std::ostream &stream, const NutrientField* field) {
+        for (int index = 0; index < NutrientField::size(); index++) {
+            const float _calories = field->get_calories(index);
+            if (_calories == 0.0f) {
+                continue;
+            }
+            stream << index;
+            stream << "\n";
+            stream << _calories;
+            stream << "\n";
+        }
+        return stream;
+    }
+
+    friend std::istream &operator>>(std::istream &stream, NutrientField* field) {
+        int index;
+        float _calories;
+        while (stream >> index >> _calories) {
+            if (index < 0 or index >= NutrientField::size()) {
+                continue;
+            }
+            field->calories[index].fetch_add(_calories, std::memory_order_relaxed);
+        }
+        return stream;
+    }
+
+    /**
+     * Draw the grid cells inside a world space rectangle
+     * Zoomed out views skip cells so at most a few hundred are drawn per axis
+     */
+    void draw(const Vector2 top_left, const Vector2 bottom_right) const {
+        const int first_x = (int) std::floor((top_left.x + HALF_WORLD_SIZE) / NUTRIENT_CELL_SIZE);
+        const int last_x = (int) std::floor((bottom_right.x + HALF_WORLD_SIZE) / NUTRIENT_CELL_SIZE);
+        const int first_y = (int) std::floor((top_left.y + HALF_WORLD_SIZE) / NUTRIENT_CELL_SIZE);
+        const int last_y = (int) std::floor((bottom_right.y + HALF_WORLD_SIZE) / NUTRIENT_CELL_SIZE);
+        const int stride = std::max(1, std::max(last_x - first_x, last_y - first_y) / 300);
+        for (int grid_y = first_y; grid_y <= last_y; grid_y += stride) {
+            for (int grid_x = first_x; grid_x <= last_x; grid_x += stride) {
+                if (!WRAP_POSITION and (grid_x < 0 or grid_y < 0 or grid_x >= NUTRIENT_FIELD_RESOLUTION or grid_y >= NUTRIENT_FIELD_RESOLUTION)) {
+                    continue;
+                }
+                const Vector2 position = {((float) grid_x + 0.5f) * NUTRIENT_CELL_SIZE - HALF_WORLD_SIZE, ((float) grid_y + 0.5f) * NUTRIENT_CELL_SIZE - HALF_WORLD_SIZE};
+                const float _calories = this->get_calories_at(position);
+                if (_calories <= 0.0f) {
+                    continue;
+                }
+                const float strength = std::min(_calories / NUTRIENT_FULL_CALORIES, 1.0f);
+                DrawRectangleV({position.x - NUTRIENT_CELL_SIZE / 2.0f, position.y - NUTRIENT_CELL_SIZE / 2.0f},
+                               {NUTRIENT_CELL_SIZE * (float) stride, NUTRIENT_CELL_SIZE * (float) stride},
+                               {0, 228, 48, (unsigned char) (255.0f * strength)});
+            }
+        }
+    }
+};
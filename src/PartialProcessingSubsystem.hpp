@@ -10,125 +10,258 @@
 
 #include "Subsystem.hpp"
 #include "Cell.hpp"
+#include "Simulation.hpp"
+#include "Kinematics.hpp"
+#include "Telemetry.hpp"
 
 
 class PartialProcessingSubsystem: public Subsystem {
 protected:
     unsigned int partial_id;
     unsigned int total;
+    Simulation &simulation;
     std::vector<Cell*> &cells;
     std::list<Egg*> &eggs;
     std::list<Food*> &foods;
+    RegionGrid &regions;
+    NutrientField &nutrients;
+    CellBatch batch;
+    TelemetrySample sample; // This thread's share, see Simulation::set_sampling()
 
     void init() override {
 
     }
 
-    void interaction() {
-        for (unsigned short cell1_index = this->partial_id; cell1_index < (unsigned short) cells.size(); cell1_index += this->total) {
-            if (cells[cell1_index]->is_dead()) {
-                continue;
+    /**
+     * Axis aligned box around a vision ray, anything centered outside of it is ignored
+     */
+    typedef struct {
+        float min_x;
+        float max_x;
+        float min_y;
+        float max_y;
+    } RayBounds;
+
+    [[nodiscard]] static bool is_outside(const RayBounds &bounds, const Vector2 position) {
+        if (position.x > bounds.max_x) {
+            return true;
+        }
+        if (position.y > bounds.max_y) {
+            return true;
+        }
+        if (position.x < bounds.min_x) {
+            return true;
+        }
+        if (position.y < bounds.min_y) {
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @param other_position Position of the other cell, may be a wrapped image of its real position
+     */
+    static void interact_cell(Cell* cell, Sensor &sensor, const Vector2 center_ray, const RayBounds &bounds, Cell* other_cell, const Vector2 other_position) {
+        if (is_outside(bounds, other_position)) {
+            return;
+        }
+        if (other_cell->is_dead()) {
+            return;
+        }
+        if (cell == other_cell) {
+            return;
+        }
+
+        RayResult center_ray_result = cell->cast_ray(other_position, other_cell->get_radius(), center_ray);
+        if (center_ray_result.hits) {
+            if (cell->does_want_stab() and center_ray_result.hit_distance <= cell->get_stab_range()) {
+                cell->target_stab(other_cell);
+            }
+            if (center_ray_result.hit_distance < sensor.hit_distance) {
+                sensor.hit_distance = center_ray_result.hit_distance;
+                sensor.hit_red = other_cell->get_red();
+                sensor.hit_green = other_cell->get_green();
+                sensor.hit_blue = other_cell->get_blue();
             }
+        }
+    }
 
-            Sensor center_sensor{};
-            center_sensor.hit_distance = cells[cell1_index]->get_vision_range();
-            const Vector2 center_ray = cells[cell1_index]->sensor_ray(0);
-
-            float max_x;
-            float min_x;
-            if (cells[cell1_index]->get_x_position() >= center_ray.x) {
-                max_x = cells[cell1_index]->get_x_position();
-                min_x = center_ray.x;
-            } else {
-                max_x = center_ray.x;
-                min_x = cells[cell1_index]->get_x_position();
-            }
-            
-            float max_y;
-            float min_y;
-            if (cells[cell1_index]->get_y_position() >= center_ray.y) {
-                max_y = cells[cell1_index]->get_y_position();
-                min_y = center_ray.y;
-            } else {
-                max_y = center_ray.y;
-                min_y = cells[cell1_index]->get_y_position();
+    /**
+     * @param food_position Position of the food, may be a wrapped image of its real position
+     */
+    static void interact_food(Cell* cell, Sensor &sensor, const Vector2 center_ray, const RayBounds &bounds, Food* food, const Vector2 food_position) {
+        if (is_outside(bounds, food_position)) {
+            return;
+        }
+        if (food->is_consumed()) {
+            return;
+        }
+
+        RayResult center_ray_result = cell->cast_ray(food_position, food->get_radius(), center_ray);
+        if (center_ray_result.hits) {
+            if (cell->does_want_eat() and center_ray_result.hit_distance <= cell->get_eat_range()) {
+                cell->target_food(food);
+            }
+            if (center_ray_result.hit_distance < sensor.hit_distance) {
+                sensor.hit_distance = center_ray_result.hit_distance;
+                sensor.hit_red = food->get_red();
+                sensor.hit_green = food->get_green();
+                sensor.hit_blue = food->get_blue();
             }
+        }
+    }
 
-            for (unsigned short cell2_index = 0; cell2_index < (unsigned short) cells.size(); cell2_index++) {
-                if (cells[cell2_index]->get_x_position() > max_x) {
-                    continue;
-                }
-                if (cells[cell2_index]->get_y_position() > max_y) {
-                    continue;
-                }
-                if (cells[cell2_index]->get_x_position() < min_x) {
-                    continue;
-                }
-                if (cells[cell2_index]->get_y_position() < min_y) {
-                    continue;
-                }
+    /**
+     * Closest image of a position as seen from the cell, only differs from the position on a wrapped world
+     */
+    [[nodiscard]] static Vector2 nearest_image(const Cell* cell, const Vector2 position) {
+        return {cell->get_x_position() + wrap_delta(position.x - cell->get_x_position()), cell->get_y_position() + wrap_delta(position.y - cell->get_y_position())};
+    }
 
-                if (cells[cell2_index]->is_dead()) {
-                    continue;
+    /**
+     * Only visit the regions the vision ray can reach
+     */
+    void interact_nearby_regions(Cell* cell, Sensor &sensor, const Vector2 center_ray, const RayBounds &bounds) {
+        const int first_region_x = RegionGrid::unwrapped_coordinate(bounds.min_x);
+        const int last_region_x = RegionGrid::unwrapped_coordinate(bounds.max_x);
+        const int first_region_y = RegionGrid::unwrapped_coordinate(bounds.min_y);
+        const int last_region_y = RegionGrid::unwrapped_coordinate(bounds.max_y);
+        for (int region_y = first_region_y; region_y <= last_region_y; region_y++) {
+            for (int region_x = first_region_x; region_x <= last_region_x; region_x++) {
+                Region &region = this->regions.get_region(region_x, region_y);
+                for (Cell* other_cell: region.cells) {
+                    interact_cell(cell, sensor, center_ray, bounds, other_cell, nearest_image(cell, other_cell->get_position()));
                 }
-                if (cell1_index == cell2_index) {
-                    continue;
+                for (const std::list<Food*>::iterator &food: region.foods) {
+                    interact_food(cell, sensor, center_ray, bounds, *food, nearest_image(cell, (*food)->get_position()));
                 }
+            }
+        }
+    }
 
-                RayResult center_ray_result = cells[cell1_index]->cast_ray(cells[cell2_index]->get_position(), cells[cell2_index]->get_radius(), center_ray);
-                if (center_ray_result.hits) {
-                    if (cells[cell1_index]->does_want_stab() and center_ray_result.hit_distance <= cells[cell1_index]->get_stab_range()) {
-                        cells[cell1_index]->stab(cells[cell2_index]);
-                    }
-                    if (center_ray_result.hit_distance < center_sensor.hit_distance) {
-                        center_sensor.hit_distance = center_ray_result.hit_distance;
-                        center_sensor.hit_red = cells[cell2_index]->get_red();
-                        center_sensor.hit_green = cells[cell2_index]->get_green();
-                        center_sensor.hit_blue = cells[cell2_index]->get_blue();
-                    }
-                }
+    /**
+     * Target the nutrient patches between the cell and the end of its eat range and look for the closest visible patch
+     */
+    void interact_nutrients(Cell* cell, Sensor &sensor) {
+        if (cell->does_want_eat()) {
+            const Vector2 mouth = cell->polar_offset(cell->get_eat_range(), 0);
+            cell->target_nutrients(NutrientField::index_at(cell->get_position()));
+            if (NutrientField::index_at(mouth) != NutrientField::index_at(cell->get_position())) {
+                cell->target_nutrients(NutrientField::index_at(mouth));
             }
+        }
 
-            for (Food* food: foods) {
+        const float hit_distance = this->nutrients.sample_ray(cell->get_position(), cell->get_direction(), cell->get_radius(), sensor.hit_distance);
+        if (hit_distance >= 0.0f) {
+            sensor.hit_distance = hit_distance;
+            sensor.hit_red = 0.0f;
+            sensor.hit_green = 255.0f;
+            sensor.hit_blue = 0.0f;
+        }
+    }
 
-                if (food->get_x_position() > max_x) {
-                    continue;
-                }
-                if (food->get_y_position() > max_y) {
-                    continue;
-                }
-                if (food->get_x_position() < min_x) {
-                    continue;
-                }
-                if (food->get_y_position() < min_y) {
-                    continue;
-                }
+    /**
+     * Add this thread's share of the eggs, food and nutrients to the sample, cells are added by the interaction pass
+     */
+    void sample_resources() {
+        unsigned int index = 0;
+        for (const Egg* egg: this->eggs) {
+            if (index++ % this->total == this->partial_id) {
+                this->sample.add_egg(egg);
+            }
+        }
+        index = 0;
+        for (const Food* food: this->foods) {
+            if (index++ % this->total == this->partial_id) {
+                this->sample.add_food(food);
+            }
+        }
+        if constexpr (NUTRIENT_FIELD_PLANTS) {
+            const int share = (NutrientField::size() + (int) this->total - 1) / (int) this->total;
+            const int first = std::min((int) this->partial_id * share, NutrientField::size());
+            this->sample.nutrient_calories = this->nutrients.get_total_calories(first, std::min(first + share, NutrientField::size()));
+        }
+    }
 
-                if (food->is_consumed()) {
-                    continue;
-                }
+    void interaction() {
+        this->simulation.capture_cells(this->partial_id, this->total); // before any cell changes
+        const bool sampling = this->simulation.is_sampling();
+        if (sampling) {
+            this->sample = TelemetrySample();
+            this->sample_resources();
+        }
+        for (unsigned int cell1_index = this->partial_id; cell1_index < (unsigned int) cells.size(); cell1_index += this->total) {
+            Cell* cell = cells[cell1_index];
+            if (cell->is_dead()) {
+                continue;
+            }
+            if (sampling) {
+                this->sample.add_cell(cell);
+            }
+            cell->set_timestep(this->simulation.get_timestep(cell->get_id(), cell->get_position()));
+            if (cell->get_timestep() == 0) {
+                continue;
+            }
+
+            Sensor center_sensor{};
+            center_sensor.hit_distance = cell->get_vision_range();
+            const Vector2 center_ray = cell->sensor_ray(0);
 
-                RayResult center_ray_result = cells[cell1_index]->cast_ray(food->get_position(), food->get_radius(), center_ray);
-                if (center_ray_result.hits) {
-                    if (cells[cell1_index]->does_want_eat() and center_ray_result.hit_distance <= cells[cell1_index]->get_eat_range()) {
-                        cells[cell1_index]->consume(food);
-                    }
-                    if (center_ray_result.hit_distance < center_sensor.hit_distance) {
-                        center_sensor.hit_distance = center_ray_result.hit_distance;
-                        center_sensor.hit_red = food->get_red();
-                        center_sensor.hit_green = food->get_green();
-                        center_sensor.hit_blue = food->get_blue();
-                    }
+            RayBounds bounds{};
+            if (cell->get_x_position() >= center_ray.x) {
+                bounds.max_x = cell->get_x_position();
+                bounds.min_x = center_ray.x;
+            } else {
+                bounds.max_x = center_ray.x;
+                bounds.min_x = cell->get_x_position();
+            }
+
+            if (cell->get_y_position() >= center_ray.y) {
+                bounds.max_y = cell->get_y_position();
+                bounds.min_y = center_ray.y;
+            } else {
+                bounds.max_y = center_ray.y;
+                bounds.min_y = cell->get_y_position();
+            }
+
+            if constexpr (TOROIDAL_WORLD) {
+                this->interact_nearby_regions(cell, center_sensor, center_ray, bounds);
+            }
+            else {
+                for (Cell* other_cell: cells) {
+                    interact_cell(cell, center_sensor, center_ray, bounds, other_cell, other_cell->get_position());
+                }
+                for (Food* food: foods) {
+                    interact_food(cell, center_sensor, center_ray, bounds, food, food->get_position());
                 }
             }
+            if constexpr (NUTRIENT_FIELD_PLANTS) {
+                this->interact_nutrients(cell, center_sensor);
+            }
 
-            cells[cell1_index]->cell_vision(center_sensor);
+            cell->cell_vision(center_sensor);
         }
     }
     void tick() {
-        for (unsigned short cell_index = this->partial_id; cell_index < (unsigned short) cells.size(); cell_index += this->total) {
+        this->batch.clear();
+        for (unsigned int cell_index = this->partial_id; cell_index < (unsigned int) cells.size(); cell_index += this->total) {
+            if (cells[cell_index]->get_timestep() == 0) {
+                continue;
+            }
+            if constexpr (BATCHED_CELL_UPDATE) {
+                cells[cell_index]->think();
+                this->batch.gather(cells[cell_index]);
+                continue;
+            }
             cells[cell_index]->tick();
         }
+        if constexpr (BATCHED_CELL_UPDATE) {
+            this->batch.update();
+            this->batch.scatter();
+        }
+        if constexpr (BRAIN_MEMOIZATION) {
+            BrainCacheStatistics::flush_local();
+        }
     }
 
     void update() override {
@@ -143,7 +276,7 @@ protected:
     }
 
     void signal_shutdown() override {
-        this->should_shutdown.set_data(true);
+        this->should_shutdown.store(true);
 
         //release all semaphores
         this->do_interaction_notifier.release();
@@ -153,7 +286,7 @@ protected:
     }
 
     void signal_panic() override {
-        this->should_panic.set_data(true);
+        this->should_panic.store(true);
 
         //release all semaphores
         this->do_interaction_notifier.release();
@@ -188,18 +321,27 @@ public:
     std::binary_semaphore tick_completion_notifier{0};
 
     explicit PartialProcessingSubsystem(const unsigned int partial_id,
-                                        const unsigned int total, std::vector<Cell*> &cells,
-                                        std::list<Egg*> &eggs, std::list<Food*> &foods):
+                                        const unsigned int total, Simulation &simulation):
                                         partial_id(partial_id),
                                         total(total),
-                                        cells(cells),
-                                        eggs(eggs),
-                                        foods(foods) {
+                                        simulation(simulation),
+                                        cells(simulation.get_cells()),
+                                        eggs(simulation.get_eggs()),
+                                        foods(simulation.get_foods()),
+                                        regions(simulation.get_regions()),
+                                        nutrients(simulation.get_nutrients()) {
 
     }
 
     ~PartialProcessingSubsystem() = default;
 
+    /**
+     * This thread's share of the last sampled tick, only read between ticks
+     */
+    [[nodiscard]] const TelemetrySample& get_sample() const {
+        return this->sample;
+    }
+
     [[nodiscard]] constexpr std::string id() const override {
         return "Partial Processing Subsystem";
     }
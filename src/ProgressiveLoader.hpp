@@ -0,0 +1,260 @@
+#pragma once
+
+
+#include <cstdint>
+#include <vector>
+#include <span>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <filesystem>
+#include <format>
+
+
+#include "Snapshot.hpp"
+#include "Region.hpp"
+#include "ThreadSafety.hpp"
+#include "Logging.hpp"
+
+
+constexpr bool PROGRESSIVE_LOADING = true; // Load tiled binary saves region by region around the camera instead of all at once, regions skip ticks while they wait so resumed runs only match uninterrupted ones with RunOptions::exact_resume (--resume exact, the default with --record), which finishes loading before the first tick
+
+
+/**
+ * Records of a memory mapped save, read in place
+ */
+class SnapshotRecordViews {
+public:
+    std::span<const GenomeBinaryRecord> genomes;
+    std::span<const CellBinaryRecord> cells;
+    std::span<const EggBinaryRecord> eggs;
+    std::span<const FoodBinaryRecord> plants;
+    std::span<const FoodBinaryRecord> meats;
+    std::span<const NutrientBinaryRecord> nutrients;
+    bool has_nutrients = false;
+};
+
+/**
+ * One tile's worth of a save, ready to be restored into the simulation
+ */
+class LoadedTile {
+public:
+    int tile;
+    Snapshot snapshot;
+};
+
+
+/**
+ * Streams a tiled binary save (see TILED_SAVES) in on its own thread, one tile at a time, nearest to the focus first
+ * The save stays memory mapped and only the records of a tile are touched when the tile is loaded, each tile is
+ * checksummed on its own, so the time until the first tiles arrive does not depend on the size of the world.
+ * Finished tiles are handed over with take_loaded() and restored by the simulation between ticks.
+ */
+class ProgressiveLoader {
+private:
+    BinarySaveReader reader;
+    SnapshotRecordViews records;
+    std::vector<TileRecord> tiles;
+    std::vector<uint32_t> order;
+    std::vector<std::shared_ptr<DNA_t>> genomes; // Constructed on first use, only touched by the loading thread
+    Snapshot state; // Only the simulation state, no entities
+
+    ThreadSafe<Vector2> focus;
+    std::mutex loaded_lock;
+    std::vector<LoadedTile> loaded; // Finished, not taken yet
+    std::atomic<bool> stopping = false;
+    std::atomic<size_t> loaded_count = 0;
+    std::thread thread;
+
+    template<typename Record> bool view(const SaveSectionType type, std::span<const Record> &span) {
+        const Record* data;
+        uint64_t count;
+        if (!this->reader.view_section(type, data, count)) {
+            return false;
+        }
+        span = {data, count};
+        return true;
+    }
+
+    /**
+     * Gather, verify and convert one tile
+     * @return Whether the tile was intact, failures are logged
+     */
+    bool load_tile(const int index, Snapshot &snapshot) {
+        const TileRecord &tile = this->tiles[index];
+        const uint32_t* tile_order = this->order.data() + tile.first_order;
+        const size_t sizes[TILE_RECORD_TYPE_COUNT] = {this->records.cells.size(), this->records.eggs.size(), this->records.plants.size(), this->records.meats.size(), this->records.nutrients.size()};
+        const uint32_t* member = tile_order;
+        for (unsigned int type = 0; type < TILE_RECORD_TYPE_COUNT; type++) {
+            for (uint32_t count = 0; count < tile.counts[type]; count++, member++) {
+                if (*member >= sizes[type]) {
+                    this->reader.log_error(std::format("tile {} refers to missing record {}", index, *member));
+                    return false;
+                }
+            }
+        }
+        SnapshotRecords gathered;
+        Snapshot::gather_tile(this->records, tile_order, tile, gathered);
+        const auto valid_genome = [this](const uint32_t genome) {
+            return genome < this->records.genomes.size();
+        };
+        if (!std::all_of(gathered.cells.begin(), gathered.cells.end(), [&valid_genome](const CellBinaryRecord &record) { return valid_genome(record.genome); })
+                or !std::all_of(gathered.eggs.begin(), gathered.eggs.end(), [&valid_genome](const EggBinaryRecord &record) { return valid_genome(record.genome); })) {
+            this->reader.log_error(std::format("tile {} refers to a missing genome", index));
+            return false;
+        }
+        if (Snapshot::tile_checksum(gathered, this->records.genomes.data()) != tile.checksum) {
+            this->reader.log_error(std::format("tile {} failed its checksum, it is corrupted", index));
+            return false;
+        }
+        return Snapshot::from_records(gathered, snapshot, [this](const uint32_t genome, const uint64_t) {
+            if (this->genomes[genome] == nullptr) {
+                this->genomes[genome] = std::make_shared<DNA_t>(this->records.genomes[genome].genes);
+            }
+            return this->genomes[genome];
+        });
+    }
+
+    /**
+     * Squared distance between two tiles in tiles, across the wrapped edges
+     */
+    [[nodiscard]] static int tile_distance(const int a, const int b) {
+        int dx = std::abs(a % REGIONS_PER_SIDE - b % REGIONS_PER_SIDE);
+        int dy = std::abs(a / REGIONS_PER_SIDE - b / REGIONS_PER_SIDE);
+        dx = std::min(dx, REGIONS_PER_SIDE - dx);
+        dy = std::min(dy, REGIONS_PER_SIDE - dy);
+        return dx * dx + dy * dy;
+    }
+
+    void run() {
+        std::vector<int> remaining(REGION_COUNT);
+        for (int index = 0; index < REGION_COUNT; index++) {
+            remaining[index] = index;
+        }
+        int sorted_for = -1;
+        while (!remaining.empty() and !this->stopping.load()) {
+            // nearest last, resorted whenever the focus moves to another tile
+            const int focus_tile = RegionGrid::region_at(this->focus.get_data());
+            if (focus_tile != sorted_for) {
+                std::sort(remaining.begin(), remaining.end(), [focus_tile](const int a, const int b) {
+                    return ProgressiveLoader::tile_distance(a, focus_tile) > ProgressiveLoader::tile_distance(b, focus_tile);
+                });
+                sorted_for = focus_tile;
+            }
+            LoadedTile tile;
+            tile.tile = remaining.back();
+            remaining.pop_back();
+            if (!this->load_tile(tile.tile, tile.snapshot)) {
+                tile.snapshot = Snapshot(); // a damaged tile arrives empty so its region doesn't stay frozen
+            }
+            std::lock_guard<std::mutex> guard(this->loaded_lock);
+            this->loaded.push_back(std::move(tile));
+            this->loaded_count++;
+        }
+    }
+
+public:
+    ProgressiveLoader() = default;
+
+    ProgressiveLoader(const ProgressiveLoader&) = delete;
+    ProgressiveLoader& operator=(const ProgressiveLoader&) = delete;
+
+    ~ProgressiveLoader() {
+        this->stopping.store(true);
+        if (this->thread.joinable()) {
+            this->thread.join();
+        }
+    }
+
+    /**
+     * Map a save and check its tile index, nothing else is read
+     * @return Whether the save is intact as far as checked and tiled for this build's region grid, a save that
+     * isn't can still be loaded in full
+     */
+    bool open(const std::filesystem::path &path) {
+        if (!this->reader.open(path, false) or !this->reader.has_section(TILE_GRID_SECTION)) {
+            return false;
+        }
+        std::vector<TileGridRecord> grid;
+        if (!this->reader.verify_section(TILE_GRID_SECTION) or !this->reader.verify_section(TILE_SECTION) or !this->reader.verify_section(TILE_ORDER_SECTION)
+                or !this->reader.read_section(TILE_GRID_SECTION, grid) or !this->reader.read_section(TILE_SECTION, this->tiles) or !this->reader.read_section(TILE_ORDER_SECTION, this->order)) {
+            return false;
+        }
+        if (!this->reader.verify_section(STATE_SECTION) or !this->reader.verify_section(RANDOM_STATE_SECTION) or !Snapshot::read_state_sections(this->reader, this->state)) {
+            return false;
+        }
+        if (grid.size() != 1 or grid[0].tile_size != REGION_SIZE or grid[0].tiles_per_side != (uint32_t) REGIONS_PER_SIDE or grid[0].world_size != WORLD_SIZE or this->tiles.size() != (size_t) REGION_COUNT) {
+            this->reader.log_error("tiled for another world or region size");
+            return false;
+        }
+        for (const TileRecord &tile: this->tiles) {
+            uint64_t count = 0;
+            for (const uint32_t type_count: tile.counts) {
+                count += type_count;
+            }
+            if (tile.first_order > this->order.size() or count > this->order.size() - tile.first_order) {
+                this->reader.log_error("tile index runs past the end of the record order");
+                return false;
+            }
+        }
+        if (!this->view(GENOME_SECTION, this->records.genomes) or !this->view(CELL_SECTION, this->records.cells) or !this->view(EGG_SECTION, this->records.eggs)
+                or !this->view(PLANT_SECTION, this->records.plants) or !this->view(MEAT_SECTION, this->records.meats) or !this->view(NUTRIENT_SECTION, this->records.nutrients)) {
+            return false;
+        }
+        this->records.has_nutrients = this->reader.has_section(NUTRIENT_SECTION);
+        this->genomes.resize(this->records.genomes.size());
+        return true;
+    }
+
+    /**
+     * Counters and random state of the save, see Snapshot::has_state
+     */
+    [[nodiscard]] const Snapshot& get_state() const {
+        return this->state;
+    }
+
+    /**
+     * Start loading on a new thread, only call once after open() succeeded
+     * @param _focus Tiles around here come first
+     */
+    void start(const Vector2 _focus) {
+        this->focus.set_data(_focus);
+        this->thread = std::thread(&ProgressiveLoader::run, this);
+    }
+
+    /**
+     * Move the point that the remaining tiles are loaded around
+     */
+    void set_focus(const Vector2 _focus) {
+        this->focus.set_data(_focus);
+    }
+
+    /**
+     * Tiles finished since the last call, in the order they were loaded
+     */
+    [[nodiscard]] std::vector<LoadedTile> take_loaded() {
+        std::vector<LoadedTile> taken;
+        std::lock_guard<std::mutex> guard(this->loaded_lock);
+        taken.swap(this->loaded);
+        return taken;
+    }
+
+    /**
+     * Block until every tile is loaded
+     */
+    void wait() {
+        if (this->thread.joinable()) {
+            this->thread.join();
+        }
+    }
+
+    [[nodiscard]] bool is_finished() const {
+        return this->loaded_count.load() == (size_t) REGION_COUNT;
+    }
+
+    [[nodiscard]] float get_progress() const {
+        return (float) this->loaded_count.load() / (float) REGION_COUNT;
+    }
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+
+#include <string>
+#include <sstream>
+#include <locale>
+
+
+#include "Constants.hpp"
+#include "DNA.hpp"
+
+
+/*
+ * The state of every random generator and distribution the simulation draws from, so a save can continue with the
+ * exact random numbers the run that wrote it would have drawn next
+ * Normal distributions cache the second value of each pair they generate, so they are part of the state too
+ * Everything is written through the standard stream operators, which round trip exactly
+ */
+
+
+/**
+ * Call visit on the engine and on every distribution, always in the same order
+ */
+template<typename Visit> void visit_random_state(Visit visit) {
+    visit(RNG);
+    visit(uniform_percent);
+    visit(random_angle);
+    visit(shit_offset);
+    visit(random_originish);
+    visit(random_weight);
+    visit(weight_mutation);
+    visit(random_bias);
+    visit(bias_mutation);
+    visit(random_radius);
+    visit(radius_mutation);
+    visit(random_diet);
+    visit(diet_mutation);
+    visit(random_speed);
+    visit(speed_mutation);
+    visit(random_vision_range);
+    visit(vision_range_mutation);
+    visit(random_egg_energy_transfer);
+    visit(egg_energy_transfer_mutation);
+    visit(random_metabolism);
+    visit(metabolism_mutation);
+    visit(random_color);
+    visit(color_mutation);
+}
+
+/**
+ * @return The random state as a single line of text
+ */
+[[nodiscard]] std::string save_random_state() {
+    std::ostringstream stream;
+    stream.imbue(std::locale::classic());
+    visit_random_state([&stream](const auto &generator) {
+        stream << generator << ' ';
+    });
+    return stream.str();
+}
+
+/**
+ * Continue from a state written by save_random_state(), nothing changes unless the whole state could be read
+ * @return Whether the state was restored
+ */
+[[nodiscard]] bool load_random_state(const std::string &state) {
+    std::istringstream check_stream(state);
+    check_stream.imbue(std::locale::classic());
+    bool valid = true;
+    visit_random_state([&check_stream, &valid](const auto &generator) {
+        auto copy = generator;
+        valid = valid and (check_stream >> copy);
+    });
+    if (!valid) {
+        return false;
+    }
+    std::istringstream stream(state);
+    stream.imbue(std::locale::classic());
+    visit_random_state([&stream](auto &generator) {
+        stream >> generator;
+    });
+    return true;
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+
+#include <vector>
+#include <list>
+#include <cmath>
+
+
+#include "Constants.hpp"
+#include "Cell.hpp"
+#include "Egg.hpp"
+#include "Food.hpp"
+
+
+constexpr float REGION_SIZE = 1000.0f; // Must stay larger than the longest vision ray so queries only reach neighboring regions
+constexpr int REGIONS_PER_SIDE = (int) (WORLD_SIZE / REGION_SIZE);
+constexpr int REGION_COUNT = REGIONS_PER_SIDE * REGIONS_PER_SIDE;
+static_assert(REGION_SIZE > VISION_RANGE.max, "vision rays would reach past the neighboring regions");
+
+
+/**
+ * A square piece of the wrapped world
+ */
+class Region {
+public:
+    std::vector<Cell*> cells;
+    std::vector<std::list<Food*>::iterator> foods;
+    unsigned long awake_tick = 0; // Last tick the region was awake
+};
+
+
+/**
+ * Splits the wrapped world into regions
+ * A region is awake while it or one of its neighbors holds a cell or an egg, every other region sleeps
+ * Sleeping regions are never visited by the per-tick passes, so the cost follows the occupied area instead of the world size
+ */
+class RegionGrid {
+private:
+    std::vector<Region> regions;
+    std::vector<int> awake_regions;
+    std::vector<int> previously_awake_regions;
+    unsigned long tick = 0;
+
+    /**
+     * Mark region and its neighbors as awake for this tick
+     * Regions are emptied the first time they are touched in a tick
+     */
+    void wake_around(const Vector2 position) {
+        const int center_x = RegionGrid::unwrapped_coordinate(position.x);
+        const int center_y = RegionGrid::unwrapped_coordinate(position.y);
+        for (int region_y = center_y - 1; region_y <= center_y + 1; region_y++) {
+            for (int region_x = center_x - 1; region_x <= center_x + 1; region_x++) {
+                const int index = RegionGrid::region_index(region_x, region_y);
+                Region &region = this->regions[index];
+                if (region.awake_tick == this->tick) {
+                    continue;
+                }
+                region.awake_tick = this->tick;
+                region.cells.clear();
+                this->awake_regions.push_back(index);
+            }
+        }
+    }
+
+public:
+    RegionGrid(): regions(REGION_COUNT) {    }
+
+    /**
+     * Region column/row of a coordinate, not wrapped so that rays crossing the edge keep increasing
+     */
+    [[nodiscard]] static int unwrapped_coordinate(const float position) {
+        return (int) std::floor((position + HALF_WORLD_SIZE) / REGION_SIZE);
+    }
+
+    [[nodiscard]] static int region_index(const int region_x, const int region_y) {
+        const int wrapped_x = ((region_x % REGIONS_PER_SIDE) + REGIONS_PER_SIDE) % REGIONS_PER_SIDE;
+        const int wrapped_y = ((region_y % REGIONS_PER_SIDE) + REGIONS_PER_SIDE) % REGIONS_PER_SIDE;
+        return wrapped_y * REGIONS_PER_SIDE + wrapped_x;
+    }
+
+    [[nodiscard]] static int region_at(const Vector2 position) {
+        return RegionGrid::region_index(RegionGrid::unwrapped_coordinate(position.x), RegionGrid::unwrapped_coordinate(position.y));
+    }
+
+    [[nodiscard]] Region& get_region(const int region_x, const int region_y) {
+        return this->regions[RegionGrid::region_index(region_x, region_y)];
+    }
+
+    [[nodiscard]] Region& get_region(const int index) {
+        return this->regions[index];
+    }
+
+    [[nodiscard]] const std::vector<int>& get_awake_regions() const {
+        return this->awake_regions;
+    }
+
+    [[nodiscard]] bool is_awake(const int index) const {
+        return this->regions[index].awake_tick == this->tick;
+    }
+
+    /**
+     * Register food that was just added to the food list
+     * @param food Iterator to the food in the simulation's food list
+     */
+    void add_food(const std::list<Food*>::iterator food) {
+        this->regions[RegionGrid::region_at((*food)->get_position())].foods.push_back(food);
+    }
+
+    /**
+     * Rebucket cells and work out which regions are awake
+     * Only touches regions that are or just were awake
+     */
+    void update(const std::vector<Cell*> &cells, const std::list<Egg*> &eggs) {
+        this->tick++;
+        std::swap(this->awake_regions, this->previously_awake_regions);
+        this->awake_regions.clear();
+
+        for (Cell* cell: cells) {
+            this->wake_around(cell->get_position());
+            this->regions[RegionGrid::region_at(cell->get_position())].cells.push_back(cell);
+        }
+        for (Egg* egg: eggs) {
+            this->wake_around(egg->get_position());
+        }
+
+        // regions that just fell asleep must not keep pointers to cells that can be deleted
+        for (const int index: this->previously_awake_regions) {
+            if (!this->is_awake(index)) {
+                this->regions[index].cells.clear();
+            }
+        }
+    }
+
+    /**
+     * Drop consumed food from awake regions and the simulation's food list
+     * Sleeping regions can't have had anything eaten
+     * Regions keep their food in the order of the food list, so a loaded save rebuilds them in the same order
+     * @param foods Simulation food list
+     */
+    void remove_consumed_foods(std::list<Food*> &foods) {
+        for (const int index: this->awake_regions) {
+            std::vector<std::list<Food*>::iterator> &region_foods = this->regions[index].foods;
+            size_t kept = 0;
+            for (size_t food_index = 0; food_index < region_foods.size(); food_index++) {
+                if ((*region_foods[food_index])->is_consumed()) {
+                    foods.erase(region_foods[food_index]);
+                    continue;
+                }
+                region_foods[kept] = region_foods[food_index];
+                kept++;
+            }
+            region_foods.resize(kept);
+        }
+    }
+
+    /**
+     * Register every food again, after the food list was reordered
+     * @param foods Simulation food list
+     */
+    void reindex_foods(std::list<Food*> &foods) {
+        for (Region &region: this->regions) {
+            region.foods.clear();
+        }
+        for (std::list<Food*>::iterator food = foods.begin(); food != foods.end(); food++) {
+            this->add_food(food);
+        }
+    }
+};
@@ -10,12 +10,21 @@
 #include "Subsystem.hpp"
 #include "Constants.hpp"
 #include "Cell.hpp"
+#include "NutrientField.hpp"
 #include "ManagerSignals.hpp"
+#include "Rewind.hpp"
+#include "Replay.hpp"
+#include "TraitStatistics.hpp"
+#include "Species.hpp"
+#include "Colony.hpp"
 
 
 constexpr float BASE_CAMERA_MOVEMENT_SPEED = 200;
 constexpr float SPRINT_CAMERA_MOVEMENT_SPEED = BASE_CAMERA_MOVEMENT_SPEED * 5;
 constexpr float CAMERA_ZOOM_SPEED = 0.5f;
+constexpr unsigned long LONG_STEP_TICKS = 10; // Stepped by shift N, N steps one tick
+constexpr unsigned long FAST_FORWARD_TICKS = 1000; // Fast forwarded by F, shift F fast forwards ten times as many
+constexpr unsigned long RUN_UNTIL_INTERVAL = 1000; // U runs until the next multiple of this
 
 
 class RenderSubsystem: public Subsystem {
@@ -26,6 +35,14 @@ private:
     std::vector<Cell*> &cells;
     std::list<Egg*> &eggs;
     std::list<Food*> &foods;
+    NutrientField &nutrients;
+    ReplayPlayer* replay = nullptr; // Drawn instead of the simulation when set
+    const TraitStatistics* traits = nullptr; // Drawn as a panel when set and toggled on
+    bool show_traits = false;
+    SpeciesSubsystem* species = nullptr; // Colors cells by species when set and toggled on
+    bool show_species = false;
+    const ColonyTracker* colonies = nullptr; // Outlined with a summary when set and toggled on
+    bool show_colonies = false;
 
     void init() override {
         SetConfigFlags(FLAG_WINDOW_RESIZABLE);
@@ -34,8 +51,6 @@ private:
         SetWindowMinSize(WINDOW_SIZE, WINDOW_SIZE);
         SetExitKey(0);
 
-        this->paused.set_data(false);
-
         this->camera = {{WINDOW_SIZE / 2.0f, WINDOW_SIZE / 2.0f},
                         {WINDOW_SIZE / 2.0f, WINDOW_SIZE / 2.0f},
                         0.0f,
@@ -71,19 +86,43 @@ private:
         BeginDrawing();
             ClearBackground(BLACK);
             BeginMode2D(this->camera);
-                this->draw_focus_marker(this->focused_id);
-                this->draw();
+                if (this->replay != nullptr) {
+                    this->replay->draw([this](const Vector2 position) { return this->should_render(position); });
+                }
+                else {
+                    this->draw_focus_marker(this->focused_id);
+                    this->draw();
+                    if (this->show_colonies and this->colonies != nullptr) {
+                        this->colonies->draw();
+                    }
+                }
             EndMode2D();
-            this->draw_focus_info(this->focused_id);
+            if (this->replay != nullptr) {
+                this->replay->draw_info();
+            }
+            else {
+                this->draw_control_info();
+                this->draw_focus_info(this->focused_id);
+                if (this->show_traits and this->traits != nullptr) {
+                    this->traits->draw_panel();
+                }
+                if (this->show_colonies and this->colonies != nullptr) {
+                    this->colonies->draw_summary();
+                }
+            }
             DrawFPS((int) (.9 * GetScreenWidth()), (int) (.02 * GetScreenHeight()));
         EndDrawing();
 
         if(WindowShouldClose()) {
-            ManagerSignals::shutdown.set_data(true);
+            ManagerSignals::control.request_shutdown();
         }
     }
 
     void draw() const {
+        if constexpr (NUTRIENT_FIELD_PLANTS) {
+            this->nutrients.draw(GetScreenToWorld2D({0, 0}, this->camera), GetScreenToWorld2D({(float) GetScreenWidth(), (float) GetScreenHeight()}, this->camera));
+        }
+
         for (Food* food: this->foods) {
             if (!this->should_render(food->get_position())) {
                 continue;
@@ -98,11 +137,35 @@ private:
             egg->draw();
         }
 
+        const std::shared_ptr<const SpeciesLabels> labels = this->show_species and this->species != nullptr ? this->species->get_labels() : nullptr;
         for (Cell* cell: this->cells) {
             if (!this->should_render(cell->get_position())) {
                 continue;
             }
-            cell->draw();
+            const uint32_t cell_species = labels == nullptr ? 0 : labels->species_of(cell->get_dna().get());
+            if (cell_species == 0) {
+                cell->draw();
+            }
+            else {
+                cell->draw(SpeciesLabels::get_color(cell_species));
+            }
+        }
+    }
+
+    /**
+     * Pausing, stepping, fast forwarding and running until a tick, in the bottom right corner
+     */
+    static void draw_control_info() {
+        const Control &control = ManagerSignals::control;
+        const Vector2 position = {(float) GetScreenWidth() - 200.0f, (float) GetScreenHeight() - 25.0f};
+        if (control.is_fast_forwarding()) {
+            DrawTextEx(GetFontDefault(), "Fast forwarding", position, FONT_SIZE, 1, YELLOW);
+        }
+        else if (control.get_run_until_tick() != 0) {
+            DrawTextEx(GetFontDefault(), TextFormat("Running until tick %llu", (unsigned long long) control.get_run_until_tick()), position, FONT_SIZE, 1, WHITE);
+        }
+        else if (control.is_paused()) {
+            DrawTextEx(GetFontDefault(), "Paused", position, FONT_SIZE, 1, WHITE);
         }
     }
 
@@ -125,10 +188,41 @@ private:
         }
     }
     void input() {
+        Control &control = ManagerSignals::control;
         if (IsKeyPressed(KEY_SPACE)) {
-            this->paused.manual_lock();
-            this->paused.unsafe_set_data(!this->paused.unsafe_get_data());
-            this->paused.manual_unlock();
+            control.toggle_pause();
+        }
+
+        if (IsKeyPressed(KEY_N)) {
+            control.step(IsKeyDown(KEY_LEFT_SHIFT) ? LONG_STEP_TICKS : 1);
+        }
+
+        if (IsKeyPressed(KEY_F)) {
+            control.toggle_fast_forward(IsKeyDown(KEY_LEFT_SHIFT) ? FAST_FORWARD_TICKS * 10 : FAST_FORWARD_TICKS);
+        }
+
+        if (IsKeyPressed(KEY_U)) {
+            control.run_until_next(RUN_UNTIL_INTERVAL);
+        }
+
+        if (IsKeyPressed(KEY_K)) {
+            control.request_save();
+        }
+
+        if (REWIND and IsKeyPressed(KEY_R)) {
+            control.request_rewind(IsKeyDown(KEY_LEFT_SHIFT) ? REWIND_LONG_STEPS : 1);
+        }
+
+        if (IsKeyPressed(KEY_T)) {
+            this->show_traits = !this->show_traits;
+        }
+
+        if (IsKeyPressed(KEY_C)) {
+            this->show_species = !this->show_species;
+        }
+
+        if (IsKeyPressed(KEY_G)) {
+            this->show_colonies = !this->show_colonies;
         }
 
         if (IsKeyPressed(KEY_ONE)) {
@@ -176,7 +270,12 @@ private:
             this->camera.zoom = std::max(0.01f, this->camera.zoom);
         }
 
-        if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+        this->focus.set_data(this->camera.target);
+
+        if (this->replay != nullptr) {
+            this->replay->input();
+        }
+        else if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
             Vector2 mouse_position = GetScreenToWorld2D(GetMousePosition(), this->camera);
             this->focused_id = this->get_cell_at(mouse_position);
         }
@@ -191,7 +290,7 @@ private:
     };
 
     void signal_shutdown() override {
-        this->should_shutdown.set_data(true);
+        this->should_shutdown.store(true);
 
         //release all semaphores
         this->render_notifier.release();
@@ -199,7 +298,7 @@ private:
     }
 
     void signal_panic() override {
-        this->should_panic.set_data(true);
+        this->should_panic.store(true);
 
         //release all semaphores
         this->render_notifier.release();
@@ -216,15 +315,43 @@ private:
     }
 
 public:
-    ThreadSafe<bool> paused;
+    ThreadSafe<Vector2> focus; // Camera target for level of detail scheduling
     std::binary_semaphore render_notifier{0};
     std::binary_semaphore finished_render_notifier{0};
-    RenderSubsystem(std::vector<Cell*> &cells, std::list<Egg*> &eggs, std::list<Food*> &foods): cells(cells), eggs(eggs), foods(foods)  {
+    RenderSubsystem(std::vector<Cell*> &cells, std::list<Egg*> &eggs, std::list<Food*> &foods, NutrientField &nutrients): cells(cells), eggs(eggs), foods(foods), nutrients(nutrients), focus(Vector2{WINDOW_SIZE / 2.0f, WINDOW_SIZE / 2.0f})  {
 
     }
 
     ~RenderSubsystem() = default;
 
+    /**
+     * Draw a replay instead of the simulation, call before run_thread()
+     */
+    void set_replay(ReplayPlayer* _replay) {
+        this->replay = _replay;
+    }
+
+    /**
+     * Statistics to show on the trait panel (T), call before run_thread()
+     */
+    void set_traits(const TraitStatistics* _traits) {
+        this->traits = _traits;
+    }
+
+    /**
+     * Species to color cells by (C), call before run_thread()
+     */
+    void set_species(SpeciesSubsystem* _species) {
+        this->species = _species;
+    }
+
+    /**
+     * Colonies to outline (G), call before run_thread()
+     */
+    void set_colonies(const ColonyTracker* _colonies) {
+        this->colonies = _colonies;
+    }
+
     [[nodiscard]] constexpr std::string id() const override {
         return "Render Subsystem";
     }
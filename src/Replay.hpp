@@ -0,0 +1,758 @@
+#pragma once
+
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <list>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <format>
+#include <type_traits>
+
+
+#include <raylib.h>
+
+
+#include "Constants.hpp"
+#include "Cell.hpp"
+#include "Egg.hpp"
+#include "Food.hpp"
+#include "BinarySave.hpp"
+#include "Logging.hpp"
+
+
+constexpr uint32_t REPLAY_VERSION = 1; // Bump whenever the frame encoding changes
+constexpr char REPLAY_MAGIC[8] = {'M', 'E', 'A', 'T', 'R', 'P', 'L', 'Y'};
+constexpr unsigned int REPLAY_KEYFRAME_PERIOD = 250; // Frames between keyframes, a seek decodes at most this many
+constexpr float REPLAY_POSITION_SCALE = 8.0f; // Positions are recorded in steps of 1 / REPLAY_POSITION_SCALE
+constexpr unsigned int REPLAY_MAX_SPEED = 4096; // Frames played per rendered frame at most
+
+
+/*
+ * Replays record what the renderer draws, one frame per tick, so a run can be watched again far faster than it was
+ * simulated. The file is a ReplayHeader followed by frames, each a ReplayFrameHeader and its payload, and is only
+ * ever appended to, a torn frame at the end is cut off by the next recording session.
+ *
+ * A payload lists, for cells, eggs and foods in turn, what changed since the previous frame:
+ *   removed: indices into the previous frame's list
+ *   spawned: everything that never changes about the new entities, appended to the list
+ * Entities stay in the order the simulation keeps them in, by id with new ones at the end (see
+ * Simulation::order_loaded_entities()), so nothing else is needed to tell which entity is which.
+ * Cells then get two bytes of flags and heading each and their movement in position steps as two more bytes, or the
+ * absolute position when it moved too far. Eggs and foods only list the ones that moved or changed size.
+ * Keyframes are encoded the same way against an empty frame, so they stand on their own and seeking starts from the
+ * keyframe before the target. The nutrient field is not recorded.
+ */
+
+
+enum ReplayFrameType: uint32_t {
+    REPLAY_KEYFRAME,
+    REPLAY_DELTA
+};
+
+enum ReplayCellFlag: uint8_t {
+    REPLAY_STAB_FLAG = 1,
+    REPLAY_EAT_FLAG = 2,
+    REPLAY_ABSOLUTE_FLAG = 128 // The position follows in full instead of as a step
+};
+
+class ReplayHeader {
+public:
+    char magic[8];
+    uint32_t version;
+    float world_size;
+};
+
+class ReplayFrameHeader {
+public:
+    uint64_t tick;
+    uint32_t type;
+    uint32_t size; // Of the payload
+    uint64_t checksum; // Of the payload
+};
+
+static_assert(std::is_trivially_copyable_v<ReplayHeader> and std::is_trivially_copyable_v<ReplayFrameHeader>);
+
+/**
+ * A cell as drawn, positions in steps of 1 / REPLAY_POSITION_SCALE
+ */
+class ReplayCell {
+public:
+    uint64_t id;
+    int32_t x;
+    int32_t y;
+    float radius;
+    float vision_range;
+    Color color;
+    uint8_t heading; // In 1/256 of a turn
+    uint8_t flags;
+};
+
+/**
+ * An egg or food as drawn
+ */
+class ReplayBody {
+public:
+    uint64_t id;
+    int32_t x;
+    int32_t y;
+    float radius;
+    Color color;
+};
+
+
+[[nodiscard]] int32_t quantize_replay_position(const float position) {
+    return (int32_t) std::lround(position * REPLAY_POSITION_SCALE);
+}
+
+[[nodiscard]] Vector2 replay_position(const int32_t x, const int32_t y) {
+    return {(float) x / REPLAY_POSITION_SCALE, (float) y / REPLAY_POSITION_SCALE};
+}
+
+
+/**
+ * Appends values to a payload
+ */
+class ReplayWriter {
+public:
+    std::vector<unsigned char> bytes;
+
+    template<typename T> void put(const T &value) {
+        const size_t offset = this->bytes.size();
+        this->bytes.resize(offset + sizeof(T));
+        std::memcpy(this->bytes.data() + offset, &value, sizeof(T));
+    }
+};
+
+/**
+ * Reads values back from a payload, every read is bounds checked
+ */
+class ReplayReader {
+private:
+    const unsigned char* data;
+    size_t size;
+    size_t offset = 0;
+
+public:
+    ReplayReader(const unsigned char* data, const size_t size): data(data), size(size) {
+
+    }
+
+    template<typename T> [[nodiscard]] bool get(T &value) {
+        if (this->size - this->offset < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, this->data + this->offset, sizeof(T));
+        this->offset += sizeof(T);
+        return true;
+    }
+
+    [[nodiscard]] bool is_finished() const {
+        return this->offset == this->size;
+    }
+};
+
+
+/**
+ * Everything one frame of a replay draws
+ */
+class ReplayState {
+private:
+    /**
+     * Match the entities of a frame to those of the previous frame
+     * @param matches Set to the previous index of every entity, -1 for new ones
+     * @param removed Set to the previous indices that are gone, ascending
+     * @return Whether the new entities all come after the surviving ones, otherwise the frame needs a keyframe
+     */
+    template<typename Entity> [[nodiscard]] static bool match(const std::vector<Entity> &previous, const std::vector<Entity> &current, std::vector<int64_t> &matches, std::vector<uint32_t> &removed) {
+        matches.resize(current.size());
+        removed.clear();
+        size_t index = 0;
+        for (size_t current_index = 0; current_index < current.size(); current_index++) {
+            while (index < previous.size() and previous[index].id < current[current_index].id) {
+                removed.push_back((uint32_t) index++);
+            }
+            if (index < previous.size() and previous[index].id == current[current_index].id) {
+                matches[current_index] = (int64_t) index++;
+                continue;
+            }
+            if (index < previous.size()) {
+                return false;
+            }
+            matches[current_index] = -1;
+        }
+        for (; index < previous.size(); index++) {
+            removed.push_back((uint32_t) index);
+        }
+        return true;
+    }
+
+    static void write_removed(const std::vector<uint32_t> &removed, ReplayWriter &writer) {
+        writer.put((uint32_t) removed.size());
+        for (const uint32_t index: removed) {
+            writer.put(index);
+        }
+    }
+
+    /**
+     * Drop the entities a frame removed, keeping the order of the rest
+     */
+    template<typename Entity> [[nodiscard]] static bool read_removed(ReplayReader &reader, std::vector<Entity> &entities) {
+        uint32_t count;
+        if (!reader.get(count) or count > entities.size()) {
+            return false;
+        }
+        size_t kept = 0;
+        size_t next = 0;
+        for (uint32_t removal = 0; removal < count; removal++) {
+            uint32_t index;
+            if (!reader.get(index) or index < next or index >= entities.size()) {
+                return false;
+            }
+            for (; next < index; next++) {
+                entities[kept++] = entities[next];
+            }
+            next = index + 1;
+        }
+        for (; next < entities.size(); next++) {
+            entities[kept++] = entities[next];
+        }
+        entities.resize(kept);
+        return true;
+    }
+
+    static void write_bodies(const std::vector<ReplayBody> &previous, const std::vector<ReplayBody> &current, const std::vector<int64_t> &matches, const std::vector<uint32_t> &removed, ReplayWriter &writer) {
+        ReplayState::write_removed(removed, writer);
+        uint32_t changed = 0;
+        uint32_t spawned = 0;
+        for (size_t index = 0; index < current.size(); index++) {
+            if (matches[index] < 0) {
+                spawned++;
+                continue;
+            }
+            const ReplayBody &before = previous[matches[index]];
+            changed += before.x != current[index].x or before.y != current[index].y or before.radius != current[index].radius;
+        }
+        writer.put(changed);
+        for (size_t index = 0; index < current.size() - spawned; index++) {
+            const ReplayBody &body = current[index];
+            const ReplayBody &before = previous[matches[index]];
+            if (before.x != body.x or before.y != body.y or before.radius != body.radius) {
+                writer.put((uint32_t) index);
+                writer.put(body.x);
+                writer.put(body.y);
+                writer.put(body.radius);
+            }
+        }
+        writer.put(spawned);
+        for (size_t index = current.size() - spawned; index < current.size(); index++) {
+            writer.put(current[index]);
+        }
+    }
+
+    [[nodiscard]] static bool read_bodies(ReplayReader &reader, std::vector<ReplayBody> &bodies) {
+        uint32_t count;
+        if (!ReplayState::read_removed(reader, bodies) or !reader.get(count)) {
+            return false;
+        }
+        for (uint32_t change = 0; change < count; change++) {
+            uint32_t index;
+            if (!reader.get(index) or index >= bodies.size()) {
+                return false;
+            }
+            ReplayBody &body = bodies[index];
+            if (!reader.get(body.x) or !reader.get(body.y) or !reader.get(body.radius)) {
+                return false;
+            }
+        }
+        if (!reader.get(count)) {
+            return false;
+        }
+        for (uint32_t spawn = 0; spawn < count; spawn++) {
+            ReplayBody body;
+            if (!reader.get(body)) {
+                return false;
+            }
+            bodies.push_back(body);
+        }
+        return true;
+    }
+
+public:
+    uint64_t tick = 0;
+    std::vector<ReplayCell> cells;
+    std::vector<ReplayBody> eggs;
+    std::vector<ReplayBody> foods;
+
+    /**
+     * Take the drawn state of the simulation, call between ticks
+     */
+    void capture(const uint64_t _tick, const std::vector<Cell*> &_cells, const std::list<Egg*> &_eggs, const std::list<Food*> &_foods) {
+        this->tick = _tick;
+        this->cells.resize(_cells.size());
+        for (size_t index = 0; index < _cells.size(); index++) {
+            const Cell* cell = _cells[index];
+            ReplayCell &record = this->cells[index];
+            record.id = cell->get_id();
+            record.x = quantize_replay_position(cell->get_x_position());
+            record.y = quantize_replay_position(cell->get_y_position());
+            record.radius = cell->get_radius();
+            record.vision_range = cell->get_vision_range();
+            record.color = {(unsigned char) std::round(cell->get_red()), (unsigned char) std::round(cell->get_green()), (unsigned char) std::round(cell->get_blue()), 255};
+            record.heading = (uint8_t) (std::lround(cell->get_angle() * 256.0f / TAU) & 0xFF);
+            record.flags = (cell->does_want_stab() ? REPLAY_STAB_FLAG : 0) | (cell->does_want_eat() ? REPLAY_EAT_FLAG : 0);
+        }
+        this->eggs.clear();
+        for (const Egg* egg: _eggs) {
+            this->eggs.push_back({egg->get_id(), quantize_replay_position(egg->get_x_position()), quantize_replay_position(egg->get_y_position()), egg->get_radius(), egg->get_color()});
+        }
+        this->foods.clear();
+        for (const Food* food: _foods) {
+            this->foods.push_back({food->get_id(), quantize_replay_position(food->get_x_position()), quantize_replay_position(food->get_y_position()), food->get_radius(), food->get_color()});
+        }
+    }
+
+    /**
+     * Encode the changes since another frame
+     * @param previous Frame before this one, an empty frame for a keyframe
+     * @return Whether the change could be encoded, it always can against an empty frame
+     */
+    [[nodiscard]] bool encode(const ReplayState &previous, ReplayWriter &writer) const {
+        std::vector<int64_t> cell_matches;
+        std::vector<int64_t> egg_matches;
+        std::vector<int64_t> food_matches;
+        std::vector<uint32_t> removed_cells;
+        std::vector<uint32_t> removed_eggs;
+        std::vector<uint32_t> removed_foods;
+        if (!ReplayState::match(previous.cells, this->cells, cell_matches, removed_cells) or !ReplayState::match(previous.eggs, this->eggs, egg_matches, removed_eggs)
+                or !ReplayState::match(previous.foods, this->foods, food_matches, removed_foods)) {
+            return false;
+        }
+        writer.bytes.reserve(this->cells.size() * 4 + 256);
+
+        ReplayState::write_removed(removed_cells, writer);
+        const size_t first_spawned = std::find(cell_matches.begin(), cell_matches.end(), -1) - cell_matches.begin();
+        writer.put((uint32_t) (this->cells.size() - first_spawned));
+        for (size_t index = first_spawned; index < this->cells.size(); index++) {
+            const ReplayCell &cell = this->cells[index];
+            writer.put(cell.id);
+            writer.put(cell.radius);
+            writer.put(cell.vision_range);
+            writer.put(cell.color);
+        }
+        for (size_t index = 0; index < this->cells.size(); index++) {
+            const ReplayCell &cell = this->cells[index];
+            if (index < first_spawned) {
+                const ReplayCell &before = previous.cells[cell_matches[index]];
+                const int32_t dx = cell.x - before.x;
+                const int32_t dy = cell.y - before.y;
+                if (dx >= INT8_MIN and dx <= INT8_MAX and dy >= INT8_MIN and dy <= INT8_MAX) {
+                    writer.put(cell.flags);
+                    writer.put(cell.heading);
+                    writer.put((int8_t) dx);
+                    writer.put((int8_t) dy);
+                    continue;
+                }
+            }
+            writer.put((uint8_t) (cell.flags | REPLAY_ABSOLUTE_FLAG));
+            writer.put(cell.heading);
+            writer.put(cell.x);
+            writer.put(cell.y);
+        }
+
+        ReplayState::write_bodies(previous.eggs, this->eggs, egg_matches, removed_eggs, writer);
+        ReplayState::write_bodies(previous.foods, this->foods, food_matches, removed_foods, writer);
+        return true;
+    }
+
+    /**
+     * Apply one frame's payload, start from an empty state for keyframes
+     * @return Whether the payload was well formed, the state is unusable otherwise
+     */
+    [[nodiscard]] bool decode(ReplayReader &reader) {
+        uint32_t spawned;
+        if (!ReplayState::read_removed(reader, this->cells) or !reader.get(spawned)) {
+            return false;
+        }
+        for (uint32_t spawn = 0; spawn < spawned; spawn++) {
+            ReplayCell cell{};
+            if (!reader.get(cell.id) or !reader.get(cell.radius) or !reader.get(cell.vision_range) or !reader.get(cell.color)) {
+                return false;
+            }
+            this->cells.push_back(cell);
+        }
+        for (ReplayCell &cell: this->cells) {
+            if (!reader.get(cell.flags) or !reader.get(cell.heading)) {
+                return false;
+            }
+            if (cell.flags & REPLAY_ABSOLUTE_FLAG) {
+                cell.flags &= ~REPLAY_ABSOLUTE_FLAG;
+                if (!reader.get(cell.x) or !reader.get(cell.y)) {
+                    return false;
+                }
+                continue;
+            }
+            int8_t dx;
+            int8_t dy;
+            if (!reader.get(dx) or !reader.get(dy)) {
+                return false;
+            }
+            cell.x += dx;
+            cell.y += dy;
+        }
+        return ReplayState::read_bodies(reader, this->eggs) and ReplayState::read_bodies(reader, this->foods) and reader.is_finished();
+    }
+
+    void clear() {
+        this->cells.clear();
+        this->eggs.clear();
+        this->foods.clear();
+    }
+
+    /**
+     * Draw like RenderSubsystem draws the simulation
+     * @param should_render Whether a world position is on screen
+     */
+    template<typename ShouldRender> void draw(ShouldRender should_render) const {
+        for (const ReplayBody &food: this->foods) {
+            const Vector2 position = replay_position(food.x, food.y);
+            if (should_render(position)) {
+                DrawCircle((int) std::round(position.x), (int) std::round(position.y), food.radius, food.color);
+            }
+        }
+        for (const ReplayBody &egg: this->eggs) {
+            const Vector2 position = replay_position(egg.x, egg.y);
+            if (should_render(position)) {
+                DrawCircle((int) std::round(position.x), (int) std::round(position.y), egg.radius, egg.color);
+            }
+        }
+        for (const ReplayCell &cell: this->cells) {
+            const Vector2 position = replay_position(cell.x, cell.y);
+            if (!should_render(position)) {
+                continue;
+            }
+            const float angle = (float) cell.heading * TAU / 256.0f;
+            const Vector2 direction = {std::cos(angle), std::sin(angle)};
+            DrawLineV(position, {position.x + direction.x * cell.vision_range, position.y + direction.y * cell.vision_range}, {cell.color.r, cell.color.g, cell.color.b, VISION_LINE_OPACITY});
+            if (cell.flags & REPLAY_STAB_FLAG) {
+                DrawLineEx(position, {position.x + direction.x * (cell.radius + STAB_REACH), position.y + direction.y * (cell.radius + STAB_REACH)}, 1.0f, RED);
+            }
+            DrawCircleV(position, cell.radius, cell.color);
+        }
+    }
+};
+
+
+/**
+ * Offsets of the complete frames of a replay file
+ * @param keyframes Set to the indices of the keyframes among them
+ * @return Offset just past the last complete frame
+ */
+size_t scan_replay(const unsigned char* data, const size_t size, std::vector<size_t> &frames, std::vector<size_t> &keyframes) {
+    size_t offset = sizeof(ReplayHeader);
+    while (size - offset >= sizeof(ReplayFrameHeader)) {
+        ReplayFrameHeader header;
+        std::memcpy(&header, data + offset, sizeof(ReplayFrameHeader));
+        if (header.type > REPLAY_DELTA or header.size > size - offset - sizeof(ReplayFrameHeader)) {
+            break;
+        }
+        if (header.type == REPLAY_KEYFRAME) {
+            keyframes.push_back(frames.size());
+        }
+        frames.push_back(offset);
+        offset += sizeof(ReplayFrameHeader) + header.size;
+    }
+    return offset;
+}
+
+/**
+ * @return Whether data starts with the header of a replay this build can read
+ */
+[[nodiscard]] bool is_replay(const unsigned char* data, const size_t size) {
+    if (size < sizeof(ReplayHeader)) {
+        return false;
+    }
+    ReplayHeader header;
+    std::memcpy(&header, data, sizeof(ReplayHeader));
+    return std::memcmp(header.magic, REPLAY_MAGIC, sizeof(REPLAY_MAGIC)) == 0 and header.version == REPLAY_VERSION and header.world_size == WORLD_SIZE;
+}
+
+
+/**
+ * Appends one frame per tick to a replay file, on the thread that ticks the simulation
+ * Capturing and encoding a frame touches every entity once and writes about four bytes per cell, which stays far
+ * below the cost of the tick itself.
+ */
+class ReplayRecorder {
+private:
+    std::filesystem::path path;
+    std::ofstream file;
+    ReplayState previous;
+    ReplayState current;
+    const ReplayState empty;
+    ReplayWriter writer;
+    bool has_previous = false;
+    unsigned int frames_since_keyframe = 0;
+    uint64_t byte_count = 0;
+
+    void log_error(const std::string &message) const {
+        Log::get_instance().log(Log::CRITICAL, ReplayRecorder::id(), std::format("Replay {}: {}", this->path.string(), message));
+    }
+
+public:
+    /**
+     * Start recording, continuing the file if it already is a replay
+     * A frame left unfinished by a crash is cut off first, the first frame of every session is a keyframe
+     * @return Whether the file can be recorded to, files that are not replays are left alone
+     */
+    bool open(const std::filesystem::path &_path) {
+        this->path = _path;
+        std::error_code error;
+        if (std::filesystem::exists(this->path, error)) {
+            size_t end;
+            {
+                MappedFile existing;
+                if (!existing.open(this->path) or !is_replay(existing.get_data(), existing.get_size())) {
+                    this->log_error("exists and is not a replay of this version and world size");
+                    return false;
+                }
+                std::vector<size_t> frames;
+                std::vector<size_t> keyframes;
+                end = scan_replay(existing.get_data(), existing.get_size(), frames, keyframes);
+                if (end != existing.get_size()) {
+                    this->log_error(std::format("cut off {} bytes of an unfinished frame", existing.get_size() - end));
+                }
+            }
+            std::filesystem::resize_file(this->path, end, error);
+            if (error) {
+                this->log_error(std::format("could not cut off the unfinished frame: {}", error.message()));
+                return false;
+            }
+            this->file.open(this->path, std::ios::out | std::ios::binary | std::ios::app);
+        }
+        else {
+            ReplayHeader header{};
+            std::memcpy(header.magic, REPLAY_MAGIC, sizeof(REPLAY_MAGIC));
+            header.version = REPLAY_VERSION;
+            header.world_size = WORLD_SIZE;
+            this->file.open(this->path, std::ios::out | std::ios::binary | std::ios::app);
+            this->file.write((const char*) &header, sizeof(ReplayHeader));
+        }
+        if (!this->file) {
+            this->log_error("could not be opened for writing");
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Append the frame of the tick that just finished
+     */
+    void record(const uint64_t tick, const std::vector<Cell*> &cells, const std::list<Egg*> &eggs, const std::list<Food*> &foods) {
+        if (!this->file.is_open()) {
+            return;
+        }
+        this->current.capture(tick, cells, eggs, foods);
+        this->writer.bytes.clear();
+        bool keyframe = !this->has_previous or this->frames_since_keyframe + 1 >= REPLAY_KEYFRAME_PERIOD;
+        if (!keyframe and !this->current.encode(this->previous, this->writer)) {
+            this->writer.bytes.clear(); // entities out of order, only while a progressive load is still restoring regions
+            keyframe = true;
+        }
+        if (keyframe) {
+            (void) this->current.encode(this->empty, this->writer);
+        }
+
+        ReplayFrameHeader header{};
+        header.tick = tick;
+        header.type = keyframe ? REPLAY_KEYFRAME : REPLAY_DELTA;
+        header.size = (uint32_t) this->writer.bytes.size();
+        header.checksum = save_checksum(this->writer.bytes.data(), this->writer.bytes.size());
+        this->file.write((const char*) &header, sizeof(ReplayFrameHeader));
+        this->file.write((const char*) this->writer.bytes.data(), (std::streamsize) this->writer.bytes.size());
+        if (keyframe) {
+            this->file.flush();
+        }
+        if (!this->file) {
+            this->log_error("write failed, recording stopped");
+            this->file.close();
+            return;
+        }
+        this->byte_count += sizeof(ReplayFrameHeader) + this->writer.bytes.size();
+        std::swap(this->previous, this->current);
+        this->has_previous = true;
+        this->frames_since_keyframe = keyframe ? 0 : this->frames_since_keyframe + 1;
+    }
+
+    /**
+     * Bytes recorded this session
+     */
+    [[nodiscard]] uint64_t get_byte_count() const {
+        return this->byte_count;
+    }
+
+    [[nodiscard]] static constexpr std::string id() {
+        return "Replay Recorder";
+    }
+};
+
+
+/**
+ * Plays a replay file back through RenderSubsystem
+ * advance() runs on the thread that drives rendering, input() on the render thread, the controls between them are
+ * atomics. The file is memory mapped and frames are checked against their checksums as they are played, playback
+ * ends at the first damaged frame.
+ */
+class ReplayPlayer {
+private:
+    std::filesystem::path path;
+    MappedFile file;
+    std::vector<size_t> frames; // Offsets of the frame headers
+    std::vector<size_t> keyframes; // Indices into frames
+    ReplayState state;
+    size_t frame = 0; // Shown by state
+    bool has_frame = false;
+
+    std::atomic<unsigned int> speed = 1;
+    std::atomic<int64_t> seek_offset = 0; // Frames to jump, taken by advance()
+
+    /**
+     * Apply a frame on top of the state, a keyframe replaces it
+     * @return Whether the frame was intact, playback is cut off before a damaged frame
+     */
+    bool apply(const size_t index) {
+        ReplayFrameHeader header;
+        std::memcpy(&header, this->file.get_data() + this->frames[index], sizeof(ReplayFrameHeader));
+        const unsigned char* payload = this->file.get_data() + this->frames[index] + sizeof(ReplayFrameHeader);
+        if (header.type == REPLAY_KEYFRAME) {
+            this->state.clear();
+        }
+        ReplayReader reader(payload, header.size);
+        if (save_checksum(payload, header.size) != header.checksum or !this->state.decode(reader)) {
+            Log::get_instance().log(Log::CRITICAL, ReplayPlayer::id(), std::format("Replay {}: frame {} is damaged, playback ends before it", this->path.string(), index));
+            this->frames.resize(index);
+            this->keyframes.erase(std::lower_bound(this->keyframes.begin(), this->keyframes.end(), index), this->keyframes.end());
+            return false;
+        }
+        this->state.tick = header.tick;
+        return true;
+    }
+
+    /**
+     * Show the last intact frame after apply() cut playback short
+     * @return false, the frame that was sought could not be reached
+     */
+    bool recover() {
+        if (!this->frames.empty()) {
+            this->seek(this->frames.size() - 1);
+        }
+        return false;
+    }
+
+public:
+    /**
+     * Map a replay and show its first frame
+     * @return Whether it is a replay with at least one intact frame
+     */
+    bool open(const std::filesystem::path &_path) {
+        this->path = _path;
+        if (!this->file.open(this->path) or !is_replay(this->file.get_data(), this->file.get_size())) {
+            return false;
+        }
+        scan_replay(this->file.get_data(), this->file.get_size(), this->frames, this->keyframes);
+        return !this->keyframes.empty() and this->keyframes.front() == 0 and this->seek(0);
+    }
+
+    /**
+     * Show a frame, decoding from the keyframe before it unless it is ahead of the frame shown
+     * @return Whether the frame could be reached, otherwise the last intact frame before it is shown
+     */
+    bool seek(const size_t target) {
+        if (target >= this->frames.size()) {
+            return false;
+        }
+        const size_t keyframe = *(std::upper_bound(this->keyframes.begin(), this->keyframes.end(), target) - 1);
+        if (!this->has_frame or keyframe > this->frame or target < this->frame) {
+            this->has_frame = false;
+            if (!this->apply(keyframe)) {
+                return this->recover();
+            }
+            this->frame = keyframe;
+            this->has_frame = true;
+        }
+        while (this->frame < target) {
+            if (!this->apply(this->frame + 1)) {
+                this->has_frame = false; // partly applied
+                return this->recover();
+            }
+            this->frame++;
+        }
+        return true;
+    }
+
+    /**
+     * Move on by the chosen speed, or to where input() sought
+     * @param playing Whether to move on by itself, seeking works while paused
+     */
+    void advance(const bool playing) {
+        const int64_t offset = this->seek_offset.exchange(0);
+        if (offset != 0) {
+            const int64_t last = (int64_t) this->frames.size() - 1;
+            this->seek((size_t) std::clamp((int64_t) this->frame + offset, (int64_t) 0, last));
+            return;
+        }
+        if (!playing) {
+            return;
+        }
+        const size_t target = std::min(this->frame + this->speed.load(), this->frames.size() - 1);
+        this->seek(target);
+    }
+
+    /**
+     * Up and down double and halve the speed, left and right seek by a keyframe period, ten with shift
+     */
+    void input() {
+        if (IsKeyPressed(KEY_UP)) {
+            this->speed.store(std::min(this->speed.load() * 2, REPLAY_MAX_SPEED));
+        }
+        if (IsKeyPressed(KEY_DOWN)) {
+            this->speed.store(std::max(this->speed.load() / 2, 1u));
+        }
+        const int64_t step = IsKeyDown(KEY_LEFT_SHIFT) ? REPLAY_KEYFRAME_PERIOD * 10 : REPLAY_KEYFRAME_PERIOD;
+        if (IsKeyPressed(KEY_RIGHT)) {
+            this->seek_offset += step;
+        }
+        if (IsKeyPressed(KEY_LEFT)) {
+            this->seek_offset -= step;
+        }
+    }
+
+    template<typename ShouldRender> void draw(ShouldRender should_render) const {
+        this->state.draw(should_render);
+    }
+
+    void draw_info() const {
+        DrawTextEx(GetFontDefault(), TextFormat("Replay tick %llu  frame %zu/%zu  speed %ux", (unsigned long long) this->state.tick, this->frame + 1, this->frames.size(), this->speed.load()), {10, 10}, FONT_SIZE, 1, WHITE);
+    }
+
+    [[nodiscard]] const ReplayState& get_state() const {
+        return this->state;
+    }
+
+    [[nodiscard]] size_t get_frame() const {
+        return this->frame;
+    }
+
+    [[nodiscard]] size_t get_frame_count() const {
+        return this->frames.size();
+    }
+
+    [[nodiscard]] static constexpr std::string id() {
+        return "Replay Player";
+    }
+};
@@ -0,0 +1,228 @@
+#pragma once
+
+
+#include <deque>
+#include <memory>
+#include <thread>
+#include <algorithm>
+
+
+#include "Snapshot.hpp"
+#include "Simulation.hpp"
+
+
+constexpr bool REWIND = true; // Keep recent snapshots in memory to go back to, see RewindBuffer
+constexpr unsigned long REWIND_PERIOD = 100; // Ticks between rewind points
+constexpr size_t REWIND_MEMORY_BUDGET = 1024ul * 1024ul * 1024ul; // Bytes, the oldest points are dropped beyond it
+constexpr unsigned int REWIND_LONG_STEPS = 30; // Points skipped by a long rewind
+
+
+/**
+ * One snapshot of the ring with what it is estimated to hold on to
+ */
+class RewindPoint {
+public:
+    std::shared_ptr<Snapshot> snapshot;
+    size_t byte_size;
+};
+
+
+/**
+ * Bounded ring of recent snapshots to rewind the simulation to
+ * Snapshots share the genomes of cells with each other and with the simulation, so a point only costs its records
+ * and the genomes of the entities created since the point before it. Once the budget is used up the oldest point is
+ * dropped and its buffers are reused by the next capture, so steady state capturing allocates nothing. Until then the
+ * buffers of the next point are allocated and touched on a thread of their own after each capture, so page faults on
+ * a fresh snapshot don't land on the tick that takes it.
+ */
+class RewindBuffer {
+private:
+    std::deque<RewindPoint> points; // Oldest first
+    std::shared_ptr<Snapshot> spare; // Dropped point or prepared snapshot whose buffers the next capture reuses
+    std::shared_ptr<Snapshot> prepared; // Set by preparing_thread
+    std::thread preparing_thread;
+    std::shared_ptr<Snapshot> pending; // Begun but still waiting for its cells, see begin_capture()
+    size_t byte_size = 0;
+    size_t memory_budget;
+    unsigned long period;
+    unsigned long last_capture_tick = 0;
+    bool has_captured = false;
+
+    /**
+     * Memory held by a snapshot beyond what the point before it already holds
+     * @param previous Point before it, nullptr to count all of its genomes
+     */
+    [[nodiscard]] static size_t estimate_byte_size(const Snapshot &snapshot, const Snapshot* previous) {
+        size_t bytes = sizeof(Snapshot) + snapshot.random_state.capacity()
+                + snapshot.cells.capacity() * sizeof(CellRecord) + snapshot.eggs.capacity() * sizeof(EggRecord)
+                + (snapshot.plants.capacity() + snapshot.meats.capacity()) * sizeof(FoodRecord)
+                + snapshot.nutrients.capacity() * sizeof(std::pair<int, float>);
+        // anything with a higher id than existed at the previous point came with a new genome
+        const unsigned long first_new_id = previous == nullptr ? 0 : previous->id_count;
+        for (const CellRecord &record: snapshot.cells) {
+            bytes += record.id > first_new_id ? sizeof(DNA_t) : 0;
+        }
+        for (const EggRecord &record: snapshot.eggs) {
+            bytes += record.id > first_new_id ? sizeof(DNA_t) : 0;
+        }
+        return bytes;
+    }
+
+    /**
+     * Allocate the cell records of the next point in the background, unless a dropped point will be reused
+     */
+    void prepare_spare(const size_t cell_count) {
+        if (this->spare != nullptr or this->preparing_thread.joinable()) {
+            return;
+        }
+        this->preparing_thread = std::thread([this, cell_count]() {
+            std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>();
+            snapshot->cells.resize(cell_count + cell_count / 8); // room for growth until the next point
+            this->prepared = std::move(snapshot);
+        });
+    }
+
+    [[nodiscard]] std::shared_ptr<Snapshot> take_spare() {
+        if (this->preparing_thread.joinable()) {
+            this->preparing_thread.join();
+            if (this->spare == nullptr) {
+                this->spare = std::move(this->prepared);
+            }
+            this->prepared.reset();
+        }
+        std::shared_ptr<Snapshot> snapshot = this->spare != nullptr ? std::move(this->spare) : std::make_shared<Snapshot>();
+        this->spare.reset();
+        return snapshot;
+    }
+
+    void add_point(std::shared_ptr<Snapshot> snapshot) {
+        const size_t bytes = RewindBuffer::estimate_byte_size(*snapshot, this->points.empty() ? nullptr : this->points.back().snapshot.get());
+        this->points.push_back({std::move(snapshot), bytes});
+        this->byte_size += bytes;
+        this->last_capture_tick = this->points.back().snapshot->tick_count;
+        this->has_captured = true;
+        while (this->byte_size > this->memory_budget and this->points.size() > 1) {
+            this->drop_oldest();
+        }
+        this->prepare_spare(this->points.back().snapshot->cells.size());
+    }
+
+    void drop_oldest() {
+        this->byte_size -= this->points.front().byte_size;
+        if (this->points.front().snapshot.use_count() == 1) {
+            this->spare = std::move(this->points.front().snapshot);
+        }
+        this->points.pop_front();
+        if (!this->points.empty()) {
+            // the new oldest point now holds all of its genomes on its own
+            RewindPoint &oldest = this->points.front();
+            this->byte_size -= oldest.byte_size;
+            oldest.byte_size = RewindBuffer::estimate_byte_size(*oldest.snapshot, nullptr);
+            this->byte_size += oldest.byte_size;
+        }
+    }
+
+public:
+    explicit RewindBuffer(const size_t memory_budget = REWIND_MEMORY_BUDGET, const unsigned long period = REWIND_PERIOD): memory_budget(memory_budget), period(period) {
+
+    }
+
+    RewindBuffer(const RewindBuffer&) = delete;
+    RewindBuffer& operator=(const RewindBuffer&) = delete;
+
+    ~RewindBuffer() {
+        if (this->preparing_thread.joinable()) {
+            this->preparing_thread.join();
+        }
+    }
+
+    /**
+     * Whether the simulation has advanced far enough since the last point to take a new one
+     */
+    [[nodiscard]] bool is_due(const unsigned long tick_count) const {
+        return !this->has_captured or tick_count >= this->last_capture_tick + this->period;
+    }
+
+    /**
+     * Take a new point, only call between ticks
+     * Only reads the simulation, so it can run while the world is being drawn
+     */
+    void capture(Simulation &simulation) {
+        std::shared_ptr<Snapshot> snapshot = this->take_spare();
+        simulation.capture(*snapshot);
+        this->add_point(std::move(snapshot));
+    }
+
+    /**
+     * Start a new point whose cells the processing threads copy in the interaction pass of the next tick, so the
+     * manager thread only copies the eggs and food (see Simulation::begin_capture())
+     * Only call between ticks, the point is added by finish_capture()
+     */
+    void begin_capture(Simulation &simulation) {
+        this->pending = this->take_spare();
+        simulation.begin_capture(*this->pending);
+        this->last_capture_tick = simulation.get_tick_count();
+        this->has_captured = true;
+    }
+
+    /**
+     * Add the point of begin_capture(), does nothing without one
+     * Only call between ticks or between the interaction and tick passes
+     */
+    void finish_capture(Simulation &simulation) {
+        if (this->pending == nullptr) {
+            return;
+        }
+        simulation.finish_capture();
+        this->add_point(std::move(this->pending));
+        this->pending.reset();
+    }
+
+    /**
+     * Pick the point to rewind to and forget every point after it, the simulation branches off from there
+     * @param steps How many points to go back, 1 for the latest point before the current tick
+     * @param tick_count Current tick, a point taken at it doesn't count as a step
+     * @return The point, nullptr if there is none before the current tick
+     */
+    [[nodiscard]] std::shared_ptr<const Snapshot> take(const unsigned int steps, const unsigned long tick_count) {
+        size_t candidates = this->points.size();
+        while (candidates > 0 and this->points[candidates - 1].snapshot->tick_count >= tick_count) {
+            candidates--;
+        }
+        if (candidates == 0 or steps == 0) {
+            return nullptr;
+        }
+        const size_t index = candidates - std::min((size_t) steps, candidates);
+        while (this->points.size() > index + 1) {
+            this->byte_size -= this->points.back().byte_size;
+            if (this->points.back().snapshot.use_count() == 1) {
+                this->spare = std::move(this->points.back().snapshot);
+            }
+            this->points.pop_back();
+        }
+        this->last_capture_tick = this->points.back().snapshot->tick_count;
+        return this->points.back().snapshot;
+    }
+
+    /**
+     * @return The newest point, nullptr before the first capture
+     */
+    [[nodiscard]] std::shared_ptr<const Snapshot> get_latest() const {
+        return this->points.empty() ? nullptr : this->points.back().snapshot;
+    }
+
+    [[nodiscard]] size_t get_point_count() const {
+        return this->points.size();
+    }
+
+    [[nodiscard]] size_t get_byte_size() const {
+        return this->byte_size;
+    }
+
+    /**
+     * Ticks covered from the oldest point to the newest
+     */
+    [[nodiscard]] unsigned long get_span() const {
+        return this->points.empty() ? 0 : this->points.back().snapshot->tick_count - this->points.front().snapshot->tick_count;
+    }
+};
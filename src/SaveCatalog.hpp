@@ -0,0 +1,151 @@
+#pragma once
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <chrono>
+#include <algorithm>
+
+
+#include "SaveManifest.hpp"
+#include "Snapshot.hpp"
+#include "Checkpoint.hpp"
+
+
+/**
+ * One save directory as listed by SaveCatalog
+ * Saves without an intact manifest get their format, size and time from the directory, the rest of the manifest is 0
+ */
+class SaveCatalogEntry {
+public:
+    std::string name;
+    std::filesystem::path path;
+    bool has_manifest;
+    SaveManifest manifest;
+
+    [[nodiscard]] SaveFormat get_format() const {
+        return (SaveFormat) this->manifest.format;
+    }
+};
+
+/**
+ * Which saves to list, every bound is inclusive
+ * Bounds on ticks and counts are only known from a manifest, saves without one never pass them
+ */
+class SaveFilter {
+public:
+    std::string name; // Substring of the save's directory name
+    bool any_format = true;
+    SaveFormat format = TEXT_SAVE_FORMAT;
+    uint64_t min_ticks = 0;
+    uint64_t max_ticks = UINT64_MAX;
+    uint64_t min_cells = 0;
+    uint64_t max_cells = UINT64_MAX;
+
+    [[nodiscard]] bool matches(const SaveCatalogEntry &entry) const {
+        if (!this->name.empty() and entry.name.find(this->name) == std::string::npos) {
+            return false;
+        }
+        if (!this->any_format and entry.get_format() != this->format) {
+            return false;
+        }
+        const bool bounded = this->min_ticks != 0 or this->max_ticks != UINT64_MAX or this->min_cells != 0 or this->max_cells != UINT64_MAX;
+        if (!entry.has_manifest) {
+            return !bounded;
+        }
+        return entry.manifest.tick_count >= this->min_ticks and entry.manifest.tick_count <= this->max_ticks
+                and entry.manifest.cell_count >= this->min_cells and entry.manifest.cell_count <= this->max_cells;
+    }
+};
+
+
+/**
+ * Lists the saves of a directory from their manifests, without opening the saves themselves
+ */
+class SaveCatalog {
+private:
+    /**
+     * Stand in for the manifest of a save that has none
+     */
+    [[nodiscard]] static SaveManifest describe(const std::filesystem::path &directory) {
+        SaveManifest manifest{};
+        std::error_code error;
+        if (!list_checkpoints(directory).empty()) {
+            manifest.format = CHAIN_SAVE_FORMAT;
+        }
+        else if (std::filesystem::exists(directory / BINARY_SAVE_FILE_NAME, error)) {
+            manifest.format = BINARY_SAVE_FORMAT;
+        }
+        else {
+            manifest.format = TEXT_SAVE_FORMAT;
+        }
+        for (const std::filesystem::directory_entry &entry: std::filesystem::directory_iterator(directory, error)) {
+            if (entry.is_regular_file(error)) {
+                manifest.byte_size += entry.file_size(error);
+            }
+        }
+        const std::filesystem::file_time_type modified = std::filesystem::last_write_time(directory, error);
+        if (!error) {
+            const auto time = std::chrono::file_clock::to_sys(modified);
+            manifest.creation_time = std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count();
+        }
+        return manifest;
+    }
+
+public:
+    /**
+     * Every save directly inside a directory, oldest first
+     * Hidden directories, which are unfinished saves, are skipped
+     */
+    [[nodiscard]] static std::vector<SaveCatalogEntry> scan(const std::filesystem::path &root, const SaveFilter &filter = {}) {
+        std::vector<SaveCatalogEntry> entries;
+        std::error_code error;
+        for (const std::filesystem::directory_entry &directory: std::filesystem::directory_iterator(root, error)) {
+            const std::string name = directory.path().filename().string();
+            if (!directory.is_directory(error) or name.starts_with(".")) {
+                continue;
+            }
+            SaveCatalogEntry entry;
+            entry.name = name;
+            entry.path = directory.path();
+            entry.has_manifest = read_save_manifest(directory.path(), entry.manifest);
+            if (!entry.has_manifest) {
+                entry.manifest = SaveCatalog::describe(directory.path());
+            }
+            if (filter.matches(entry)) {
+                entries.push_back(std::move(entry));
+            }
+        }
+        std::sort(entries.begin(), entries.end(), [](const SaveCatalogEntry &a, const SaveCatalogEntry &b) {
+            return a.manifest.creation_time != b.manifest.creation_time ? a.manifest.creation_time < b.manifest.creation_time : a.name < b.name;
+        });
+        return entries;
+    }
+
+    /**
+     * Find the save to load
+     * @param name "latest" for the newest save in root, a save directory's name in root, or a path to a save directory
+     * @param path Set to the save's directory when found
+     * @return Whether a save was found
+     */
+    [[nodiscard]] static bool resolve(const std::filesystem::path &root, const std::string &name, std::filesystem::path &path) {
+        std::error_code error;
+        if (name == "latest") {
+            const std::vector<SaveCatalogEntry> entries = SaveCatalog::scan(root);
+            if (entries.empty()) {
+                return false;
+            }
+            path = entries.back().path;
+            return true;
+        }
+        for (const std::filesystem::path &candidate: {root / name, std::filesystem::path(name)}) {
+            if (std::filesystem::is_directory(candidate, error)) {
+                path = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+};
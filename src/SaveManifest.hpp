@@ -0,0 +1,107 @@
+#pragma once
+
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <type_traits>
+
+
+#include "BinarySave.hpp"
+
+
+constexpr uint32_t SAVE_MANIFEST_VERSION = 1; // Bump whenever SaveManifest's layout changes
+constexpr char SAVE_MANIFEST_MAGIC[8] = {'M', 'E', 'A', 'T', 'M', 'E', 'T', 'A'};
+constexpr std::string SAVE_MANIFEST_FILE_NAME = "manifest.bin";
+constexpr unsigned int MANIFEST_TRAIT_COUNT = 6;
+constexpr const char* MANIFEST_TRAIT_NAMES[MANIFEST_TRAIT_COUNT] = {"radius", "diet", "speed", "vision", "egg transfer", "metabolism"};
+
+
+/*
+ * Every save directory gets a small manifest next to its save files, so that saves can be listed and filtered
+ * without reading the saves themselves, see SaveCatalog.hpp
+ * The manifest is written into the save before it is renamed into place, checkpoint chains replace theirs after
+ * every checkpoint. Saves from before manifests existed have none and are still listed, just without metadata.
+ */
+
+
+enum SaveFormat: uint32_t {
+    TEXT_SAVE_FORMAT, // One file per entity type, see Snapshot::write_text()
+    BINARY_SAVE_FORMAT, // BINARY_SAVE_FILE_NAME, see BinarySave.hpp
+    CHAIN_SAVE_FORMAT // Checkpoint chain, see Checkpoint.hpp
+};
+
+[[nodiscard]] constexpr const char* save_format_name(const SaveFormat format) {
+    switch (format) {
+        case TEXT_SAVE_FORMAT:
+            return "text";
+        case BINARY_SAVE_FORMAT:
+            return "binary";
+        case CHAIN_SAVE_FORMAT:
+            return "chain";
+    }
+    return "unknown";
+}
+
+/**
+ * Spread of one genome trait over the living cells
+ */
+class TraitSummary {
+public:
+    float mean;
+    float minimum;
+    float maximum;
+};
+
+class SaveManifest {
+public:
+    char magic[8];
+    uint32_t version;
+    uint32_t format;
+    uint32_t format_version; // BINARY_SAVE_VERSION of binary saves and chains, 0 for text saves
+    uint32_t padding;
+    int64_t creation_time; // Seconds since the unix epoch when the snapshot was taken
+    uint64_t tick_count;
+    uint64_t cell_count;
+    uint64_t egg_count;
+    uint64_t plant_count;
+    uint64_t meat_count;
+    uint64_t nutrient_count;
+    uint64_t byte_size; // Of the save files, without the manifest
+    uint64_t checkpoint_count; // 0 unless it is a chain
+    TraitSummary traits[MANIFEST_TRAIT_COUNT]; // In the order of MANIFEST_TRAIT_NAMES
+    uint64_t checksum; // Of everything before it
+
+    [[nodiscard]] uint64_t compute_checksum() const {
+        return save_checksum(this, offsetof(SaveManifest, checksum));
+    }
+
+    /**
+     * Fill in the magic, version and checksum, call last before writing
+     */
+    void seal() {
+        std::memcpy(this->magic, SAVE_MANIFEST_MAGIC, sizeof(SAVE_MANIFEST_MAGIC));
+        this->version = SAVE_MANIFEST_VERSION;
+        this->padding = 0;
+        this->checksum = this->compute_checksum();
+    }
+};
+
+static_assert(std::is_trivially_copyable_v<SaveManifest> and sizeof(SaveManifest) % 8 == 0);
+
+
+/**
+ * Read the manifest of a save directory
+ * @return Whether there was an intact manifest of this version, a missing or damaged one is not an error
+ */
+[[nodiscard]] bool read_save_manifest(const std::filesystem::path &directory, SaveManifest &manifest) {
+    std::ifstream file(directory / SAVE_MANIFEST_FILE_NAME, std::ios::in | std::ios::binary);
+    if (!file.is_open() or !file.read((char*) &manifest, sizeof(SaveManifest)) or file.peek() != std::char_traits<char>::eof()) {
+        return false;
+    }
+    return std::memcmp(manifest.magic, SAVE_MANIFEST_MAGIC, sizeof(SAVE_MANIFEST_MAGIC)) == 0 and manifest.version == SAVE_MANIFEST_VERSION
+            and manifest.checksum == manifest.compute_checksum();
+}
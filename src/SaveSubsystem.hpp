@@ -0,0 +1,196 @@
+#pragma once
+
+
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <semaphore>
+#include <filesystem>
+
+
+#include "Subsystem.hpp"
+#include "Snapshot.hpp"
+#include "Checkpoint.hpp"
+#include "Simulation.hpp"
+
+
+/**
+ * Timings of the saves done so far
+ */
+class SaveMetrics {
+public:
+    unsigned long completed_saves = 0;
+    unsigned long failed_saves = 0;
+    unsigned long replaced_saves = 0; // Requests dropped because a newer one came in before they were started
+    float last_capture_seconds = 0; // Time the simulation was stalled taking the snapshot
+    float last_write_seconds = 0; // Time the save thread spent writing and syncing
+    size_t last_record_count = 0;
+    uint64_t last_size = 0; // Bytes written by the last checkpoint, 0 for full saves
+    bool last_was_keyframe = false;
+};
+
+
+/**
+ * Writes snapshots to disk on its own thread so the simulation only stalls for Simulation::capture_snapshot()
+ * Only the newest request is kept, if saves are requested faster than they can be written the older pending one is dropped
+ * With CHECKPOINT_CHAINS every save of a run is appended to one checkpoint chain, see Checkpoint.hpp
+ */
+class SaveSubsystem: public Subsystem {
+private:
+    ThreadSafe<std::shared_ptr<Snapshot>> pending_snapshot;
+    std::counting_semaphore<> save_notifier{0};
+
+    std::atomic<bool> saving = false;
+    std::atomic<size_t> records_written = 0;
+    std::atomic<size_t> records_total = 0;
+    ThreadSafe<SaveMetrics> metrics;
+    std::unique_ptr<CheckpointWriter> checkpoints; // Only used by this subsystem's thread
+
+    void init() override {
+        std::filesystem::create_directory(SAVES_PATH);
+    }
+
+    void update() override {
+        this->save_notifier.acquire();
+        this->write_pending();
+    }
+
+    void write_pending() {
+        this->pending_snapshot.manual_lock();
+        const std::shared_ptr<Snapshot> snapshot = this->pending_snapshot.unsafe_get_data();
+        this->pending_snapshot.unsafe_set_data(nullptr);
+        this->pending_snapshot.manual_unlock();
+        if (snapshot == nullptr) {
+            return;
+        }
+
+        if constexpr (CHECKPOINT_CHAINS) {
+            if (this->checkpoints == nullptr) {
+                this->checkpoints = std::make_unique<CheckpointWriter>(Simulation::new_chain_path());
+            }
+        }
+        const std::string save_path = CHECKPOINT_CHAINS ? this->checkpoints->get_directory().string() : Simulation::new_save_path();
+        this->records_written.store(0);
+        this->records_total.store(snapshot->get_record_count());
+        this->saving.store(true);
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bool saved;
+        if constexpr (CHECKPOINT_CHAINS) {
+            saved = this->checkpoints->write(*snapshot, this->records_written);
+        }
+        else {
+            saved = snapshot->write_atomically(save_path, this->records_written);
+        }
+        const float write_seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+        this->saving.store(false);
+
+        this->metrics.manual_lock();
+        SaveMetrics _metrics = this->metrics.unsafe_get_data();
+        if (saved) {
+            _metrics.completed_saves++;
+            _metrics.last_capture_seconds = snapshot->capture_seconds;
+            _metrics.last_write_seconds = write_seconds;
+            _metrics.last_record_count = snapshot->get_record_count();
+            if constexpr (CHECKPOINT_CHAINS) {
+                _metrics.last_size = this->checkpoints->get_last_size();
+                _metrics.last_was_keyframe = this->checkpoints->was_last_keyframe();
+            }
+        }
+        else {
+            _metrics.failed_saves++;
+        }
+        this->metrics.unsafe_set_data(_metrics);
+        this->metrics.manual_unlock();
+
+        if (!saved) {
+            this->log(Log::CRITICAL, std::format("Failed to write save {}, previous saves are untouched", save_path));
+            return;
+        }
+        if constexpr (CHECKPOINT_CHAINS) {
+            this->log(Log::REGULAR, std::format("Wrote {} checkpoint of {} records ({} bytes) to {} in {} seconds, capture stalled the simulation for {} seconds", _metrics.last_was_keyframe ? "keyframe" : "delta", _metrics.last_record_count, _metrics.last_size, save_path, write_seconds, _metrics.last_capture_seconds));
+            return;
+        }
+        this->log(Log::REGULAR, std::format("Saved {} records to {} in {} seconds, capture stalled the simulation for {} seconds", _metrics.last_record_count, save_path, write_seconds, _metrics.last_capture_seconds));
+    }
+
+    void on_shutdown() override {
+        this->write_pending(); // don't drop a save that was requested right before shutting down
+    }
+
+    void on_panic() override {
+
+    }
+
+    void signal_shutdown() override {
+        this->should_shutdown.store(true);
+
+        //release all semaphores
+        this->save_notifier.release();
+    }
+
+    void signal_panic() override {
+        this->should_panic.store(true);
+
+        //release all semaphores
+        this->save_notifier.release();
+    }
+
+    [[nodiscard]] constexpr float warning_loop_second_threshold() const override {
+        return -1; // Disabled
+    }
+
+    [[nodiscard]] constexpr float critical_loop_second_threshold() const override {
+        return -1; // Disabled
+    }
+
+public:
+    SaveSubsystem() = default;
+
+    ~SaveSubsystem() = default;
+
+    /**
+     * Queue a snapshot to be written
+     * @param snapshot Snapshot from Simulation::capture_snapshot()
+     */
+    void request_save(std::shared_ptr<Snapshot> snapshot) {
+        this->pending_snapshot.manual_lock();
+        const bool replaced = this->pending_snapshot.unsafe_get_data() != nullptr;
+        this->pending_snapshot.unsafe_set_data(std::move(snapshot));
+        this->pending_snapshot.manual_unlock();
+        if (replaced) {
+            this->metrics.manual_lock();
+            SaveMetrics _metrics = this->metrics.unsafe_get_data();
+            _metrics.replaced_saves++;
+            this->metrics.unsafe_set_data(_metrics);
+            this->metrics.manual_unlock();
+            return;
+        }
+        this->save_notifier.release();
+    }
+
+    [[nodiscard]] bool is_saving() const {
+        return this->saving.load();
+    }
+
+    /**
+     * @return Fraction of the current save's records written, 1 when no save is running
+     */
+    [[nodiscard]] float get_progress() const {
+        if (!this->saving.load()) {
+            return 1.0f;
+        }
+        const size_t total = this->records_total.load();
+        if (total == 0) {
+            return 1.0f;
+        }
+        return (float) this->records_written.load(std::memory_order_relaxed) / (float) total;
+    }
+
+    [[nodiscard]] SaveMetrics get_metrics() {
+        return this->metrics.get_data();
+    }
+
+    [[nodiscard]] constexpr std::string id() const override {
+        return "Save Subsystem";
+    }
+};
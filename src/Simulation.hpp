@@ -5,11 +5,26 @@
 #include <filesystem>
 #include <vector>
 #include <list>
+#include <memory>
+#include <atomic>
 
 
 #include "Food.hpp"
 #include "Egg.hpp"
 #include "Cell.hpp"
+#include "Region.hpp"
+#include "NutrientField.hpp"
+#include "Coalescing.hpp"
+#include "LevelOfDetail.hpp"
+#include "Snapshot.hpp"
+#include "Checkpoint.hpp"
+#include "TextSave.hpp"
+#include "ProgressiveLoader.hpp"
+#include "RandomState.hpp"
+#include "Lineage.hpp"
+#include "TraitStatistics.hpp"
+#include "Colony.hpp"
+#include "Logging.hpp"
 
 
 constexpr std::string SAVES_PATH = "saves";
@@ -19,18 +34,91 @@ private:
     std::vector<Cell*> cells;
     std::list<Egg*> eggs;
     std::list<Food*> foods;
+    RegionGrid regions;
+    NutrientField nutrients;
+    FoodCoalescer coalescer;
+    TraitStatistics traits; // Of the cells, updated wherever cells are added or removed
+    ColonyTracker colonies; // Buckets the cells, updated wherever cells are added, removed or moved
+    unsigned long tick_count = 0;
+    Vector2 focus = {0.0f, 0.0f}; // Camera target, bodies far from it run at reduced detail
+    std::unique_ptr<ProgressiveLoader> loader; // While a save is still being loaded, see PROGRESSIVE_LOADING
+    std::vector<bool> loaded_tiles; // Per region, while loading
+    int merged_tile_count = 0;
+    std::chrono::steady_clock::time_point loading_start;
+    LineageSubsystem* lineage = nullptr; // Births and deaths are logged to it when set
+    bool sampling = false; // Whether the interaction pass of this tick gathers telemetry, see TelemetrySample
+    Snapshot* capturing = nullptr; // Waiting for its cell records, see begin_capture()
+    bool capture_handed_over = false; // Whether the interaction pass of this tick copies the cells of capturing
+
+    /**
+     * A save taken while a coalescing pass was running holds the food the pass was started on, start it again
+     * Only call once the entities are restored and in id order
+     */
+    void resume_coalescing() {
+        if (this->coalescer.ticks_since_pass >= FOOD_COALESCE_PERIOD) {
+            this->coalescer.start_pass(this->foods);
+        }
+    }
 
-public:
-    Simulation() {
+    /**
+     * Everything capture() copies apart from the cells
+     */
+    void capture_all_but_cells(Snapshot &snapshot) {
+        snapshot.eggs.clear();
+        snapshot.plants.clear();
+        snapshot.meats.clear();
+        snapshot.nutrients.clear();
+        snapshot.eggs.reserve(this->eggs.size());
+        for (const Egg* egg: this->eggs) {
+            snapshot.eggs.push_back(egg->get_record());
+        }
+        for (const Food* food: this->foods) {
+            if (food->get_food_type() == PLANT) {
+                snapshot.plants.push_back(food->get_record());
+            } else {
+                snapshot.meats.push_back(food->get_record());
+            }
+        }
+        snapshot.has_nutrients = NUTRIENT_FIELD_PLANTS;
+        if constexpr (NUTRIENT_FIELD_PLANTS) {
+            for (int index = 0; index < NutrientField::size(); index++) {
+                const float _calories = this->nutrients.get_calories(index);
+                if (_calories != 0.0f) {
+                    snapshot.nutrients.emplace_back(index, _calories);
+                }
+            }
+        }
+        snapshot.tick_count = this->tick_count;
+        snapshot.has_state = true;
+        snapshot.id_count = Body::id_count;
+        snapshot.ticks_since_coalesce = this->coalescer.ticks_since_pass;
+        snapshot.coalesce_residual = this->coalescer.get_residual_calories();
+        snapshot.coalesce_merge_count = this->coalescer.get_merge_count();
+        snapshot.random_state = save_random_state();
+        snapshot.creation_time = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
 
+    /**
+     * Add loaded food in file order, plants become nutrients when the nutrient field replaces them
+     */
+    void add_loaded_food(Food* food) {
+        if constexpr (NUTRIENT_FIELD_PLANTS) {
+            if (food->get_food_type() == PLANT) {
+                this->deposit_plant(food->take_calories(), food->get_position());
+                delete food;
+                return;
+            }
+        }
+        this->add_food(food);
     }
 
-    explicit Simulation(const std::string& save_path) {
+    /**
+     * Load the entities of a legacy text save value by value through iostreams
+     */
+    void import_text_entities(const std::string& save_path) {
         std::ifstream cell_file;
         cell_file.open(save_path + "/cells", std::ios::in);
-        int i = 0;
         while (true) {
-            i++;
             Cell* cell = new Cell(cell_file);
             if (cell_file.eof()) {
                 delete cell;
@@ -62,7 +150,7 @@ public:
                 delete food;
                 break;
             }
-            this->foods.push_back(food);
+            this->add_loaded_food(food);
         }
         plant_file.close();
 
@@ -73,12 +161,186 @@ public:
                 delete food;
                 break;
             }
-            this->foods.push_back(food);
+            this->add_loaded_food(food);
         }
         meat_file.close();
     }
 
+    /**
+     * Load a save in the legacy text format, one file per entity type
+     * See TextSave.hpp for the parallel parser, import_text_entities() is the iostream one it must match
+     */
+    void import_text_save(const std::string& save_path) {
+        if constexpr (PARALLEL_TEXT_LOADING) {
+            TextSave save;
+            save.load(save_path);
+            this->cells.insert(this->cells.end(), save.cells.begin(), save.cells.end());
+            this->eggs.insert(this->eggs.end(), save.eggs.begin(), save.eggs.end());
+            for (Food* food: save.plants) {
+                this->add_loaded_food(food);
+            }
+            for (Food* food: save.meats) {
+                this->add_loaded_food(food);
+            }
+        }
+        else {
+            this->import_text_entities(save_path);
+        }
+        this->traits.rebuild(this->cells);
+        if constexpr (COLONY_TRACKING) {
+            this->colonies.rebuild(this->cells);
+        }
+
+        std::ifstream nutrient_file;
+        nutrient_file.open(save_path + "/nutrients", std::ios::in);
+        if (nutrient_file.is_open()) {
+            if constexpr (NUTRIENT_FIELD_PLANTS) {
+                nutrient_file >> &this->nutrients;
+            }
+            else {
+                // saved with the nutrient field, turn every patch back into a plant, patches are written in index order
+                int index;
+                float calories;
+                while (nutrient_file >> index >> calories) {
+                    if (index >= 0 and index < NutrientField::size() and calories > 0.0f) {
+                        this->deposit_plant(calories, NutrientField::position_of(index));
+                    }
+                }
+            }
+            nutrient_file.close();
+        }
+
+        Snapshot state;
+        if (Snapshot::read_text_state(save_path, state)) {
+            this->restore_state(state);
+        }
+        this->order_loaded_entities();
+        this->resume_coalescing();
+    }
+
+    /**
+     * Continue where the run that took a snapshot left off, with its tick, ids, coalescing and random numbers
+     * Does nothing for snapshots without a state
+     */
+    void restore_state(const Snapshot &snapshot) {
+        if (!snapshot.has_state) {
+            return;
+        }
+        this->tick_count = snapshot.tick_count;
+        Body::id_count = snapshot.id_count;
+        this->coalescer.ticks_since_pass = snapshot.ticks_since_coalesce;
+        this->coalescer.restore_totals(snapshot.coalesce_residual, snapshot.coalesce_merge_count);
+        if (!load_random_state(snapshot.random_state)) {
+            Log::get_instance().log(Log::CRITICAL, "Simulation", "Saved random state is damaged, continuing with fresh random numbers");
+        }
+    }
+
+    /**
+     * Put loaded entities in id order, which is the order a running simulation keeps them in since new entities get
+     * the highest id and removal keeps the order, so a loaded save is iterated exactly like the run that wrote it
+     * Also makes sure new ids don't collide with loaded ones
+     */
+    void order_loaded_entities() {
+        const auto by_id = [](const Body* body, const Body* other_body) {
+            return body->get_id() < other_body->get_id();
+        };
+        std::sort(this->cells.begin(), this->cells.end(), by_id);
+        this->eggs.sort(by_id);
+        this->foods.sort(by_id);
+        if constexpr (TOROIDAL_WORLD) {
+            this->regions.reindex_foods(this->foods);
+        }
+        for (const Cell* cell: this->cells) {
+            Body::id_count = std::max(Body::id_count, cell->get_id());
+        }
+        for (const Egg* egg: this->eggs) {
+            Body::id_count = std::max(Body::id_count, egg->get_id());
+        }
+        for (const Food* food: this->foods) {
+            Body::id_count = std::max(Body::id_count, food->get_id());
+        }
+    }
+
+    /**
+     * Construct every entity of a snapshot and add it to the simulation
+     */
+    void restore(const Snapshot &snapshot) {
+        this->cells.reserve(this->cells.size() + snapshot.cells.size());
+        for (const CellRecord &record: snapshot.cells) {
+            this->cells.push_back(new Cell(record));
+            this->traits.add(record.dna.get());
+            if constexpr (COLONY_TRACKING) {
+                this->colonies.add(this->cells.back());
+            }
+        }
+        for (const EggRecord &record: snapshot.eggs) {
+            this->eggs.push_back(new Egg(record));
+        }
+        for (const FoodRecord &record: snapshot.plants) {
+            if constexpr (NUTRIENT_FIELD_PLANTS) {
+                this->deposit_plant(record.calories, record.position);
+                continue;
+            }
+            this->add_food(new Plant(record));
+        }
+        for (const FoodRecord &record: snapshot.meats) {
+            this->add_food(new Meat(record));
+        }
+        for (const std::pair<int, float> &nutrient: snapshot.nutrients) {
+            if (nutrient.first < 0 or nutrient.first >= NutrientField::size()) {
+                continue;
+            }
+            if constexpr (NUTRIENT_FIELD_PLANTS) {
+                this->nutrients.deposit(nutrient.first, nutrient.second);
+                continue;
+            }
+            // saved with the nutrient field, turn every patch back into a plant
+            this->deposit_plant(nutrient.second, NutrientField::position_of(nutrient.first));
+        }
+    }
+
+public:
+    Simulation() {
+
+    }
+
+    /**
+     * Load a save directory
+     * Checkpoint chains are loaded at their latest checkpoint, binary saves are memory mapped, anything else is
+     * imported as a legacy text save
+     */
+    explicit Simulation(const std::string& save_path) {
+        const std::filesystem::path binary_path = std::filesystem::path(save_path) / BINARY_SAVE_FILE_NAME;
+        const std::vector<uint64_t> checkpoints = list_checkpoints(save_path);
+        if (checkpoints.empty() and !std::filesystem::exists(binary_path)) {
+            this->import_text_save(save_path);
+            return;
+        }
+        if (PROGRESSIVE_LOADING and checkpoints.empty()) {
+            std::unique_ptr<ProgressiveLoader> _loader = std::make_unique<ProgressiveLoader>();
+            if (_loader->open(binary_path)) {
+                this->restore_state(_loader->get_state());
+                this->loader = std::move(_loader);
+                this->loaded_tiles.assign(REGION_COUNT, false);
+                this->loading_start = std::chrono::steady_clock::now();
+                this->loader->start(this->focus);
+                return;
+            }
+        }
+        Snapshot snapshot;
+        const bool loaded = checkpoints.empty() ? Snapshot::read_binary(binary_path, snapshot) : materialize_checkpoint(save_path, checkpoints.back(), snapshot);
+        if (!loaded) {
+            Log::get_instance().log(Log::CRITICAL, "Simulation", std::format("Could not load {}, starting empty", save_path));
+            return;
+        }
+        this->restore_state(snapshot);
+        this->restore(snapshot);
+        this->order_loaded_entities();
+        this->resume_coalescing();
+    }
+
     ~Simulation() {
+        this->loader.reset();
         printf("doing cell\n");
         for (Cell* cell: this->cells) {
             delete cell;
@@ -91,37 +353,257 @@ public:
         }
     }
 
-    void save() {
-        std::filesystem::create_directory(SAVES_PATH);
-        const std::string save_path = std::format("{}/save_{}",SAVES_PATH, std::chrono::system_clock::now());
-        std::filesystem::create_directory(save_path);
-        std::ofstream cell_file;
-        cell_file.open(save_path + "/cells", std::ios::out);
-        for (Cell* cell: this->cells) {
-            cell_file << cell;
+    /**
+     * Directory name for a new save taken now
+     */
+    [[nodiscard]] static std::string new_save_path() {
+        return std::format("{}/save_{}", SAVES_PATH, std::chrono::system_clock::now());
+    }
+
+    /**
+     * Directory name for a new checkpoint chain started now
+     */
+    [[nodiscard]] static std::string new_chain_path() {
+        return std::format("{}/chain_{}", SAVES_PATH, std::chrono::system_clock::now());
+    }
+
+    /**
+     * Restore the tiles that the progressive loader finished since the last call, only call between ticks
+     */
+    void merge_loaded_tiles() {
+        if (this->loader == nullptr) {
+            return;
+        }
+        for (LoadedTile &tile: this->loader->take_loaded()) {
+            this->restore(tile.snapshot);
+            this->loaded_tiles[tile.tile] = true;
+            this->merged_tile_count++;
+        }
+        if (this->merged_tile_count == REGION_COUNT) {
+            this->order_loaded_entities();
+            const float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - this->loading_start).count();
+            Log::get_instance().log(Log::REGULAR, "Simulation", std::format("Finished loading {} regions in {} seconds", REGION_COUNT, seconds));
+            this->loader.reset();
+            this->loaded_tiles.clear();
+        }
+    }
+
+    /**
+     * Block until a progressive load is complete and restore what is left, only call between ticks
+     */
+    void finish_loading() {
+        if (this->loader == nullptr) {
+            return;
+        }
+        this->loader->wait();
+        this->merge_loaded_tiles();
+    }
+
+    /**
+     * Have the next interaction pass gather telemetry, only call between ticks
+     */
+    void set_sampling(const bool _sampling) {
+        this->sampling = _sampling;
+    }
+
+    [[nodiscard]] bool is_sampling() const {
+        return this->sampling;
+    }
+
+    [[nodiscard]] bool is_loading() const {
+        return this->loader != nullptr;
+    }
+
+    /**
+     * Whether bodies at a position wait for their surroundings to be loaded
+     * Vision and interactions reach into the neighboring regions, so every region around has to be there
+     */
+    [[nodiscard]] bool is_frozen(const Vector2 position) const {
+        if (this->loader == nullptr) {
+            return false;
+        }
+        const int center_x = RegionGrid::unwrapped_coordinate(position.x);
+        const int center_y = RegionGrid::unwrapped_coordinate(position.y);
+        for (int region_y = center_y - 1; region_y <= center_y + 1; region_y++) {
+            for (int region_x = center_x - 1; region_x <= center_x + 1; region_x++) {
+                if (!this->loaded_tiles[RegionGrid::region_index(region_x, region_y)]) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Ticks worth of simulation a body advances this tick, 0 while it is frozen, see LevelOfDetail::timestep()
+     */
+    [[nodiscard]] unsigned int get_timestep(const unsigned long id, const Vector2 position) const {
+        if (this->is_frozen(position)) {
+            return 0;
+        }
+        return LevelOfDetail::timestep(id, position, this->focus, this->tick_count);
+    }
+
+    /**
+     * Copy everything that is saved, only call between ticks
+     * A progressive load is finished first so that the snapshot holds the whole world
+     */
+    [[nodiscard]] std::shared_ptr<Snapshot> capture_snapshot() {
+        std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>();
+        this->capture(*snapshot);
+        return snapshot;
+    }
+
+    /**
+     * Same as capture_snapshot(), into an existing snapshot whose buffers are reused
+     * Only reads the simulation apart from finishing a progressive load
+     */
+    void capture(Snapshot &snapshot) {
+        this->finish_loading();
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        snapshot.cells.clear();
+        snapshot.cells.reserve(this->cells.size());
+        for (const Cell* cell: this->cells) {
+            snapshot.cells.push_back(cell->get_record());
+        }
+        this->capture_all_but_cells(snapshot);
+        snapshot.capture_seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /**
+     * Same as capture(), except that the cell records, most of the work, are left to the interaction pass of the next
+     * tick, each processing thread copies its own cells before it changes them, see capture_cells()
+     * Only call between ticks without a capture running, finish_capture() completes the snapshot
+     */
+    void begin_capture(Snapshot &snapshot) {
+        this->finish_loading();
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        snapshot.cells.resize(this->cells.size());
+        this->capture_all_but_cells(snapshot);
+        snapshot.capture_seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+        this->capturing = &snapshot;
+        this->capture_handed_over = false;
+    }
+
+    /**
+     * Copy every stride-th cell record from first into the snapshot of begin_capture(), does nothing without one
+     * Only call from the interaction pass before it changes any cell
+     */
+    void capture_cells(const unsigned int first, const unsigned int stride) {
+        if (this->capturing == nullptr) {
+            return;
+        }
+        for (unsigned int index = first; index < (unsigned int) this->cells.size(); index += stride) {
+            this->cells[index]->copy_record(this->capturing->cells[index]);
+        }
+    }
+
+    /**
+     * Complete the snapshot of begin_capture(), its cells are copied here when no tick has run since
+     * Only call between ticks or between the interaction and tick passes, does nothing without a capture running
+     */
+    void finish_capture() {
+        if (this->capturing == nullptr) {
+            return;
+        }
+        if (!this->capture_handed_over) {
+            this->capture_cells(0, 1);
+        }
+        this->capturing = nullptr;
+    }
+
+    /**
+     * Go back to a snapshot this simulation took, only call between ticks
+     * Entities that still exist are overwritten in place instead of being rebuilt, cells keep their brains when the
+     * genome is the same, so only entities that died since the snapshot are constructed again
+     */
+    void rewind(const Snapshot &snapshot) {
+        this->finish_loading();
+        this->finish_capture(); // it copies the cells that are replaced below
+        this->coalescer.cancel_pass(); // it holds food that is freed below
+
+        // both in id order, see order_loaded_entities()
+        std::vector<Cell*> rewound_cells;
+        rewound_cells.reserve(snapshot.cells.size());
+        size_t live_index = 0;
+        for (const CellRecord &record: snapshot.cells) {
+            while (live_index < this->cells.size() and this->cells[live_index]->get_id() < record.id) {
+                this->traits.remove(this->cells[live_index]->get_dna().get());
+                delete this->cells[live_index++];
+            }
+            if (live_index < this->cells.size() and this->cells[live_index]->get_id() == record.id and this->cells[live_index]->get_dna() == record.dna) {
+                Cell* cell = this->cells[live_index++];
+                cell->set_record(record);
+                rewound_cells.push_back(cell);
+                continue;
+            }
+            rewound_cells.push_back(new Cell(record));
+            this->traits.add(record.dna.get());
+        }
+        for (; live_index < this->cells.size(); live_index++) {
+            this->traits.remove(this->cells[live_index]->get_dna().get());
+            delete this->cells[live_index];
+        }
+        this->cells.swap(rewound_cells);
+        if constexpr (COLONY_TRACKING) {
+            this->colonies.rebuild(this->cells); // most cells moved, and the deleted ones are still listed
+            this->colonies.find_colonies(snapshot.tick_count);
         }
-        cell_file.close();
 
-        std::ofstream egg_file;
-        egg_file.open(save_path + "/eggs", std::ios::out);
         for (Egg* egg: this->eggs) {
-            egg_file << egg;
+            delete egg;
+        }
+        this->eggs.clear();
+        for (const EggRecord &record: snapshot.eggs) {
+            this->eggs.push_back(new Egg(record));
         }
-        egg_file.close();
 
-        std::ofstream plant_file;
-        std::ofstream meat_file;
-        plant_file.open(save_path + "/plants", std::ios::out);
-        meat_file.open(save_path + "/meats", std::ios::out);
-        for (Food* food: this->foods) {
-            if (food->get_food_type() == PLANT) {
-                plant_file << food;
-            } else {
-                meat_file << food;
+        // plants and meats are saved apart, merged back into id order
+        std::vector<Food*> rewound_foods;
+        rewound_foods.reserve(snapshot.plants.size() + snapshot.meats.size());
+        std::list<Food*>::iterator live_food = this->foods.begin();
+        size_t plant_index = 0;
+        size_t meat_index = 0;
+        while (plant_index < snapshot.plants.size() or meat_index < snapshot.meats.size()) {
+            const bool is_plant = meat_index == snapshot.meats.size() or (plant_index < snapshot.plants.size() and snapshot.plants[plant_index].id < snapshot.meats[meat_index].id);
+            const FoodRecord &record = is_plant ? snapshot.plants[plant_index++] : snapshot.meats[meat_index++];
+            while (live_food != this->foods.end() and (*live_food)->get_id() < record.id) {
+                delete *live_food++;
+            }
+            if (live_food != this->foods.end() and (*live_food)->get_id() == record.id and (*live_food)->get_food_type() == record.food_type) {
+                (*live_food)->set_record(record);
+                rewound_foods.push_back(*live_food++);
+                continue;
             }
+            rewound_foods.push_back(is_plant ? (Food*) new Plant(record) : (Food*) new Meat(record));
         }
-        plant_file.close();
-        meat_file.close();
+        for (; live_food != this->foods.end(); live_food++) {
+            delete *live_food;
+        }
+        this->foods.resize(rewound_foods.size());
+        std::copy(rewound_foods.begin(), rewound_foods.end(), this->foods.begin());
+        if constexpr (TOROIDAL_WORLD) {
+            this->regions.reindex_foods(this->foods);
+        }
+
+        if constexpr (NUTRIENT_FIELD_PLANTS) {
+            this->nutrients.clear();
+            for (const std::pair<int, float> &nutrient: snapshot.nutrients) {
+                this->nutrients.deposit(nutrient.first, nutrient.second);
+            }
+        }
+        this->restore_state(snapshot);
+        this->resume_coalescing();
+    }
+
+    /**
+     * Save right away on the calling thread, see SaveSubsystem for saving in the background
+     * @return Whether the save was completed
+     */
+    bool save() {
+        std::filesystem::create_directory(SAVES_PATH);
+        std::atomic<size_t> written = 0;
+        return this->capture_snapshot()->write_atomically(Simulation::new_save_path(), written);
     }
 
     void setup_environment() {
@@ -131,7 +613,7 @@ public:
         const unsigned short plant_count = 200;
         const unsigned short cell_count = 500;
         for (unsigned short i = 0; i < plant_count; i++) {
-            this->foods.push_back(new Plant(40.0f, {position_distribution(RNG), position_distribution(RNG)}));
+            this->deposit_plant(40.0f, {position_distribution(RNG), position_distribution(RNG)});
         }
         for (unsigned short i = 0; i < cell_count; i++) {
             this->eggs.push_back(new Egg(20.0f, {position_distribution(RNG), position_distribution(RNG)}));
@@ -139,7 +621,7 @@ public:
 
 
         for (unsigned short i = 0; i < plant_count; i++) {
-            this->foods.push_back(new Plant(50.0f, {position_distribution(RNG), -position_distribution(RNG)}));
+            this->deposit_plant(50.0f, {position_distribution(RNG), -position_distribution(RNG)});
         }
         for (unsigned short i = 0; i < cell_count; i++) {
             this->eggs.push_back(new Egg(20.0f, {position_distribution(RNG), -position_distribution(RNG)}));
@@ -147,7 +629,7 @@ public:
 
 
         for (unsigned short i = 0; i < plant_count; i++) {
-            this->foods.push_back(new Plant(50.0f, {-position_distribution(RNG), position_distribution(RNG)}));
+            this->deposit_plant(50.0f, {-position_distribution(RNG), position_distribution(RNG)});
         }
         for (unsigned short i = 0; i < cell_count; i++) {
             this->eggs.push_back(new Egg(20.0f, {-position_distribution(RNG), position_distribution(RNG)}));
@@ -155,7 +637,7 @@ public:
 
 
         for (unsigned short i = 0; i < plant_count; i++) {
-            this->foods.push_back(new Plant(50.0f, {-position_distribution(RNG), -position_distribution(RNG)}));
+            this->deposit_plant(50.0f, {-position_distribution(RNG), -position_distribution(RNG)});
         }
         for (unsigned short i = 0; i < cell_count; i++) {
             this->eggs.push_back(new Egg(20.0f, {-position_distribution(RNG), -position_distribution(RNG)}));
@@ -171,14 +653,121 @@ public:
     [[nodiscard]] std::list<Food*>& get_foods() {
         return this->foods;
     }
+    [[nodiscard]] RegionGrid& get_regions() {
+        return this->regions;
+    }
+    [[nodiscard]] NutrientField& get_nutrients() {
+        return this->nutrients;
+    }
+    [[nodiscard]] const TraitStatistics& get_traits() const {
+        return this->traits;
+    }
+
+    [[nodiscard]] const ColonyTracker& get_colonies() const {
+        return this->colonies;
+    }
+
+    /**
+     * @param distance Cells closer than this share a colony, see ColonyTracker
+     */
+    void set_colony_distance(const float distance) {
+        this->colonies.set_link_distance(distance, this->cells);
+    }
+
+    /**
+     * Check the trait statistics against a recount and log where they drifted, see TraitStatistics::verify()
+     */
+    bool verify_traits() const {
+        std::string description;
+        if (this->traits.verify(this->cells, description)) {
+            return true;
+        }
+        Log::get_instance().log(Log::CRITICAL, "Simulation", std::format("Trait statistics are off at tick {}: {}", this->tick_count, description));
+        return false;
+    }
+
+    [[nodiscard]] const FoodCoalescer& get_coalescer() const {
+        return this->coalescer;
+    }
+
+    /**
+     * Turn calories into plant matter, either a new Plant or a deposit into the nutrient field
+     */
+    void deposit_plant(const float calories, Vector2 position) {
+        if constexpr (NUTRIENT_FIELD_PLANTS) {
+            if (is_too_far(position)) {
+                position = {random_originish(RNG), random_originish(RNG)};
+            }
+            this->nutrients.deposit(position, calories);
+        }
+        else {
+            this->add_food(new Plant(calories, position));
+        }
+    }
+
+    void add_food(Food* food) {
+        this->foods.push_back(food);
+        if constexpr (TOROIDAL_WORLD) {
+            this->regions.add_food(std::prev(this->foods.end()));
+        }
+    }
+
+    /**
+     * Prepare for the interaction pass, which takes over the cells of a capture begun since the last tick
+     * @param _focus Camera target
+     */
+    void begin_tick(const Vector2 _focus) {
+        this->tick_count++;
+        this->focus = _focus;
+        this->capture_handed_over = this->capturing != nullptr;
+        if (this->loader != nullptr) {
+            this->loader->set_focus(_focus);
+            this->merge_loaded_tiles();
+        }
+        if constexpr (TOROIDAL_WORLD) {
+            this->regions.update(this->cells, this->eggs);
+        }
+    }
+
+    /**
+     * Apply the stabs and meals found in the interaction pass, in cell order
+     * Only call between the interaction and tick passes
+     */
+    void resolve_interactions() {
+        for (Cell* cell: this->cells) {
+            cell->resolve_targets(this->nutrients);
+        }
+    }
+
+    /**
+     * Log births and deaths from now on, nullptr to stop
+     */
+    void set_lineage(LineageSubsystem* _lineage) {
+        this->lineage = _lineage;
+    }
+
+    [[nodiscard]] unsigned long get_tick_count() const {
+        return this->tick_count;
+    }
+
+    [[nodiscard]] Vector2 get_focus() const {
+        return this->focus;
+    }
 
     void clear() {
         for (Cell* cell: cells) {
             if (cell->is_dead()) {
+                if (this->lineage != nullptr) {
+                    this->lineage->record(DIED, this->tick_count, cell->get_id(), cell->get_killer_id());
+                }
+                this->traits.remove(cell->get_dna().get());
+                if constexpr (COLONY_TRACKING) {
+                    this->colonies.remove(cell);
+                }
 
                 const float calories = cell->take_waste(cell->get_waste()) + cell->take_energy(cell->get_energy()) + cell->take_stomach_calories() + cell->take_base_energy() ;
                 if (calories > 0) {
-                    this->foods.push_back(new Meat(calories, cell->polar_offset(cell->get_radius(), random_angle(RNG))));
+                    this->add_food(new Meat(calories, cell->polar_offset(cell->get_radius(), random_angle(RNG))));
                 }
             }
         }
@@ -191,9 +780,34 @@ public:
             return egg->is_hatched();
         }), eggs.end());
 
-        foods.erase(std::remove_if(foods.begin(), foods.end(), [] (const Food* food) {
-            return food->is_consumed();
-        }), foods.end());
+        // started at the end of the last tick, merged sources are removed with the consumed food below
+        if (this->coalescer.ticks_since_pass >= FOOD_COALESCE_PERIOD) {
+            this->coalescer.finish_pass();
+            this->coalescer.ticks_since_pass = 0;
+        }
+
+        if constexpr (COLONY_TRACKING) {
+            this->colonies.update(this->cells);
+            this->colonies.ticks_since_pass++;
+            if (this->colonies.ticks_since_pass >= COLONY_PERIOD) {
+                this->colonies.find_colonies(this->tick_count);
+            }
+        }
+
+        if constexpr (TOROIDAL_WORLD) {
+            this->regions.remove_consumed_foods(this->foods);
+        }
+        else {
+            foods.erase(std::remove_if(foods.begin(), foods.end(), [] (const Food* food) {
+                return food->is_consumed();
+            }), foods.end());
+        }
+
+        // scanned while the next tick runs
+        this->coalescer.ticks_since_pass++;
+        if (this->coalescer.ticks_since_pass >= FOOD_COALESCE_PERIOD) {
+            this->coalescer.start_pass(this->foods);
+        }
 
     }
 
@@ -203,24 +817,36 @@ public:
                 Egg* egg = cell->lay_egg();
                 if (egg != nullptr) {
                     this->eggs.push_back(egg);
+                    if (this->lineage != nullptr) {
+                        this->lineage->record(EGG_LAID, this->tick_count, egg->get_id(), cell->get_id());
+                    }
                 }
             }
             if (cell->should_shit()) {
-                this->foods.push_back(new Plant(cell->shit(), cell->get_shit_position()));
+                this->deposit_plant(cell->shit(), cell->get_shit_position());
             }
         }
 
         for (Egg* egg: this->eggs) {
-            egg->tick();
+            egg->tick(this->get_timestep(egg->get_id(), egg->get_position()));
             if (egg->is_ready_to_hatch()) {
                 egg->hatch();
                 this->cells.push_back(new Cell(egg));
+                this->traits.add(egg->get_dna().get());
+                if constexpr (COLONY_TRACKING) {
+                    this->colonies.add(this->cells.back());
+                }
+                if (this->lineage != nullptr) {
+                    this->lineage->record(HATCHED, this->tick_count, this->cells.back()->get_id(), egg->get_id());
+                }
             }
         }
 
-        for (Food* food: this->foods) {
-            if (food->is_too_far()) {
-                food->set_position({random_originish(RNG), random_originish(RNG)});
+        if constexpr (!TOROIDAL_WORLD) {
+            for (Food* food: this->foods) {
+                if (food->is_too_far()) {
+                    food->set_position({random_originish(RNG), random_originish(RNG)});
+                }
             }
         }
     }
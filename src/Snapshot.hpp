@@ -0,0 +1,780 @@
+#pragma once
+
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <atomic>
+#include <utility>
+#include <unordered_map>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+#include "Cell.hpp"
+#include "Egg.hpp"
+#include "Food.hpp"
+#include "Region.hpp"
+#include "NutrientField.hpp"
+#include "BinarySave.hpp"
+#include "SaveManifest.hpp"
+#include "RandomState.hpp"
+#include "Logging.hpp"
+
+
+constexpr bool BINARY_SAVES = true; // Write new saves in the binary format instead of text, both can always be loaded
+constexpr std::string BINARY_SAVE_FILE_NAME = "world.bin";
+constexpr bool TILED_SAVES = true; // Binary saves also index their records by region so they can be loaded progressively, see ProgressiveLoader.hpp
+
+
+/**
+ * Flush a written file to disk
+ * Directories are synced too on POSIX so that renames are durable, Windows has no equivalent and skips them
+ * @param path File or directory
+ * @return Whether the sync succeeded
+ */
+bool sync_path(const std::filesystem::path &path) {
+#if defined(_WIN32)
+    std::error_code error;
+    if (std::filesystem::is_directory(path, error)) {
+        return true;
+    }
+    const int descriptor = _open(path.string().c_str(), _O_RDWR);
+    if (descriptor < 0) {
+        return false;
+    }
+    const bool synced = _commit(descriptor) == 0;
+    _close(descriptor);
+    return synced;
+#else
+    const int descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        return false;
+    }
+    const bool synced = fsync(descriptor) == 0;
+    close(descriptor);
+    return synced;
+#endif
+}
+
+
+/*
+ * Binary save records, one section each, see BinarySave.hpp
+ * Cells and eggs refer to their genome by index into the genome section so a shared genome is stored once
+ * Every record starts with its KEY_SIZE byte key (id or nutrient patch index), Checkpoint.hpp matches records across saves with it
+ */
+
+class GenomeBinaryRecord {
+public:
+    float genes[DNA_t::gene_count()];
+};
+
+constexpr uint32_t WANT_LAY_EGG_FLAG = 1 << 0;
+constexpr uint32_t WANT_EAT_FLAG = 1 << 1;
+constexpr uint32_t WANT_STAB_FLAG = 1 << 2;
+
+class CellBinaryRecord {
+public:
+    uint64_t id;
+    uint64_t age;
+    uint32_t genome;
+    uint32_t flags;
+    float radius;
+    Vector2 position;
+    float energy;
+    float base_energy;
+    Vector2 velocity;
+    float angle;
+    float health;
+    float waste;
+    float memory[3];
+    Sensor sensor;
+    Stomach stomach;
+    float brain_values[Network_t::get_value_count()];
+
+    constexpr static size_t KEY_SIZE = sizeof(uint64_t);
+
+    [[nodiscard]] uint64_t get_key() const {
+        return this->id;
+    }
+};
+
+class EggBinaryRecord {
+public:
+    uint64_t id;
+    uint32_t genome;
+    uint32_t age;
+    float radius;
+    Vector2 position;
+    float energy;
+    uint32_t hatched;
+    uint32_t padding;
+
+    constexpr static size_t KEY_SIZE = sizeof(uint64_t);
+
+    [[nodiscard]] uint64_t get_key() const {
+        return this->id;
+    }
+};
+
+class FoodBinaryRecord {
+public:
+    uint64_t id;
+    float radius;
+    Vector2 position;
+    float calories;
+    uint32_t consumed;
+    uint32_t padding;
+
+    constexpr static size_t KEY_SIZE = sizeof(uint64_t);
+
+    [[nodiscard]] uint64_t get_key() const {
+        return this->id;
+    }
+};
+
+class NutrientBinaryRecord {
+public:
+    int32_t index;
+    float calories;
+
+    constexpr static size_t KEY_SIZE = sizeof(int32_t);
+
+    [[nodiscard]] uint64_t get_key() const {
+        return (uint32_t) this->index;
+    }
+};
+
+
+/**
+ * Everything besides the entities that a run needs to continue exactly, see Snapshot::has_state
+ * The random state is stored as text in RANDOM_STATE_SECTION next to it
+ */
+class SimulationStateRecord {
+public:
+    uint64_t tick_count;
+    uint64_t id_count;
+    uint64_t coalesce_merge_count;
+    double coalesce_residual;
+    uint32_t ticks_since_coalesce;
+    uint32_t padding;
+};
+
+
+/**
+ * Tile index of a binary save, tiles are the regions of RegionGrid
+ * TILE_ORDER_SECTION lists record indices, for every tile in turn its cells, eggs, plants, meats and nutrients.
+ * The record sections themselves keep the simulation's order, so loaders that ignore tiles are unaffected.
+ */
+class TileGridRecord {
+public:
+    float tile_size;
+    uint32_t tiles_per_side;
+    float world_size;
+    uint32_t padding;
+};
+
+constexpr unsigned int TILE_RECORD_TYPE_COUNT = 5; // Cells, eggs, plants, meats and nutrients
+
+class TileRecord {
+public:
+    uint64_t first_order; // Index into TILE_ORDER_SECTION
+    uint32_t counts[TILE_RECORD_TYPE_COUNT];
+    uint32_t padding;
+    uint64_t checksum; // Of the tile's records and the genomes they use, see Snapshot::tile_checksum()
+};
+
+
+/**
+ * A snapshot converted to binary records, genomes are referred to by index
+ */
+class SnapshotRecords {
+public:
+    std::vector<GenomeBinaryRecord> genomes;
+    std::vector<CellBinaryRecord> cells;
+    std::vector<EggBinaryRecord> eggs;
+    std::vector<FoodBinaryRecord> plants;
+    std::vector<FoodBinaryRecord> meats;
+    std::vector<NutrientBinaryRecord> nutrients;
+    bool has_nutrients = false;
+};
+
+
+/**
+ * Consistent copy of everything that is saved, taken between ticks
+ * Every entity is copied into a flat record and genomes are shared instead of copied (they never change after
+ * construction), so capturing is cheap and the simulation can keep running while the snapshot is written
+ */
+class Snapshot {
+private:
+    /**
+     * Write one text save file and fsync it
+     * @return Whether everything was written
+     */
+    template<typename Record> bool write_records(const std::filesystem::path &path, const std::vector<Record> &records, std::atomic<size_t> &written) const {
+        std::ofstream file;
+        file.open(path, std::ios::out);
+        file << std::setprecision(std::numeric_limits<float>::max_digits10);
+        for (const Record &record: records) {
+            file << record;
+            written.fetch_add(1, std::memory_order_relaxed);
+        }
+        file.close();
+        return !file.fail() and sync_path(path);
+    }
+
+    [[nodiscard]] static FoodBinaryRecord to_binary(const FoodRecord &food) {
+        FoodBinaryRecord record{};
+        record.id = food.id;
+        record.radius = food.radius;
+        record.position = food.position;
+        record.calories = food.calories;
+        record.consumed = food.consumed;
+        return record;
+    }
+
+    [[nodiscard]] static FoodRecord from_binary(const FoodBinaryRecord &record, const FoodType food_type) {
+        return {record.id, record.radius, record.position, record.calories, record.consumed != 0, food_type};
+    }
+
+public:
+    std::vector<CellRecord> cells;
+    std::vector<EggRecord> eggs;
+    std::vector<FoodRecord> plants;
+    std::vector<FoodRecord> meats;
+    std::vector<std::pair<int, float>> nutrients; // Nonzero nutrient field patches
+    bool has_nutrients = false;
+    float capture_seconds = 0; // How long the simulation was stalled taking the snapshot
+    unsigned long tick_count = 0;
+    int64_t creation_time = 0; // Seconds since the unix epoch
+    // Continuing from the snapshot needs these as well, saves from before they were saved have no state
+    bool has_state = false;
+    unsigned long id_count = 0; // Body::id_count
+    unsigned int ticks_since_coalesce = 0;
+    double coalesce_residual = 0;
+    unsigned long coalesce_merge_count = 0;
+    std::string random_state; // See RandomState.hpp
+
+    [[nodiscard]] size_t get_record_count() const {
+        return this->cells.size() + this->eggs.size() + this->plants.size() + this->meats.size() + this->nutrients.size();
+    }
+
+    /**
+     * Write the snapshot in the legacy text save format, one file per entity type
+     * @param directory Existing directory to write the save files into
+     * @param written Incremented for every record written, for progress reporting
+     * @return Whether every file was written and synced
+     */
+    bool write_text(const std::filesystem::path &directory, std::atomic<size_t> &written) const {
+        if (!this->write_records(directory / "cells", this->cells, written)) {
+            return false;
+        }
+        if (!this->write_records(directory / "eggs", this->eggs, written)) {
+            return false;
+        }
+        if (!this->write_records(directory / "plants", this->plants, written)) {
+            return false;
+        }
+        if (!this->write_records(directory / "meats", this->meats, written)) {
+            return false;
+        }
+        if (this->has_state and !this->write_text_state(directory / "state")) {
+            return false;
+        }
+        if (!this->has_nutrients) {
+            return true;
+        }
+        const std::filesystem::path path = directory / "nutrients";
+        std::ofstream file;
+        file.open(path, std::ios::out);
+        file << std::setprecision(std::numeric_limits<float>::max_digits10);
+        // same format as NutrientField's operator<<
+        for (const std::pair<int, float> &nutrient: this->nutrients) {
+            file << nutrient.first;
+            file << "\n";
+            file << nutrient.second;
+            file << "\n";
+            written.fetch_add(1, std::memory_order_relaxed);
+        }
+        file.close();
+        return !file.fail() and sync_path(path);
+    }
+
+    /**
+     * Write the state as text, one value per line
+     * @return Whether the file was written and synced
+     */
+    bool write_text_state(const std::filesystem::path &path) const {
+        std::ofstream file;
+        file.open(path, std::ios::out);
+        file << std::setprecision(std::numeric_limits<double>::max_digits10);
+        file << this->tick_count << "\n";
+        file << this->id_count << "\n";
+        file << this->ticks_since_coalesce << "\n";
+        file << this->coalesce_residual << "\n";
+        file << this->coalesce_merge_count << "\n";
+        file << this->random_state << "\n";
+        file.close();
+        return !file.fail() and sync_path(path);
+    }
+
+    /**
+     * Read the state file of a text save
+     * @return Whether the save has a complete state, older saves have none
+     */
+    [[nodiscard]] static bool read_text_state(const std::filesystem::path &directory, Snapshot &snapshot) {
+        std::ifstream file;
+        file.open(directory / "state", std::ios::in);
+        if (!file.is_open()) {
+            return false;
+        }
+        file >> snapshot.tick_count;
+        file >> snapshot.id_count;
+        file >> snapshot.ticks_since_coalesce;
+        file >> snapshot.coalesce_residual;
+        file >> snapshot.coalesce_merge_count;
+        std::getline(file >> std::ws, snapshot.random_state);
+        snapshot.has_state = !file.fail();
+        return snapshot.has_state;
+    }
+
+    /**
+     * Add the state sections to a binary save, if there is a state
+     * @param state Storage for the sections, has to outlive them
+     * @param random_state Storage for the sections, has to outlive them
+     */
+    void add_state_sections(std::vector<SaveSection> &sections, std::vector<SimulationStateRecord> &state, std::vector<char> &random_state) const {
+        if (!this->has_state) {
+            return;
+        }
+        state = {{this->tick_count, this->id_count, this->coalesce_merge_count, this->coalesce_residual, this->ticks_since_coalesce, 0}};
+        random_state.assign(this->random_state.begin(), this->random_state.end());
+        sections.push_back(SaveSection::of(STATE_SECTION, state));
+        sections.push_back(SaveSection::of(RANDOM_STATE_SECTION, random_state));
+    }
+
+    /**
+     * Read the state sections of a binary save, a save without them is read as having no state
+     * @return Whether the sections were absent or read completely
+     */
+    [[nodiscard]] static bool read_state_sections(const BinarySaveReader &reader, Snapshot &snapshot) {
+        if (!reader.has_section(STATE_SECTION)) {
+            return true;
+        }
+        std::vector<SimulationStateRecord> state;
+        std::vector<char> random_state;
+        if (!reader.read_section(STATE_SECTION, state) or !reader.read_section(RANDOM_STATE_SECTION, random_state)) {
+            return false;
+        }
+        if (state.size() != 1) {
+            reader.log_error("has a damaged simulation state");
+            return false;
+        }
+        snapshot.tick_count = state[0].tick_count;
+        snapshot.id_count = state[0].id_count;
+        snapshot.coalesce_merge_count = state[0].coalesce_merge_count;
+        snapshot.coalesce_residual = state[0].coalesce_residual;
+        snapshot.ticks_since_coalesce = state[0].ticks_since_coalesce;
+        snapshot.random_state.assign(random_state.begin(), random_state.end());
+        snapshot.has_state = true;
+        return true;
+    }
+
+    /**
+     * Convert to binary records
+     * @param records Filled with every entity, records.genomes is left for add_genome to fill
+     * @param add_genome Returns the index to store for a genome, adding it to records.genomes if needed
+     */
+    template<typename AddGenome> void to_records(SnapshotRecords &records, AddGenome add_genome) const {
+        records.cells.resize(this->cells.size());
+        for (size_t index = 0; index < this->cells.size(); index++) {
+            const CellRecord &cell = this->cells[index];
+            CellBinaryRecord &record = records.cells[index];
+            std::memset(&record, 0, sizeof(CellBinaryRecord));
+            record.id = cell.id;
+            record.age = cell.age;
+            record.genome = add_genome(cell.dna);
+            record.flags = (cell.want_lay_egg ? WANT_LAY_EGG_FLAG : 0) | (cell.want_eat ? WANT_EAT_FLAG : 0) | (cell.want_stab ? WANT_STAB_FLAG : 0);
+            record.radius = cell.radius;
+            record.position = cell.position;
+            record.energy = cell.energy;
+            record.base_energy = cell.base_energy;
+            record.velocity = cell.velocity;
+            record.angle = cell.angle;
+            record.health = cell.health;
+            record.waste = cell.waste;
+            record.memory[0] = cell.memory1;
+            record.memory[1] = cell.memory2;
+            record.memory[2] = cell.memory3;
+            record.sensor = cell.sensor;
+            record.stomach = cell.stomach;
+            std::copy(cell.brain_values.begin(), cell.brain_values.end(), record.brain_values);
+        }
+        records.eggs.resize(this->eggs.size());
+        for (size_t index = 0; index < this->eggs.size(); index++) {
+            const EggRecord &egg = this->eggs[index];
+            EggBinaryRecord &record = records.eggs[index];
+            std::memset(&record, 0, sizeof(EggBinaryRecord));
+            record.id = egg.id;
+            record.genome = add_genome(egg.dna);
+            record.age = egg.age;
+            record.radius = egg.radius;
+            record.position = egg.position;
+            record.energy = egg.energy;
+            record.hatched = egg.hatched;
+        }
+        records.plants.clear();
+        for (const FoodRecord &plant: this->plants) {
+            records.plants.push_back(Snapshot::to_binary(plant));
+        }
+        records.meats.clear();
+        for (const FoodRecord &meat: this->meats) {
+            records.meats.push_back(Snapshot::to_binary(meat));
+        }
+        records.nutrients.clear();
+        for (const std::pair<int, float> &nutrient: this->nutrients) {
+            records.nutrients.push_back({nutrient.first, nutrient.second});
+        }
+        records.has_nutrients = this->has_nutrients;
+    }
+
+    /**
+     * Convert back from binary records, genomes are only constructed once no matter how many records share them
+     * @return Whether every genome index was valid, failures are logged
+     */
+    [[nodiscard]] static bool from_records(const SnapshotRecords &records, Snapshot &snapshot) {
+        std::vector<std::shared_ptr<DNA_t>> genomes(records.genomes.size());
+        return Snapshot::from_records(records, snapshot, [&records, &genomes](const uint32_t index, const uint64_t id) -> std::shared_ptr<DNA_t> {
+            if (index >= genomes.size()) {
+                Log::get_instance().log(Log::CRITICAL, "Snapshot", std::format("{} refers to missing genome {}", id, index));
+                return nullptr;
+            }
+            if (genomes[index] == nullptr) {
+                genomes[index] = std::make_shared<DNA_t>(records.genomes[index].genes);
+            }
+            return genomes[index];
+        });
+    }
+
+    /**
+     * Convert back from binary records whose genomes are kept elsewhere
+     * @param get_genome Returns the genome at an index for the record with an id, nullptr if there is none
+     * @return Whether every genome was found
+     */
+    template<typename GetGenome> [[nodiscard]] static bool from_records(const SnapshotRecords &records, Snapshot &snapshot, GetGenome get_genome) {
+        snapshot.cells.resize(records.cells.size());
+        for (size_t index = 0; index < records.cells.size(); index++) {
+            const CellBinaryRecord &record = records.cells[index];
+            CellRecord &cell = snapshot.cells[index];
+            cell.dna = get_genome(record.genome, record.id);
+            if (cell.dna == nullptr) {
+                return false;
+            }
+            cell.id = record.id;
+            cell.radius = record.radius;
+            cell.position = record.position;
+            cell.energy = record.energy;
+            cell.base_energy = record.base_energy;
+            cell.age = record.age;
+            std::copy(record.brain_values, record.brain_values + Network_t::get_value_count(), cell.brain_values.begin());
+            cell.velocity = record.velocity;
+            cell.angle = record.angle;
+            cell.health = record.health;
+            cell.waste = record.waste;
+            cell.memory1 = record.memory[0];
+            cell.memory2 = record.memory[1];
+            cell.memory3 = record.memory[2];
+            cell.want_lay_egg = record.flags & WANT_LAY_EGG_FLAG;
+            cell.want_eat = record.flags & WANT_EAT_FLAG;
+            cell.want_stab = record.flags & WANT_STAB_FLAG;
+            cell.sensor = record.sensor;
+            cell.stomach = record.stomach;
+        }
+        snapshot.eggs.resize(records.eggs.size());
+        for (size_t index = 0; index < records.eggs.size(); index++) {
+            const EggBinaryRecord &record = records.eggs[index];
+            std::shared_ptr<DNA_t> dna = get_genome(record.genome, record.id);
+            if (dna == nullptr) {
+                return false;
+            }
+            snapshot.eggs[index] = {record.id, record.radius, record.position, record.energy, record.age, record.hatched != 0, std::move(dna)};
+        }
+        snapshot.plants.clear();
+        for (const FoodBinaryRecord &record: records.plants) {
+            snapshot.plants.push_back(Snapshot::from_binary(record, PLANT));
+        }
+        snapshot.meats.clear();
+        for (const FoodBinaryRecord &record: records.meats) {
+            snapshot.meats.push_back(Snapshot::from_binary(record, MEAT));
+        }
+        snapshot.nutrients.clear();
+        for (const NutrientBinaryRecord &record: records.nutrients) {
+            snapshot.nutrients.emplace_back(record.index, record.calories);
+        }
+        snapshot.has_nutrients = records.has_nutrients;
+        return true;
+    }
+
+    /**
+     * Tile a record belongs to
+     */
+    [[nodiscard]] static int tile_of(const CellBinaryRecord &record) {
+        return RegionGrid::region_at(record.position);
+    }
+    [[nodiscard]] static int tile_of(const EggBinaryRecord &record) {
+        return RegionGrid::region_at(record.position);
+    }
+    [[nodiscard]] static int tile_of(const FoodBinaryRecord &record) {
+        return RegionGrid::region_at(record.position);
+    }
+    [[nodiscard]] static int tile_of(const NutrientBinaryRecord &record) {
+        return RegionGrid::region_at(NutrientField::position_of(record.index));
+    }
+
+    /**
+     * Checksum of one tile's records, and of the genomes of its cells and eggs so that genomes are verified as they
+     * are loaded instead of all up front
+     * @param genomes Genome section, indices are checked by the caller
+     */
+    [[nodiscard]] static uint64_t tile_checksum(const SnapshotRecords &tile, const GenomeBinaryRecord* genomes) {
+        std::vector<uint64_t> checksums = {
+                save_checksum(tile.cells.data(), tile.cells.size() * sizeof(CellBinaryRecord)),
+                save_checksum(tile.eggs.data(), tile.eggs.size() * sizeof(EggBinaryRecord)),
+                save_checksum(tile.plants.data(), tile.plants.size() * sizeof(FoodBinaryRecord)),
+                save_checksum(tile.meats.data(), tile.meats.size() * sizeof(FoodBinaryRecord)),
+                save_checksum(tile.nutrients.data(), tile.nutrients.size() * sizeof(NutrientBinaryRecord))
+        };
+        for (const CellBinaryRecord &record: tile.cells) {
+            checksums.push_back(save_checksum(&genomes[record.genome], sizeof(GenomeBinaryRecord)));
+        }
+        for (const EggBinaryRecord &record: tile.eggs) {
+            checksums.push_back(save_checksum(&genomes[record.genome], sizeof(GenomeBinaryRecord)));
+        }
+        return save_checksum(checksums.data(), checksums.size() * sizeof(uint64_t));
+    }
+
+    /**
+     * Build the tile index of a save's records, see TileGridRecord
+     */
+    static void index_tiles(const SnapshotRecords &records, std::vector<TileGridRecord> &grid, std::vector<TileRecord> &tiles, std::vector<uint32_t> &order) {
+        grid = {{REGION_SIZE, (uint32_t) REGIONS_PER_SIDE, WORLD_SIZE, 0}};
+        tiles.assign(REGION_COUNT, TileRecord{});
+        std::vector<std::vector<uint32_t>> members(REGION_COUNT * TILE_RECORD_TYPE_COUNT);
+        const auto add_members = [&members]<typename Record>(const std::vector<Record> &type_records, const unsigned int type) {
+            for (size_t index = 0; index < type_records.size(); index++) {
+                members[Snapshot::tile_of(type_records[index]) * TILE_RECORD_TYPE_COUNT + type].push_back((uint32_t) index);
+            }
+        };
+        add_members(records.cells, 0);
+        add_members(records.eggs, 1);
+        add_members(records.plants, 2);
+        add_members(records.meats, 3);
+        add_members(records.nutrients, 4);
+
+        order.clear();
+        order.reserve(records.cells.size() + records.eggs.size() + records.plants.size() + records.meats.size() + records.nutrients.size());
+        SnapshotRecords tile;
+        for (int index = 0; index < REGION_COUNT; index++) {
+            tiles[index].first_order = order.size();
+            for (unsigned int type = 0; type < TILE_RECORD_TYPE_COUNT; type++) {
+                const std::vector<uint32_t> &type_members = members[index * TILE_RECORD_TYPE_COUNT + type];
+                tiles[index].counts[type] = (uint32_t) type_members.size();
+                order.insert(order.end(), type_members.begin(), type_members.end());
+            }
+            Snapshot::gather_tile(records, order.data() + tiles[index].first_order, tiles[index], tile);
+            tiles[index].checksum = Snapshot::tile_checksum(tile, records.genomes.data());
+        }
+    }
+
+    /**
+     * Copy one tile's records out of a save's records, indices are checked by the caller
+     * @param order The tile's part of TILE_ORDER_SECTION
+     */
+    template<typename Records> static void gather_tile(const Records &records, const uint32_t* order, const TileRecord &tile, SnapshotRecords &gathered) {
+        const auto gather = [&order](const auto* source, auto &destination, const uint32_t count) {
+            destination.resize(count);
+            for (uint32_t index = 0; index < count; index++) {
+                destination[index] = source[*order++];
+            }
+        };
+        gather(records.cells.data(), gathered.cells, tile.counts[0]);
+        gather(records.eggs.data(), gathered.eggs, tile.counts[1]);
+        gather(records.plants.data(), gathered.plants, tile.counts[2]);
+        gather(records.meats.data(), gathered.meats, tile.counts[3]);
+        gather(records.nutrients.data(), gathered.nutrients, tile.counts[4]);
+        gathered.has_nutrients = records.has_nutrients;
+    }
+
+    /**
+     * Write the snapshot as a single binary save file, see BinarySave.hpp
+     * @param path File to write
+     * @param written Incremented for every record written, for progress reporting
+     * @return Whether the file was written and synced
+     */
+    bool write_binary(const std::filesystem::path &path, std::atomic<size_t> &written) const {
+        SnapshotRecords records;
+        std::unordered_map<const DNA_t*, uint32_t> genome_indices;
+        this->to_records(records, [&genome_indices, &records](const std::shared_ptr<DNA_t> &dna) {
+            const auto [iterator, inserted] = genome_indices.try_emplace(dna.get(), (uint32_t) records.genomes.size());
+            if (inserted) {
+                dna->export_genes(records.genomes.emplace_back().genes);
+            }
+            return iterator->second;
+        });
+
+        std::vector<SaveSection> sections = {
+                SaveSection::of(GENOME_SECTION, records.genomes),
+                SaveSection::of(CELL_SECTION, records.cells),
+                SaveSection::of(EGG_SECTION, records.eggs),
+                SaveSection::of(PLANT_SECTION, records.plants),
+                SaveSection::of(MEAT_SECTION, records.meats)
+        };
+        if (records.has_nutrients) {
+            sections.push_back(SaveSection::of(NUTRIENT_SECTION, records.nutrients));
+        }
+        std::vector<TileGridRecord> grid;
+        std::vector<TileRecord> tiles;
+        std::vector<uint32_t> order;
+        if constexpr (TILED_SAVES) {
+            Snapshot::index_tiles(records, grid, tiles, order);
+            sections.push_back(SaveSection::of(TILE_GRID_SECTION, grid));
+            sections.push_back(SaveSection::of(TILE_SECTION, tiles));
+            sections.push_back(SaveSection::of(TILE_ORDER_SECTION, order));
+        }
+        std::vector<SimulationStateRecord> state;
+        std::vector<char> random_state;
+        this->add_state_sections(sections, state, random_state);
+        return write_binary_save(path, sections, written) and sync_path(path);
+    }
+
+    /**
+     * Load a binary save written by write_binary()
+     * @param path Save file
+     * @param snapshot Filled with the save's contents
+     * @return Whether the save was intact and fully read, failures are logged
+     */
+    [[nodiscard]] static bool read_binary(const std::filesystem::path &path, Snapshot &snapshot) {
+        BinarySaveReader reader;
+        if (!reader.open(path)) {
+            return false;
+        }
+        SnapshotRecords records;
+        if (!reader.read_section(GENOME_SECTION, records.genomes) or !reader.read_section(CELL_SECTION, records.cells)
+                or !reader.read_section(EGG_SECTION, records.eggs) or !reader.read_section(PLANT_SECTION, records.plants)
+                or !reader.read_section(MEAT_SECTION, records.meats) or !reader.read_section(NUTRIENT_SECTION, records.nutrients)) {
+            return false;
+        }
+        records.has_nutrients = reader.has_section(NUTRIENT_SECTION);
+        return Snapshot::read_state_sections(reader, snapshot) and Snapshot::from_records(records, snapshot);
+    }
+
+    /**
+     * Write the snapshot in the format chosen by BINARY_SAVES
+     * @param directory Existing directory to write the save into
+     * @param written Incremented for every record written, for progress reporting
+     * @return Whether everything was written and synced
+     */
+    bool write(const std::filesystem::path &directory, std::atomic<size_t> &written) const {
+        if constexpr (BINARY_SAVES) {
+            return this->write_binary(directory / BINARY_SAVE_FILE_NAME, written);
+        }
+        return this->write_text(directory, written);
+    }
+
+    /**
+     * Summary of the snapshot for the catalog, byte_size and checkpoint_count are left to the caller
+     */
+    [[nodiscard]] SaveManifest get_manifest(const SaveFormat format) const {
+        SaveManifest manifest{};
+        manifest.format = format;
+        manifest.format_version = format == TEXT_SAVE_FORMAT ? 0 : BINARY_SAVE_VERSION;
+        manifest.creation_time = this->creation_time;
+        manifest.tick_count = this->tick_count;
+        manifest.cell_count = this->cells.size();
+        manifest.egg_count = this->eggs.size();
+        manifest.plant_count = this->plants.size();
+        manifest.meat_count = this->meats.size();
+        manifest.nutrient_count = this->nutrients.size();
+        for (size_t index = 0; index < this->cells.size(); index++) {
+            const DNA_t* dna = this->cells[index].dna.get();
+            const float traits[MANIFEST_TRAIT_COUNT] = {dna->radius, dna->diet, dna->speed, dna->vision_range, dna->egg_energy_transfer, dna->metabolism};
+            for (unsigned int trait = 0; trait < MANIFEST_TRAIT_COUNT; trait++) {
+                TraitSummary &summary = manifest.traits[trait];
+                summary.mean += traits[trait];
+                summary.minimum = index == 0 ? traits[trait] : std::min(summary.minimum, traits[trait]);
+                summary.maximum = index == 0 ? traits[trait] : std::max(summary.maximum, traits[trait]);
+            }
+        }
+        for (TraitSummary &summary: manifest.traits) {
+            summary.mean /= (float) std::max(this->cells.size(), (size_t) 1);
+        }
+        return manifest;
+    }
+
+    /**
+     * Write or replace the manifest of a save directory, through a temporary file so a crash leaves the old one
+     * @param directory Save directory holding every save file already, their sizes are summed into the manifest
+     * @param checkpoint_count Checkpoints in the chain, 0 for other formats
+     * @return Whether the manifest was written and synced
+     */
+    bool write_manifest(const std::filesystem::path &directory, const SaveFormat format, const uint64_t checkpoint_count = 0) const {
+        SaveManifest manifest = this->get_manifest(format);
+        manifest.checkpoint_count = checkpoint_count;
+        std::error_code error;
+        for (const std::filesystem::directory_entry &entry: std::filesystem::directory_iterator(directory, error)) {
+            const std::string name = entry.path().filename().string();
+            if (entry.is_regular_file(error) and name != SAVE_MANIFEST_FILE_NAME and !name.starts_with(".")) {
+                manifest.byte_size += entry.file_size(error);
+            }
+        }
+        manifest.seal();
+
+        const std::filesystem::path path = directory / SAVE_MANIFEST_FILE_NAME;
+        const std::filesystem::path temporary_path = directory / ("." + SAVE_MANIFEST_FILE_NAME + ".partial");
+        std::ofstream file(temporary_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file.write((const char*) &manifest, sizeof(SaveManifest))) {
+            return false;
+        }
+        file.close();
+        if (file.fail() or !sync_path(temporary_path)) {
+            return false;
+        }
+        std::filesystem::rename(temporary_path, path, error);
+        return !error;
+    }
+
+    /**
+     * Write the snapshot so that save_path either doesn't exist or holds a complete save, even if the process dies midway
+     * Files go into a hidden temporary directory next to save_path, are fsynced, and the directory is renamed into place
+     * Earlier saves are never opened for writing
+     * @param save_path Final save directory, must not exist yet
+     * @param written Incremented for every record written, for progress reporting
+     * @return Whether the save was completed, on failure the temporary directory is left behind and save_path is untouched
+     */
+    bool write_atomically(const std::filesystem::path &save_path, std::atomic<size_t> &written) const {
+        const std::filesystem::path temporary_path = save_path.parent_path() / ("." + save_path.filename().string() + ".partial");
+        std::error_code error;
+        std::filesystem::remove_all(temporary_path, error);
+        std::filesystem::create_directories(temporary_path, error);
+        if (error or !this->write(temporary_path, written) or !this->write_manifest(temporary_path, BINARY_SAVES ? BINARY_SAVE_FORMAT : TEXT_SAVE_FORMAT)) {
+            return false;
+        }
+        sync_path(temporary_path);
+        std::filesystem::rename(temporary_path, save_path, error);
+        if (error) {
+            return false;
+        }
+        sync_path(save_path.parent_path());
+        return true;
+    }
+};
@@ -0,0 +1,332 @@
+#pragma once
+
+
+#include <raylib.h>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <limits>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <semaphore>
+#include <chrono>
+#include <format>
+
+
+#include "Subsystem.hpp"
+#include "ThreadSafety.hpp"
+#include "DNA.hpp"
+#include "Snapshot.hpp"
+#include "SimdMath.hpp"
+#include "TraitStatistics.hpp"
+
+
+constexpr bool SPECIES_CLUSTERING = true; // Group genomes into species on a background thread, see SpeciesSubsystem
+constexpr unsigned long SPECIES_PERIOD = 500; // Ticks between clustering runs at the most, a run is skipped while the last one is still going
+constexpr float SPECIES_DISTANCE = 0.25f; // Root mean square difference per gene below which a genome joins a species
+constexpr float SPECIES_TRAIT_SCALE = 4.0f; // Traits span [0, this] over their range, weights and biases are left as they are
+constexpr unsigned int SPECIES_MAX_COUNT = 256; // Beyond this, outlying genomes join the nearest species instead of starting one
+constexpr unsigned int SPECIES_DISTANCE_BLOCK = 64; // Genes summed before checking whether a species is already too far
+constexpr unsigned int SPECIES_FEATURE_COUNT = DNA_t::gene_count();
+
+
+/**
+ * One species of the last clustering run
+ */
+class SpeciesInfo {
+public:
+    uint32_t id;
+    uint64_t cell_count;
+};
+
+/**
+ * Species of every genome in a snapshot, published by SpeciesSubsystem
+ * Offspring share the genome of their parent, so cells born after the snapshot are found by their genome as well.
+ */
+class SpeciesLabels {
+public:
+    unsigned long tick = 0; // Of the snapshot
+    float seconds = 0.0f; // Spent clustering
+    std::unordered_map<const DNA_t*, uint32_t> genome_species;
+    std::vector<std::shared_ptr<DNA_t>> genomes; // Keeps the keys above from being freed and reused
+    std::vector<SpeciesInfo> species; // By id
+
+    /**
+     * @return Species id, 0 for a genome that wasn't in the snapshot
+     */
+    [[nodiscard]] uint32_t species_of(const DNA_t* dna) const {
+        const auto found = this->genome_species.find(dna);
+        return found == this->genome_species.end() ? 0 : found->second;
+    }
+
+    /**
+     * Hue spread by the golden angle, so consecutive ids look apart
+     */
+    [[nodiscard]] static Color get_color(const uint32_t species) {
+        return ColorFromHSV(std::fmod((float) species * 137.508f, 360.0f), 0.75f, 0.95f);
+    }
+};
+
+
+/**
+ * Clusters the genomes of a snapshot into species on its own thread
+ * Species persist between runs through their medoid (the member genome closest to the species mean), so ids stay
+ * stable as the population changes. A genome keeps the species it had last run while it is still within
+ * SPECIES_DISTANCE of its medoid, otherwise it joins the nearest species within that distance or starts a new one.
+ * Distances are summed a block of genes at a time and given up on once they exceed the best so far, random genomes
+ * are far enough apart that most species are ruled out after the first block or two.
+ * Cells carrying the same genome are clustered once, offspring carry the genome of their parent.
+ */
+class SpeciesSubsystem: public Subsystem {
+private:
+    class Species {
+    public:
+        uint32_t id;
+        std::vector<float> medoid;
+        uint64_t cell_count;
+        std::vector<double> sums; // Of the member features weighted by their cells, for the mean
+        uint32_t best_member; // Closest to the mean so far
+        float best_member_distance;
+    };
+
+    std::vector<Species> species;
+    uint32_t next_species_id = 1;
+    std::unordered_map<const DNA_t*, std::pair<std::shared_ptr<DNA_t>, uint32_t>> previous; // Genome to species, last run
+
+    std::mutex pending_lock;
+    std::shared_ptr<const Snapshot> pending;
+    std::atomic<bool> busy = false;
+    std::counting_semaphore<> cluster_notifier{0};
+    ThreadSafe<std::shared_ptr<const SpeciesLabels>> labels;
+
+    /**
+     * Genes of a genome with the traits rescaled by their ranges
+     */
+    static void extract_features(const DNA_t* dna, float* features) {
+        dna->export_genes(features);
+        for (unsigned int trait = 0; trait < TRAIT_COUNT; trait++) {
+            const Range &range = TRAIT_HISTOGRAM_RANGES[trait];
+            features[trait] = (features[trait] - range.min) / (range.max - range.min) * SPECIES_TRAIT_SCALE;
+        }
+    }
+
+    /**
+     * @param limit Squared distance beyond which species are ignored
+     * @return Index of the nearest species within the limit, -1 if there is none
+     */
+    [[nodiscard]] int find_nearest(const float* features, const float limit) const {
+        int nearest = -1;
+        float nearest_distance = limit;
+        for (size_t index = 0; index < this->species.size(); index++) {
+            const float* medoid = this->species[index].medoid.data();
+            float distance = 0.0f;
+            for (unsigned int first = 0; first < SPECIES_FEATURE_COUNT and distance < nearest_distance; first += SPECIES_DISTANCE_BLOCK) {
+                distance += squared_distance(features + first, medoid + first, std::min(SPECIES_DISTANCE_BLOCK, SPECIES_FEATURE_COUNT - first));
+            }
+            if (distance < nearest_distance) {
+                nearest = (int) index;
+                nearest_distance = distance;
+            }
+        }
+        return nearest;
+    }
+
+    void add_species(const float* features) {
+        Species founded;
+        founded.id = this->next_species_id++;
+        founded.medoid.assign(features, features + SPECIES_FEATURE_COUNT);
+        founded.cell_count = 0;
+        founded.sums.assign(SPECIES_FEATURE_COUNT, 0.0);
+        this->species.push_back(std::move(founded));
+    }
+
+    void cluster(const Snapshot &snapshot) {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const float threshold = SPECIES_DISTANCE * SPECIES_DISTANCE * (float) SPECIES_FEATURE_COUNT;
+
+        // every distinct genome once, with the number of cells carrying it
+        std::unordered_map<const DNA_t*, uint32_t> genome_indices;
+        std::vector<std::shared_ptr<DNA_t>> genomes;
+        std::vector<uint64_t> carriers;
+        for (const CellRecord &record: snapshot.cells) {
+            const auto inserted = genome_indices.try_emplace(record.dna.get(), (uint32_t) genomes.size());
+            if (inserted.second) {
+                genomes.push_back(record.dna);
+                carriers.push_back(0);
+            }
+            carriers[inserted.first->second]++;
+        }
+
+        std::unordered_map<uint32_t, size_t> species_indices;
+        for (size_t index = 0; index < this->species.size(); index++) {
+            Species &existing = this->species[index];
+            existing.cell_count = 0;
+            existing.sums.assign(SPECIES_FEATURE_COUNT, 0.0);
+            species_indices[existing.id] = index;
+        }
+
+        std::vector<uint32_t> assignments(genomes.size());
+        std::vector<float> features(SPECIES_FEATURE_COUNT);
+        for (size_t genome = 0; genome < genomes.size(); genome++) {
+            SpeciesSubsystem::extract_features(genomes[genome].get(), features.data());
+            int chosen = -1;
+            const auto last = this->previous.find(genomes[genome].get());
+            if (last != this->previous.end() and species_indices.contains(last->second.second)) {
+                // outliers joined the nearest species once the cap was reached, searching again would only find it again
+                const size_t index = species_indices[last->second.second];
+                if (this->species.size() >= SPECIES_MAX_COUNT or squared_distance(features.data(), this->species[index].medoid.data(), SPECIES_FEATURE_COUNT) < threshold) {
+                    chosen = (int) index;
+                }
+            }
+            if (chosen < 0) {
+                chosen = this->find_nearest(features.data(), threshold);
+            }
+            if (chosen < 0 and this->species.size() < SPECIES_MAX_COUNT) {
+                this->add_species(features.data());
+                chosen = (int) this->species.size() - 1;
+            }
+            if (chosen < 0) {
+                chosen = this->find_nearest(features.data(), std::numeric_limits<float>::infinity());
+            }
+            Species &member_of = this->species[chosen];
+            assignments[genome] = (uint32_t) chosen;
+            member_of.cell_count += carriers[genome];
+            for (unsigned int feature = 0; feature < SPECIES_FEATURE_COUNT; feature++) {
+                member_of.sums[feature] += (double) features[feature] * (double) carriers[genome];
+            }
+        }
+
+        // the member closest to the mean becomes the medoid for the next run
+        std::vector<std::vector<float>> means(this->species.size());
+        for (size_t index = 0; index < this->species.size(); index++) {
+            Species &updated = this->species[index];
+            updated.best_member_distance = std::numeric_limits<float>::infinity();
+            if (updated.cell_count == 0) {
+                continue;
+            }
+            means[index].resize(SPECIES_FEATURE_COUNT);
+            for (unsigned int feature = 0; feature < SPECIES_FEATURE_COUNT; feature++) {
+                means[index][feature] = (float) (updated.sums[feature] / (double) updated.cell_count);
+            }
+        }
+        for (size_t genome = 0; genome < genomes.size(); genome++) {
+            Species &member_of = this->species[assignments[genome]];
+            SpeciesSubsystem::extract_features(genomes[genome].get(), features.data());
+            const float distance = squared_distance(features.data(), means[assignments[genome]].data(), SPECIES_FEATURE_COUNT);
+            if (distance < member_of.best_member_distance) {
+                member_of.best_member_distance = distance;
+                member_of.best_member = (uint32_t) genome;
+            }
+        }
+
+        std::shared_ptr<SpeciesLabels> published = std::make_shared<SpeciesLabels>();
+        published->tick = snapshot.tick_count;
+        std::vector<Species> kept;
+        for (Species &updated: this->species) {
+            if (updated.cell_count == 0) {
+                continue; // extinct
+            }
+            SpeciesSubsystem::extract_features(genomes[updated.best_member].get(), updated.medoid.data());
+            published->species.push_back({updated.id, updated.cell_count});
+            kept.push_back(std::move(updated));
+        }
+        this->previous.clear();
+        published->genomes = genomes;
+        for (size_t genome = 0; genome < genomes.size(); genome++) {
+            const uint32_t id = this->species[assignments[genome]].id;
+            this->previous[genomes[genome].get()] = {genomes[genome], id};
+            published->genome_species[genomes[genome].get()] = id;
+        }
+        this->species = std::move(kept);
+        published->seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+        this->labels.set_data(std::move(published));
+    }
+
+    void init() override {
+
+    }
+
+    void update() override {
+        this->cluster_notifier.acquire();
+        std::shared_ptr<const Snapshot> snapshot;
+        {
+            std::lock_guard<std::mutex> guard(this->pending_lock);
+            snapshot.swap(this->pending);
+        }
+        if (snapshot != nullptr) {
+            this->cluster(*snapshot);
+        }
+        this->busy.store(false);
+    }
+
+    void on_shutdown() override {
+
+    }
+
+    void on_panic() override {
+
+    }
+
+    void signal_shutdown() override {
+        this->should_shutdown.store(true);
+
+        //release all semaphores
+        this->cluster_notifier.release();
+    }
+
+    void signal_panic() override {
+        this->should_panic.store(true);
+
+        //release all semaphores
+        this->cluster_notifier.release();
+    }
+
+    [[nodiscard]] constexpr float warning_loop_second_threshold() const override {
+        return -1; // Disabled, waits for snapshots
+    }
+
+    [[nodiscard]] constexpr float critical_loop_second_threshold() const override {
+        return -1; // Disabled, waits for snapshots
+    }
+
+public:
+    SpeciesSubsystem() = default;
+
+    ~SpeciesSubsystem() = default;
+
+    /**
+     * Start clustering a snapshot unless a run is still going, never waits
+     * @return Whether the snapshot was taken
+     */
+    bool submit(std::shared_ptr<const Snapshot> snapshot) {
+        if (this->busy.exchange(true)) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> guard(this->pending_lock);
+            this->pending = std::move(snapshot);
+        }
+        this->cluster_notifier.release();
+        return true;
+    }
+
+    /**
+     * @return Whether a run is still going, submit() would turn a snapshot down
+     */
+    [[nodiscard]] bool is_busy() const {
+        return this->busy.load();
+    }
+
+    /**
+     * Result of the last finished run, nullptr before the first one
+     */
+    [[nodiscard]] std::shared_ptr<const SpeciesLabels> get_labels() {
+        return this->labels.get_data();
+    }
+
+    [[nodiscard]] constexpr std::string id() const override {
+        return "Species Subsystem";
+    }
+};
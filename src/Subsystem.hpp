@@ -4,6 +4,7 @@
 #include <chrono>
 #include <thread>
 #include <utility>
+#include <atomic>
 
 
 #include "Logging.hpp"
@@ -17,11 +18,11 @@ private:
      */
     void evaluate_update_time() const  {
         if (this->critical_loop_second_threshold() >= 0 and this->update_time >= this->critical_loop_second_threshold()) {
-            this->log(Log::CRITICAL, std::format("Threaded Subsystem ({}) took {} seconds to update", this->id(), this->update_time));
+            this->log(Log::CRITICAL, "Threaded Subsystem ({}) took {} seconds to update", this->id(), this->update_time);
             return;
         }
         if (this->warning_loop_second_threshold() >= 0 and this->update_time >= this->warning_loop_second_threshold()) {
-            this->log(Log::WARNING, std::format("Threaded Subsystem ({}) took {} seconds to update", this->id(), this->update_time));
+            this->log(Log::WARNING, "Threaded Subsystem ({}) took {} seconds to update", this->id(), this->update_time);
             return;
         }
     }
@@ -34,7 +35,7 @@ private:
 
         this->update();
 
-        if (this->should_panic.get_data()) {
+        if (this->should_panic.load()) {
             this->on_panic();
             return;
         }
@@ -53,10 +54,10 @@ private:
         this->log(Log::REGULAR, "Subsystem initialized successfully");
         while (true) {
             this->_update();
-            if (this->should_panic.get_data()) {
+            if (this->should_panic.load()) {
                 break;
             }
-            if (this->should_shutdown.get_data()) {
+            if (this->should_shutdown.load()) {
                 this->log(Log::REGULAR, "Shutting down normally");
                 this->on_shutdown();
                 return;
@@ -66,8 +67,8 @@ private:
 
 protected:
     float update_time; // NOTE this is the time it takes to call update(), not the TOTAL loop time
-    ThreadSafe<bool> should_shutdown; // Shutdown at earliest convenience
-    ThreadSafe<bool> should_panic; // Shutdown immediately
+    std::atomic<bool> should_shutdown; // Shutdown at earliest convenience, polled every loop so it takes no lock
+    std::atomic<bool> should_panic; // Shutdown immediately
     std::thread thread;
 
     /**
@@ -113,13 +114,13 @@ protected:
     virtual void on_panic() = 0;
 
     bool should_exit() {
-        return this->should_panic.get_data() or this->should_shutdown.get_data();
+        return this->should_panic.load() or this->should_shutdown.load();
     }
 
 public:
     Subsystem() {
-        this->should_shutdown.set_data(false);
-        this->should_panic.set_data(false);
+        this->should_shutdown.store(false);
+        this->should_panic.store(false);
         this->update_time = 0;
     }
 
@@ -140,11 +141,18 @@ public:
         Log::get_instance().log(log_level, this->id(), log_info);
     }
 
+    /**
+     * Same as log(...) above, the arguments are formatted later by the logging subsystem
+     */
+    template<typename... Arguments> void log(const Log::LogLevel log_level, std::format_string<Arguments...> format, const Arguments&... arguments) const {
+        Log::get_instance().log(log_level, this->id(), format, arguments...);
+    }
+
     /**
      * Tell subsystem to shut down at the earliest convenience
      */
     virtual void signal_shutdown() {
-        this->should_shutdown.set_data(true);
+        this->should_shutdown.store(true);
     }
 
     /**
@@ -152,7 +160,7 @@ public:
      * Subclasses with long update times should check frequently
      */
     virtual void signal_panic() {
-        this->should_panic.set_data(true);
+        this->should_panic.store(true);
     }
 
     /**
@@ -0,0 +1,267 @@
+#pragma once
+
+
+#include <cmath>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <mutex>
+#include <semaphore>
+#include <format>
+
+
+#include "Subsystem.hpp"
+#include "Cell.hpp"
+#include "Egg.hpp"
+#include "Food.hpp"
+#include "NutrientField.hpp"
+#include "Colony.hpp"
+#include "Logging.hpp"
+
+
+constexpr unsigned long TELEMETRY_PERIOD = 10; // Ticks between telemetry rows unless chosen on the command line
+const std::string TELEMETRY_COLONY_EXTENSION = ".colonies.csv"; // Replaces the extension of the telemetry file for the colony file
+
+
+/**
+ * Colony file written next to a telemetry file, one row per colony and colony pass
+ */
+[[nodiscard]] std::filesystem::path telemetry_colony_path(std::filesystem::path telemetry_path) {
+    return telemetry_path.replace_extension(TELEMETRY_COLONY_EXTENSION);
+}
+
+
+/**
+ * Count, mean and sum of squared deviations of a value over the population
+ */
+class Moments {
+public:
+    double count = 0;
+    double mean = 0;
+    double squared_deviations = 0;
+
+    [[nodiscard]] double get_variance() const {
+        return this->count > 0 ? this->squared_deviations / this->count : 0.0;
+    }
+};
+
+
+/**
+ * Aggregates over the world at the start of a tick, or one thread's share of them
+ */
+class TelemetrySample {
+public:
+    unsigned long cell_count = 0;
+    unsigned long egg_count = 0;
+    unsigned long plant_count = 0;
+    unsigned long meat_count = 0;
+    double cell_energy = 0; // Energy and base energy
+    double stomach_calories = 0;
+    double waste = 0;
+    double egg_energy = 0;
+    double plant_calories = 0;
+    double meat_calories = 0;
+    double nutrient_calories = 0;
+    double coalesce_residual = 0; // See FoodCoalescer, only set on the merged sample
+    unsigned long species_count = 0; // Of the latest species clustering, only set on the merged sample
+    // Only set on the merged sample, from the simulation's TraitStatistics
+    Moments diet;
+    Moments radius;
+    Moments speed;
+    Moments vision;
+
+    void add_cell(const Cell* cell) {
+        this->cell_count++;
+        this->cell_energy += cell->get_energy() + cell->get_base_energy();
+        this->stomach_calories += cell->get_stomach_calories();
+        this->waste += cell->get_waste();
+    }
+
+    void add_egg(const Egg* egg) {
+        this->egg_count++;
+        this->egg_energy += egg->get_energy();
+    }
+
+    void add_food(const Food* food) {
+        if (food->is_consumed()) {
+            return;
+        }
+        if (food->get_food_type() == PLANT) {
+            this->plant_count++;
+            this->plant_calories += food->get_calories();
+        }
+        else {
+            this->meat_count++;
+            this->meat_calories += food->get_calories();
+        }
+    }
+
+    void merge(const TelemetrySample &other) {
+        this->cell_count += other.cell_count;
+        this->egg_count += other.egg_count;
+        this->plant_count += other.plant_count;
+        this->meat_count += other.meat_count;
+        this->cell_energy += other.cell_energy;
+        this->stomach_calories += other.stomach_calories;
+        this->waste += other.waste;
+        this->egg_energy += other.egg_energy;
+        this->plant_calories += other.plant_calories;
+        this->meat_calories += other.meat_calories;
+        this->nutrient_calories += other.nutrient_calories;
+        this->coalesce_residual += other.coalesce_residual;
+    }
+
+    /**
+     * Every calorie in the world, conserved by the simulation up to float rounding
+     */
+    [[nodiscard]] double get_total_energy() const {
+        return this->cell_energy + this->stomach_calories + this->waste + this->egg_energy + this->plant_calories + this->meat_calories + this->nutrient_calories + this->coalesce_residual;
+    }
+};
+
+/**
+ * One line of the telemetry file
+ */
+class TelemetryRow {
+public:
+    unsigned long tick;
+    float ticks_per_second; // Averaged over the ticks since the previous row
+    TelemetrySample sample;
+    // Of the last colony pass, see ColonyTracker
+    unsigned long colony_tick = 0;
+    std::vector<Colony> colonies;
+    uint32_t loner_count = 0;
+};
+
+
+/**
+ * Writes telemetry rows to a CSV file on its own thread
+ * Rows are only queued by the simulation thread, formatting and writing happen here.
+ */
+class TelemetrySubsystem: public Subsystem {
+private:
+    std::filesystem::path path;
+    std::ofstream file;
+    std::ofstream colony_file;
+    unsigned long last_colony_tick = 0; // Colony passes are written once even when several rows report them
+    std::mutex pending_lock;
+    std::vector<TelemetryRow> pending; // Submitted, not written yet
+    std::counting_semaphore<> write_notifier{0};
+
+    void init() override {
+        this->file.open(this->path, std::ios::out | std::ios::trunc);
+        this->file << "tick,ticks_per_second,cells,eggs,plants,meats,cell_energy,stomach_calories,waste,egg_energy,plant_calories,meat_calories,nutrient_calories,total_energy,"
+                      "diet_mean,diet_variance,radius_mean,radius_variance,speed_mean,speed_variance,vision_mean,vision_variance,species,colonies,largest_colony,loners\n";
+        if (!this->file.good()) {
+            this->log(Log::CRITICAL, std::format("Telemetry file {} can't be written, no telemetry is recorded", this->path.string()));
+        }
+        if (COLONY_TRACKING) {
+            this->colony_file.open(telemetry_colony_path(this->path), std::ios::out | std::ios::trunc);
+            this->colony_file << "tick,colony,size,centroid_x,centroid_y,radius\n";
+            if (!this->colony_file.good()) {
+                this->log(Log::CRITICAL, std::format("Colony file {} can't be written, no colonies are recorded", telemetry_colony_path(this->path).string()));
+            }
+        }
+    }
+
+    void update() override {
+        this->write_notifier.acquire();
+        this->write_pending();
+    }
+
+    void write_pending() {
+        std::vector<TelemetryRow> rows;
+        {
+            std::lock_guard<std::mutex> guard(this->pending_lock);
+            rows.swap(this->pending);
+        }
+        if (rows.empty() or !this->file.good()) {
+            return;
+        }
+        std::string text;
+        for (const TelemetryRow &row: rows) {
+            const TelemetrySample &sample = row.sample;
+            text += std::format("{},{:.2f},{},{},{},{},{:.6g},{:.6g},{:.6g},{:.6g},{:.6g},{:.6g},{:.6g},{:.9g},{:.6g},{:.6g},{:.6g},{:.6g},{:.6g},{:.6g},{:.6g},{:.6g},{},{},{},{}\n",
+                                row.tick, row.ticks_per_second, sample.cell_count, sample.egg_count, sample.plant_count, sample.meat_count,
+                                sample.cell_energy, sample.stomach_calories, sample.waste, sample.egg_energy, sample.plant_calories, sample.meat_calories, sample.nutrient_calories, sample.get_total_energy(),
+                                sample.diet.mean, sample.diet.get_variance(), sample.radius.mean, sample.radius.get_variance(),
+                                sample.speed.mean, sample.speed.get_variance(), sample.vision.mean, sample.vision.get_variance(), sample.species_count,
+                                row.colonies.size(), row.colonies.empty() ? 0 : row.colonies.front().size, row.loner_count);
+        }
+        this->file << text;
+        this->file.flush();
+
+        if (!this->colony_file.good()) {
+            return;
+        }
+        std::string colony_text;
+        for (const TelemetryRow &row: rows) {
+            if (row.colony_tick == this->last_colony_tick) {
+                continue;
+            }
+            this->last_colony_tick = row.colony_tick;
+            for (size_t colony = 0; colony < row.colonies.size(); colony++) {
+                const Colony &written = row.colonies[colony];
+                colony_text += std::format("{},{},{},{:.6g},{:.6g},{:.6g}\n", row.colony_tick, colony, written.size, written.centroid.x, written.centroid.y, written.radius);
+            }
+        }
+        this->colony_file << colony_text;
+        this->colony_file.flush();
+    }
+
+    void on_shutdown() override {
+        this->write_pending();
+    }
+
+    void on_panic() override {
+
+    }
+
+    void signal_shutdown() override {
+        this->should_shutdown.store(true);
+
+        //release all semaphores
+        this->write_notifier.release();
+    }
+
+    void signal_panic() override {
+        this->should_panic.store(true);
+
+        //release all semaphores
+        this->write_notifier.release();
+    }
+
+    [[nodiscard]] constexpr float warning_loop_second_threshold() const override {
+        return -1; // Disabled, waits for rows
+    }
+
+    [[nodiscard]] constexpr float critical_loop_second_threshold() const override {
+        return -1; // Disabled, waits for rows
+    }
+
+public:
+    /**
+     * @param path CSV file to write, replaced if it exists
+     */
+    explicit TelemetrySubsystem(std::filesystem::path path): path(std::move(path)) {
+
+    }
+
+    ~TelemetrySubsystem() = default;
+
+    /**
+     * Queue a row to be written
+     */
+    void submit(const TelemetryRow &row) {
+        {
+            std::lock_guard<std::mutex> guard(this->pending_lock);
+            this->pending.push_back(row);
+        }
+        this->write_notifier.release();
+    }
+
+    [[nodiscard]] constexpr std::string id() const override {
+        return "Telemetry Subsystem";
+    }
+};
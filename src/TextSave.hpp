@@ -0,0 +1,377 @@
+#pragma once
+
+
+#include <charconv>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <filesystem>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <format>
+#include <algorithm>
+
+
+#include "Cell.hpp"
+#include "Egg.hpp"
+#include "Food.hpp"
+#include "Logging.hpp"
+
+
+constexpr bool PARALLEL_TEXT_LOADING = true; // Parse legacy text saves on every core instead of value by value through iostreams
+constexpr size_t TEXT_SAVE_CHUNK_SIZE = 1 << 20; // Bytes of a text save file handled per task
+
+
+/*
+ * Legacy text saves store one value per whitespace separated token, and every record of a file has the same number
+ * of tokens. A file is read in one go and split into chunks that each start right after whitespace, so no token
+ * straddles two chunks. Loading runs two parallel passes over the chunks of every file at once:
+ *   1. count the tokens of each chunk, the running total gives every chunk's first token index
+ *   2. parse each record whose first token falls in the chunk, reading on into the next chunk when it ends there
+ * Records are written into their slot by index, so the loaded entities keep the order of the file.
+ */
+
+
+/**
+ * Same whitespace as the "C" locale that the iostream loader skips
+ */
+[[nodiscard]] constexpr bool is_text_save_space(const char character) {
+    return character == ' ' or character == '\n' or character == '\t' or character == '\r' or character == '\v' or character == '\f';
+}
+
+/**
+ * Run every task once, spread over the hardware threads
+ */
+void run_in_parallel(const std::vector<std::function<void()>> &tasks) {
+    std::atomic<size_t> next_task = 0;
+    const auto work = [&tasks, &next_task]() {
+        for (size_t task = next_task++; task < tasks.size(); task = next_task++) {
+            tasks[task]();
+        }
+    };
+    const size_t thread_count = std::min((size_t) std::max(std::thread::hardware_concurrency(), 1U), tasks.size());
+    std::vector<std::thread> threads;
+    for (size_t thread_index = 1; thread_index < thread_count; thread_index++) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+}
+
+
+/**
+ * Reads whitespace separated values out of a text save buffer with std::from_chars
+ * Every read fails on a token that is not entirely one value, like the iostream loader's failbit
+ */
+class TextScanner {
+private:
+    const char* position;
+    const char* end;
+
+    [[nodiscard]] std::string_view next_token() {
+        while (this->position < this->end and is_text_save_space(*this->position)) {
+            this->position++;
+        }
+        const char* start = this->position;
+        while (this->position < this->end and !is_text_save_space(*this->position)) {
+            this->position++;
+        }
+        // from_chars does not take the leading plus that iostreams accept
+        if (this->position - start > 1 and *start == '+' and *(start + 1) != '-') {
+            start++;
+        }
+        return {start, (size_t) (this->position - start)};
+    }
+
+public:
+    TextScanner(const char* _position, const char* _end) {
+        this->position = _position;
+        this->end = _end;
+    }
+
+    void skip(size_t count) {
+        while (count-- > 0) {
+            (void) this->next_token();
+        }
+    }
+
+    template<typename Value> [[nodiscard]] bool read(Value &value) {
+        const std::string_view token = this->next_token();
+        const std::from_chars_result result = std::from_chars(token.data(), token.data() + token.size(), value);
+        return !token.empty() and result.ec == std::errc() and result.ptr == token.data() + token.size();
+    }
+
+    /**
+     * Booleans are written as 0 or 1
+     */
+    [[nodiscard]] bool read(bool &value) {
+        unsigned int number;
+        if (!this->read(number) or number > 1) {
+            return false;
+        }
+        value = number == 1;
+        return true;
+    }
+
+    [[nodiscard]] bool read(float* values, const size_t count) {
+        for (size_t index = 0; index < count; index++) {
+            if (!this->read(values[index])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Genome in the order DNA's operator<< writes it, converted to the order of DNA::export_genes()
+     */
+    [[nodiscard]] std::shared_ptr<DNA_t> read_dna() {
+        float genes[DNA_t::gene_count()];
+        if (!this->read(genes, 6) or !this->read(genes[6]) or !this->read(genes[8]) or !this->read(genes[7])) {
+            return nullptr;
+        }
+        if (!this->read(genes + 9, DNA_t::gene_count() - 9)) {
+            return nullptr;
+        }
+        return std::make_shared<DNA_t>(genes);
+    }
+
+    /**
+     * Cell in the order of CellRecord's operator<<, the brain is built from the saved parameters like Cell's operator>>
+     */
+    [[nodiscard]] Cell* read_cell() {
+        CellRecord record;
+        float brain_parameters[Network_t::get_parameter_count()];
+        float first_energy;
+        bool valid = this->read(record.id) and this->read(record.radius) and this->read(record.position.x) and this->read(record.position.y);
+        valid = valid and this->read(first_energy) and this->read(record.base_energy) and this->read(record.age);
+        if (!valid) {
+            return nullptr;
+        }
+        record.dna = this->read_dna();
+        if (record.dna == nullptr or !this->read(brain_parameters, Network_t::get_parameter_count())) {
+            return nullptr;
+        }
+        std::copy(brain_parameters, brain_parameters + Network_t::get_value_count(), record.brain_values.begin());
+        // energy is written twice, the second one is kept
+        valid = this->read(record.velocity.x) and this->read(record.velocity.y) and this->read(record.angle) and this->read(record.health);
+        valid = valid and this->read(record.energy) and this->read(record.waste);
+        valid = valid and this->read(record.memory1) and this->read(record.memory2) and this->read(record.memory3);
+        valid = valid and this->read(record.want_lay_egg) and this->read(record.want_eat) and this->read(record.want_stab);
+        valid = valid and this->read(record.sensor.hit_distance) and this->read(record.sensor.hit_red) and this->read(record.sensor.hit_green) and this->read(record.sensor.hit_blue);
+        valid = valid and this->read(record.stomach.plant_calories) and this->read(record.stomach.meat_calories);
+        if (!valid) {
+            return nullptr;
+        }
+        return new Cell(record, new Network_t(brain_parameters));
+    }
+
+    [[nodiscard]] Egg* read_egg() {
+        EggRecord record;
+        const bool valid = this->read(record.id) and this->read(record.radius) and this->read(record.position.x) and this->read(record.position.y)
+                and this->read(record.energy) and this->read(record.age) and this->read(record.hatched);
+        if (!valid) {
+            return nullptr;
+        }
+        record.dna = this->read_dna();
+        if (record.dna == nullptr) {
+            return nullptr;
+        }
+        return new Egg(record);
+    }
+
+    template<typename FoodKind> [[nodiscard]] Food* read_food() {
+        FoodRecord record;
+        const bool valid = this->read(record.id) and this->read(record.radius) and this->read(record.position.x) and this->read(record.position.y)
+                and this->read(record.calories) and this->read(record.consumed);
+        if (!valid) {
+            return nullptr;
+        }
+        return new FoodKind(record);
+    }
+};
+
+
+/**
+ * One file of a text save, loaded into a list of entities in file order
+ */
+template<typename Entity> class TextSaveFile {
+private:
+    std::filesystem::path path;
+    std::string text;
+    size_t record_token_count;
+    Entity* (TextScanner::*read_record)();
+    std::vector<size_t> chunk_starts; // Byte offsets, with the end of the text last
+    std::vector<size_t> chunk_first_tokens; // Token index of each chunk's first token, with the total last
+    std::vector<Entity*> entities;
+
+public:
+    /**
+     * @param _record_token_count Tokens in every record of this file
+     * @param _read_record Parses one record, nullptr when it is malformed
+     */
+    TextSaveFile(std::filesystem::path _path, const size_t _record_token_count, Entity* (TextScanner::*_read_record)()) {
+        this->path = std::move(_path);
+        this->record_token_count = _record_token_count;
+        this->read_record = _read_record;
+    }
+
+    ~TextSaveFile() {
+        for (Entity* entity: this->entities) {
+            delete entity;
+        }
+    }
+
+    /**
+     * Read the whole file and split it into chunks, a missing file has no records like with the iostream loader
+     */
+    void read() {
+        std::ifstream file(this->path, std::ios::in | std::ios::binary);
+        if (file.is_open()) {
+            this->text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+        size_t start = 0;
+        while (start < this->text.size()) {
+            this->chunk_starts.push_back(start);
+            start = std::min(start + TEXT_SAVE_CHUNK_SIZE, this->text.size());
+            while (start < this->text.size() and !is_text_save_space(this->text[start - 1])) {
+                start++;
+            }
+        }
+        this->chunk_starts.push_back(this->text.size());
+        this->chunk_first_tokens.assign(this->chunk_starts.size(), 0);
+    }
+
+    [[nodiscard]] size_t get_chunk_count() const {
+        return this->chunk_starts.size() - 1;
+    }
+
+    /**
+     * First pass, stores the token count of a chunk until count_records() turns it into a running total
+     */
+    void count_tokens(const size_t chunk) {
+        size_t count = 0;
+        bool in_token = false;
+        for (size_t index = this->chunk_starts[chunk]; index < this->chunk_starts[chunk + 1]; index++) {
+            const bool is_space = is_text_save_space(this->text[index]);
+            count += !is_space and !in_token;
+            in_token = !is_space;
+        }
+        this->chunk_first_tokens[chunk + 1] = count;
+    }
+
+    /**
+     * Between the passes, sizes the entity list
+     * The iostream loader only keeps records it read without reaching the end of the file, so a file that does not
+     * end in whitespace loses its last record there and here alike
+     */
+    void count_records() {
+        for (size_t chunk = 0; chunk < this->get_chunk_count(); chunk++) {
+            this->chunk_first_tokens[chunk + 1] += this->chunk_first_tokens[chunk];
+        }
+        const size_t token_count = this->chunk_first_tokens.back();
+        size_t record_count = token_count / this->record_token_count;
+        if (record_count > 0 and token_count % this->record_token_count == 0 and !is_text_save_space(this->text.back())) {
+            record_count--;
+        }
+        this->entities.assign(record_count, nullptr);
+    }
+
+    /**
+     * Second pass, parses every record that starts in a chunk
+     */
+    void parse_records(const size_t chunk) {
+        const size_t first_token = this->chunk_first_tokens[chunk];
+        const size_t end_token = this->chunk_first_tokens[chunk + 1];
+        size_t record = (first_token + this->record_token_count - 1) / this->record_token_count;
+        if (record >= this->entities.size() or record * this->record_token_count >= end_token) {
+            return;
+        }
+        TextScanner scanner(this->text.data() + this->chunk_starts[chunk], this->text.data() + this->text.size());
+        scanner.skip(record * this->record_token_count - first_token);
+        while (record < this->entities.size() and record * this->record_token_count < end_token) {
+            this->entities[record] = (scanner.*this->read_record)();
+            if (this->entities[record] == nullptr) {
+                // the rest of the chunk is not aligned to records anymore
+                return;
+            }
+            record++;
+        }
+    }
+
+    /**
+     * Hand over the entities up to the first malformed record, which the iostream loader would get stuck on
+     */
+    [[nodiscard]] std::vector<Entity*> take_entities() {
+        const typename std::vector<Entity*>::iterator malformed = std::find(this->entities.begin(), this->entities.end(), nullptr);
+        if (malformed != this->entities.end()) {
+            Log::get_instance().log(Log::CRITICAL, "TextSave", std::format("Record {} of {} is malformed, only the records before it are loaded", malformed - this->entities.begin(), this->path.string()));
+            for (typename std::vector<Entity*>::iterator entity = malformed; entity != this->entities.end(); entity++) {
+                delete *entity;
+            }
+            this->entities.erase(malformed, this->entities.end());
+        }
+        std::vector<Entity*> taken;
+        taken.swap(this->entities);
+        return taken;
+    }
+};
+
+
+/**
+ * Cells, eggs, plants and meats of a legacy text save, parsed in parallel
+ * The entities are only constructed here, adding them to a simulation is up to the caller
+ */
+class TextSave {
+public:
+    std::vector<Cell*> cells;
+    std::vector<Egg*> eggs;
+    std::vector<Food*> plants;
+    std::vector<Food*> meats;
+
+    void load(const std::filesystem::path &directory) {
+        constexpr size_t egg_token_count = 7 + DNA_t::gene_count();
+        constexpr size_t cell_token_count = 7 + DNA_t::gene_count() + Network_t::get_parameter_count() + 18;
+        constexpr size_t food_token_count = 6;
+        TextSaveFile<Cell> cell_file(directory / "cells", cell_token_count, &TextScanner::read_cell);
+        TextSaveFile<Egg> egg_file(directory / "eggs", egg_token_count, &TextScanner::read_egg);
+        TextSaveFile<Food> plant_file(directory / "plants", food_token_count, &TextScanner::read_food<Plant>);
+        TextSaveFile<Food> meat_file(directory / "meats", food_token_count, &TextScanner::read_food<Meat>);
+
+        run_in_parallel({
+                [&cell_file]() { cell_file.read(); },
+                [&egg_file]() { egg_file.read(); },
+                [&plant_file]() { plant_file.read(); },
+                [&meat_file]() { meat_file.read(); },
+        });
+
+        std::vector<std::function<void()>> counts;
+        std::vector<std::function<void()>> parses;
+        const auto add_tasks = [&counts, &parses]<typename Entity>(TextSaveFile<Entity> &file) {
+            for (size_t chunk = 0; chunk < file.get_chunk_count(); chunk++) {
+                counts.emplace_back([&file, chunk]() { file.count_tokens(chunk); });
+                parses.emplace_back([&file, chunk]() { file.parse_records(chunk); });
+            }
+        };
+        add_tasks(cell_file);
+        add_tasks(egg_file);
+        add_tasks(plant_file);
+        add_tasks(meat_file);
+
+        run_in_parallel(counts);
+        cell_file.count_records();
+        egg_file.count_records();
+        plant_file.count_records();
+        meat_file.count_records();
+        run_in_parallel(parses);
+
+        this->cells = cell_file.take_entities();
+        this->eggs = egg_file.take_entities();
+        this->plants = plant_file.take_entities();
+        this->meats = meat_file.take_entities();
+    }
+};
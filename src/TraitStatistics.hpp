@@ -0,0 +1,189 @@
+#pragma once
+
+
+#include <raylib.h>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <format>
+
+
+#include "DNA.hpp"
+#include "Cell.hpp"
+#include "Telemetry.hpp"
+#include "Logging.hpp"
+
+
+constexpr bool VERIFY_TRAIT_STATISTICS = false; // Recount the traits every TRAIT_VERIFY_PERIOD ticks and log any drift
+constexpr unsigned long TRAIT_VERIFY_PERIOD = 1000;
+constexpr unsigned int TRAIT_HISTOGRAM_BINS = 32;
+
+enum Trait {
+    RADIUS_TRAIT,
+    DIET_TRAIT,
+    SPEED_TRAIT,
+    VISION_TRAIT,
+    EGG_TRANSFER_TRAIT,
+    METABOLISM_TRAIT,
+    RED_TRAIT,
+    GREEN_TRAIT,
+    BLUE_TRAIT,
+    TRAIT_COUNT
+};
+
+constexpr const char* TRAIT_NAMES[TRAIT_COUNT] = {"radius", "diet", "speed", "vision", "egg transfer", "metabolism", "red", "green", "blue"};
+
+// Span of each histogram, values outside of it are counted in the first or last bin
+const Range TRAIT_HISTOGRAM_RANGES[TRAIT_COUNT] = {RADIUS_RANGE, DIET_RANGE, SPEED_RANGE, VISION_RANGE, EGG_ENERGY_TRANSFER_RANGE,
+                                                  Range(0.0f, 0.02f), COLOR_RANGE, COLOR_RANGE, COLOR_RANGE}; // metabolism stays far below the top of METABOLISM_RANGE
+
+
+/**
+ * Sums and histograms of the genome traits of the living cells, kept up to date as cells are added and removed
+ * Adding or removing a cell touches a fixed number of counters, so the statistics can be read at any time for free.
+ * Sums are taken around the middle of each histogram range so the variance doesn't lose precision to large means,
+ * the histograms count exactly.
+ */
+class TraitStatistics {
+private:
+    uint64_t count = 0;
+    double sums[TRAIT_COUNT] = {};
+    double squared_sums[TRAIT_COUNT] = {};
+    uint32_t histograms[TRAIT_COUNT][TRAIT_HISTOGRAM_BINS] = {};
+
+    static void read_traits(const DNA_t* dna, float (&traits)[TRAIT_COUNT]) {
+        traits[RADIUS_TRAIT] = dna->radius;
+        traits[DIET_TRAIT] = dna->diet;
+        traits[SPEED_TRAIT] = dna->speed;
+        traits[VISION_TRAIT] = dna->vision_range;
+        traits[EGG_TRANSFER_TRAIT] = dna->egg_energy_transfer;
+        traits[METABOLISM_TRAIT] = dna->metabolism;
+        traits[RED_TRAIT] = dna->red;
+        traits[GREEN_TRAIT] = dna->green;
+        traits[BLUE_TRAIT] = dna->blue;
+    }
+
+    [[nodiscard]] static unsigned int bin_of(const unsigned int trait, const float value) {
+        const Range &range = TRAIT_HISTOGRAM_RANGES[trait];
+        const float bin = (value - range.min) / (range.max - range.min) * (float) TRAIT_HISTOGRAM_BINS;
+        return (unsigned int) std::clamp(bin, 0.0f, (float) (TRAIT_HISTOGRAM_BINS - 1));
+    }
+
+    /**
+     * @param sign 1 to add the genome, -1 to remove it
+     */
+    void apply(const DNA_t* dna, const int sign) {
+        float traits[TRAIT_COUNT];
+        TraitStatistics::read_traits(dna, traits);
+        this->count += sign;
+        for (unsigned int trait = 0; trait < TRAIT_COUNT; trait++) {
+            const double centered = (double) traits[trait] - (double) TRAIT_HISTOGRAM_RANGES[trait].get_average();
+            this->sums[trait] += sign * centered;
+            this->squared_sums[trait] += sign * centered * centered;
+            this->histograms[trait][TraitStatistics::bin_of(trait, traits[trait])] += sign;
+        }
+    }
+
+public:
+    /**
+     * Count a cell that joined the population
+     */
+    void add(const DNA_t* dna) {
+        this->apply(dna, 1);
+    }
+
+    /**
+     * Stop counting a cell, only with the genome it was added with
+     */
+    void remove(const DNA_t* dna) {
+        this->apply(dna, -1);
+    }
+
+    /**
+     * Count a whole population from scratch
+     */
+    void rebuild(const std::vector<Cell*> &cells) {
+        *this = TraitStatistics();
+        for (const Cell* cell: cells) {
+            this->add(cell->get_dna().get());
+        }
+    }
+
+    /**
+     * Compare against a recount of the population
+     * @param description What differs, when something does
+     * @return Whether counts and histograms match exactly and means and variances within rounding
+     */
+    [[nodiscard]] bool verify(const std::vector<Cell*> &cells, std::string &description) const {
+        TraitStatistics recount;
+        recount.rebuild(cells);
+        if (recount.count != this->count) {
+            description = std::format("{} cells counted, {} living", this->count, recount.count);
+            return false;
+        }
+        for (unsigned int trait = 0; trait < TRAIT_COUNT; trait++) {
+            const double width = TRAIT_HISTOGRAM_RANGES[trait].max - TRAIT_HISTOGRAM_RANGES[trait].min;
+            if (!std::equal(recount.histograms[trait], recount.histograms[trait] + TRAIT_HISTOGRAM_BINS, this->histograms[trait])) {
+                description = std::format("{} histogram differs from a recount", TRAIT_NAMES[trait]);
+                return false;
+            }
+            if (std::abs(recount.get_mean(trait) - this->get_mean(trait)) > 1e-9 * width or std::abs(recount.get_variance(trait) - this->get_variance(trait)) > 1e-9 * width * width) {
+                description = std::format("{} mean {} and variance {} drifted from {} and {}", TRAIT_NAMES[trait], this->get_mean(trait), this->get_variance(trait), recount.get_mean(trait), recount.get_variance(trait));
+                return false;
+            }
+        }
+        return true;
+    }
+
+    [[nodiscard]] uint64_t get_count() const {
+        return this->count;
+    }
+
+    [[nodiscard]] double get_mean(const unsigned int trait) const {
+        return this->count == 0 ? 0.0 : TRAIT_HISTOGRAM_RANGES[trait].get_average() + this->sums[trait] / (double) this->count;
+    }
+
+    [[nodiscard]] double get_variance(const unsigned int trait) const {
+        if (this->count == 0) {
+            return 0.0;
+        }
+        const double centered_mean = this->sums[trait] / (double) this->count;
+        return std::max(this->squared_sums[trait] / (double) this->count - centered_mean * centered_mean, 0.0);
+    }
+
+    [[nodiscard]] Moments get_moments(const unsigned int trait) const {
+        return {(double) this->count, this->get_mean(trait), this->get_variance(trait) * (double) this->count};
+    }
+
+    /**
+     * Cells per bin, the bins split TRAIT_HISTOGRAM_RANGES evenly
+     */
+    [[nodiscard]] const uint32_t* get_histogram(const unsigned int trait) const {
+        return this->histograms[trait];
+    }
+
+    /**
+     * Mean, spread and histogram of every trait, in the top right corner
+     */
+    void draw_panel() const {
+        const float bar_width = 3.0f;
+        const float bar_height = 24.0f;
+        const float panel_width = 120.0f + TRAIT_HISTOGRAM_BINS * bar_width;
+        Vector2 position = {(float) GetScreenWidth() - panel_width - 10.0f, 40.0f};
+        DrawTextEx(GetFontDefault(), TextFormat("Traits of %llu cells", (unsigned long long) this->count), position, FONT_SIZE, 1, WHITE);
+        position.y += 15;
+        for (unsigned int trait = 0; trait < TRAIT_COUNT; trait++) {
+            const uint32_t* histogram = this->histograms[trait];
+            const uint32_t tallest = std::max(*std::max_element(histogram, histogram + TRAIT_HISTOGRAM_BINS), 1u);
+            DrawTextEx(GetFontDefault(), TextFormat("%s", TRAIT_NAMES[trait]), position, FONT_SIZE, 1, WHITE);
+            DrawTextEx(GetFontDefault(), TextFormat("%.4g +- %.3g", this->get_mean(trait), std::sqrt(this->get_variance(trait))), {position.x, position.y + 11}, FONT_SIZE, 1, GRAY);
+            for (unsigned int bin = 0; bin < TRAIT_HISTOGRAM_BINS; bin++) {
+                const float height = bar_height * (float) histogram[bin] / (float) tallest;
+                DrawRectangleV({position.x + 120.0f + bin * bar_width, position.y + bar_height - height}, {bar_width - 1.0f, height}, SKYBLUE);
+            }
+            position.y += bar_height + 6;
+        }
+    }
+};
@@ -1,12 +1,331 @@
 #include "Manager.hpp"
 
 
-void run() {
-    Manager manager;
+constexpr std::string DEFAULT_SAVE_NAME = "unstable95"; // Loaded when no save is chosen on the command line
+
+
+void run(const std::string &save_path, const RunOptions &options) {
+    Manager manager(save_path, options);
     manager.run();
 }
 
-int main() {
-    run();
+/**
+ * Watch a recorded replay, see --record
+ * @return Exit code
+ */
+int play(const std::string &replay_path) {
+    ReplayPlayer player;
+    if (!player.open(replay_path)) {
+        std::cout << std::format("{} is not a replay of this version and world size\n", replay_path);
+        return 1;
+    }
+    ManagerSignals::control.reset();
+    Simulation simulation; // Empty, only there for the renderer's references
+
+    std::stack<std::shared_ptr<Subsystem>> subsystems;
+    subsystems.push(std::make_shared<LoggingSubsystem>());
+    subsystems.top()->run_thread();
+    std::shared_ptr<RenderSubsystem> render_subsystem = std::make_shared<RenderSubsystem>(simulation.get_cells(), simulation.get_eggs(), simulation.get_foods(), simulation.get_nutrients());
+    render_subsystem->set_replay(&player);
+    subsystems.push(render_subsystem);
+    render_subsystem->run_thread();
+
+    while (!ManagerSignals::control.should_shutdown() and !ManagerSignals::control.should_panic()) {
+        player.advance(!ManagerSignals::control.is_paused());
+        render_subsystem->render_notifier.release();
+        render_subsystem->finished_render_notifier.acquire();
+    }
+
+    while (!subsystems.empty()) {
+        subsystems.top()->signal_shutdown();
+        subsystems.top()->thread_join();
+        subsystems.pop();
+    }
+    return 0;
+}
+
+/**
+ * @return Whether text was a whole unsigned number
+ */
+bool parse_count(const std::string &text, uint64_t &value) {
+    const std::from_chars_result result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return !text.empty() and result.ec == std::errc() and result.ptr == text.data() + text.size();
+}
+
+/**
+ * @return Whether text was a number and nothing else
+ */
+bool parse_number(const std::string &text, float &value) {
+    const std::from_chars_result result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return !text.empty() and result.ec == std::errc() and result.ptr == text.data() + text.size();
+}
+
+/**
+ * Print the saves matching the filter options, straight from their manifests
+ * @param options Pairs of --name, --format, --min-ticks, --max-ticks, --min-cells or --max-cells and their value
+ * @return Exit code
+ */
+int list_saves(const std::vector<std::string> &options) {
+    SaveFilter filter;
+    for (size_t index = 0; index < options.size(); index += 2) {
+        const std::string &option = options[index];
+        if (index + 1 >= options.size()) {
+            std::cout << std::format("{} needs a value\n", option);
+            return 1;
+        }
+        const std::string &value = options[index + 1];
+        bool valid = true;
+        if (option == "--name") {
+            filter.name = value;
+        }
+        else if (option == "--format") {
+            filter.any_format = false;
+            valid = false;
+            for (const SaveFormat format: {TEXT_SAVE_FORMAT, BINARY_SAVE_FORMAT, CHAIN_SAVE_FORMAT}) {
+                if (value == save_format_name(format)) {
+                    filter.format = format;
+                    valid = true;
+                }
+            }
+        }
+        else if (option == "--min-ticks") {
+            valid = parse_count(value, filter.min_ticks);
+        }
+        else if (option == "--max-ticks") {
+            valid = parse_count(value, filter.max_ticks);
+        }
+        else if (option == "--min-cells") {
+            valid = parse_count(value, filter.min_cells);
+        }
+        else if (option == "--max-cells") {
+            valid = parse_count(value, filter.max_cells);
+        }
+        else {
+            std::cout << std::format("Unknown filter {}\n", option);
+            return 1;
+        }
+        if (!valid) {
+            std::cout << std::format("Invalid value {} for {}\n", value, option);
+            return 1;
+        }
+    }
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const std::vector<SaveCatalogEntry> entries = SaveCatalog::scan(SAVES_PATH, filter);
+    const float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    for (const SaveCatalogEntry &entry: entries) {
+        const SaveManifest &manifest = entry.manifest;
+        const std::chrono::sys_seconds created{std::chrono::seconds(manifest.creation_time)};
+        std::cout << std::format("{}  {} v{}  {:%F %T}  {:.1f} MB", entry.name, save_format_name(entry.get_format()), manifest.format_version, created, (float) manifest.byte_size / 1e6f);
+        if (!entry.has_manifest) {
+            std::cout << "  (no manifest)\n";
+            continue;
+        }
+        if (manifest.checkpoint_count > 0) {
+            std::cout << std::format("  {} checkpoints", manifest.checkpoint_count);
+        }
+        std::cout << std::format("  tick {}  cells {}  eggs {}  plants {}  meats {}", manifest.tick_count, manifest.cell_count, manifest.egg_count, manifest.plant_count, manifest.meat_count);
+        for (unsigned int trait = 0; trait < MANIFEST_TRAIT_COUNT; trait++) {
+            std::cout << std::format("  {} {:.2f}", MANIFEST_TRAIT_NAMES[trait], manifest.traits[trait].mean);
+        }
+        std::cout << "\n";
+    }
+    std::cout << std::format("{} saves listed in {:.1f} ms\n", entries.size(), seconds * 1000.0f);
+    return 0;
+}
+
+/**
+ * Print where a cell or egg came from and how its family went on, see --log-lineage
+ * @return Exit code
+ */
+int lineage(const std::string &lineage_path, const std::string &subject_text) {
+    uint64_t subject;
+    if (!parse_count(subject_text, subject)) {
+        std::cout << std::format("Invalid id {}\n", subject_text);
+        return 1;
+    }
+    LineageReader reader;
+    if (!reader.open(lineage_path)) {
+        std::cout << std::format("{} is not a lineage log of this version\n", lineage_path);
+        return 1;
+    }
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const std::vector<LineageEvent> ancestry = reader.ancestry(subject);
+    for (const LineageEvent &birth: ancestry) {
+        if (birth.type == HATCHED) {
+            std::cout << std::format("tick {}  cell {} hatched from egg {}\n", birth.tick, birth.subject, birth.other);
+        }
+        else {
+            std::cout << std::format("tick {}  egg {} laid by cell {}\n", birth.tick, birth.subject, birth.other);
+        }
+    }
+    const uint64_t root = ancestry.empty() ? subject : ancestry.back().other;
+    std::cout << std::format("{} has no logged birth, {} generations back from {}\n", root, std::count_if(ancestry.begin(), ancestry.end(), [](const LineageEvent &birth) { return birth.type == HATCHED; }), subject);
+    LineageEvent death;
+    if (reader.find_death(subject, death)) {
+        std::cout << std::format("{} died at tick {}{}\n", subject, death.tick, death.other == 0 ? "" : std::format(", stabbed by cell {}", death.other));
+    }
+
+    uint64_t eggs = 0;
+    uint64_t cells = 0;
+    uint64_t deaths = 0;
+    uint64_t kills = 0;
+    uint32_t generations = 0;
+    reader.descendants(subject, [&](const LineageEvent &event, const uint32_t generation) {
+        eggs += event.type == EGG_LAID ? 1 : 0;
+        cells += event.type == HATCHED ? 1 : 0;
+        deaths += event.type == DIED ? 1 : 0;
+        kills += event.type == DIED and event.other != 0 ? 1 : 0;
+        generations = std::max(generations, generation);
+    });
+    const float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::format("Descendants: {} eggs, {} cells over {} generations, {} died ({} stabbed)\n", eggs, cells, generations, deaths, kills);
+    std::cout << std::format("{} events searched in {:.1f} ms\n", reader.get_event_count(), seconds * 1000.0f);
+    return 0;
+}
+
+/**
+ * Load one save and run the simulation on it
+ * @param name See SaveCatalog::resolve()
+ * @return Exit code
+ */
+int load(const std::string &name, const RunOptions &options) {
+    std::filesystem::path save_path;
+    if (!SaveCatalog::resolve(SAVES_PATH, name, save_path)) {
+        std::cout << std::format("No save {} in {}, see --list-saves\n", name, SAVES_PATH);
+        return 1;
+    }
+    run(save_path.string(), options);
+    return 0;
+}
+
+/**
+ * Write one checkpoint of a chain out as a standalone save
+ * @param checkpoint Sequence number or "latest"
+ * @return Exit code
+ */
+int materialize(const std::string& chain_path, const std::string& checkpoint, const std::string& output_path) {
+    const std::vector<uint64_t> checkpoints = list_checkpoints(chain_path);
+    if (checkpoints.empty()) {
+        std::cout << std::format("{} has no checkpoints\n", chain_path);
+        return 1;
+    }
+    uint64_t sequence = checkpoints.back();
+    if (checkpoint != "latest") {
+        if (checkpoint.empty() or !std::all_of(checkpoint.begin(), checkpoint.end(), ::isdigit)) {
+            std::cout << std::format("Checkpoint must be a number or \"latest\", got {}\n", checkpoint);
+            return 1;
+        }
+        sequence = std::stoull(checkpoint);
+    }
+    Snapshot snapshot;
+    if (!materialize_checkpoint(chain_path, sequence, snapshot)) {
+        std::cout << std::format("Could not materialize checkpoint {} of {}\n", sequence, chain_path);
+        return 1;
+    }
+    std::atomic<size_t> written = 0;
+    if (std::filesystem::exists(output_path) or !snapshot.write_atomically(output_path, written)) {
+        std::cout << std::format("Could not write {}, it must not exist yet\n", output_path);
+        return 1;
+    }
+    std::cout << std::format("Wrote checkpoint {} ({} records) to {}\n", sequence, snapshot.get_record_count(), output_path);
+    return 0;
+}
+
+/**
+ * Time the brain kernels on this machine and print the density BRAIN_SPARSE_DENSITY_THRESHOLD should be set to
+ * @return Exit code
+ */
+int calibrate_brain() {
+    if (!BRAIN_PRUNING) {
+        std::cout << "Brain pruning is off, there is no sparse kernel to calibrate\n";
+        return 1;
+    }
+    std::cout << std::format("Sparse brain kernel is faster below {} weight density, BRAIN_SPARSE_DENSITY_THRESHOLD is {}\n", Network_t::calibrate_sparse_density_threshold(), BRAIN_SPARSE_DENSITY_THRESHOLD);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const std::vector<std::string> arguments(argv + 1, argv + argc);
+    if (arguments.size() == 4 and arguments[0] == "--materialize") {
+        return materialize(arguments[1], arguments[2], arguments[3]);
+    }
+    if (arguments.size() == 1 and arguments[0] == "--calibrate-brain") {
+        return calibrate_brain();
+    }
+    if (!arguments.empty() and arguments[0] == "--list-saves") {
+        return list_saves({arguments.begin() + 1, arguments.end()});
+    }
+    if (arguments.size() == 2 and arguments[0] == "--replay") {
+        return play(arguments[1]);
+    }
+    if (arguments.size() == 3 and arguments[0] == "--lineage") {
+        return lineage(arguments[1], arguments[2]);
+    }
+    std::string save_name;
+    RunOptions options;
+    std::string resume;
+    bool valid = arguments.size() % 2 == 0;
+    for (size_t index = 0; valid and index < arguments.size(); index += 2) {
+        if (arguments[index] == "--load") {
+            save_name = arguments[index + 1];
+        }
+        else if (arguments[index] == "--record") {
+            options.replay_path = arguments[index + 1];
+        }
+        else if (arguments[index] == "--log-lineage") {
+            options.lineage_path = arguments[index + 1];
+        }
+        else if (arguments[index] == "--telemetry") {
+            options.telemetry_path = arguments[index + 1];
+        }
+        else if (arguments[index] == "--telemetry-period") {
+            uint64_t period;
+            valid = parse_count(arguments[index + 1], period) and period > 0;
+            options.telemetry_period = period;
+        }
+        else if (arguments[index] == "--colony-distance") {
+            valid = parse_number(arguments[index + 1], options.colony_distance) and options.colony_distance > 0;
+        }
+        else if (arguments[index] == "--step") {
+            uint64_t ticks;
+            valid = parse_count(arguments[index + 1], ticks);
+            options.step_ticks = ticks;
+        }
+        else if (arguments[index] == "--fast-forward") {
+            uint64_t ticks;
+            valid = parse_count(arguments[index + 1], ticks);
+            options.fast_forward_ticks = ticks;
+        }
+        else if (arguments[index] == "--resume") {
+            resume = arguments[index + 1];
+            valid = resume == "exact" or resume == "progressive";
+        }
+        else if (arguments[index] == "--run-until") {
+            uint64_t tick;
+            valid = parse_count(arguments[index + 1], tick) and tick > 0;
+            options.run_until_tick = tick;
+        }
+        else {
+            valid = false;
+        }
+    }
+    // a recorded replay should match the run it is compared with, so it waits for the whole save by default
+    options.exact_resume = resume.empty() ? !options.replay_path.empty() : resume == "exact";
+    if (!valid) {
+        std::cout << "Usage: MeatColony [--load <save|latest>] [--record <replay file>] [--log-lineage <lineage log>]\n"
+                     "                  [--telemetry <csv file>] [--telemetry-period <ticks>] [--colony-distance <distance>]\n"
+                     "                  [--step <ticks>] [--fast-forward <ticks>] [--run-until <tick>] [--resume exact|progressive]\n"
+                     "       MeatColony --replay <replay file>\n"
+                     "       MeatColony --calibrate-brain\n"
+                     "       MeatColony --lineage <lineage log> <cell or egg id>\n"
+                     "       MeatColony --list-saves [--name <part>] [--format text|binary|chain] [--min-ticks n] [--max-ticks n] [--min-cells n] [--max-cells n]\n"
+                     "       MeatColony --materialize <chain directory> <checkpoint|latest> <output save directory>\n";
+        return 1;
+    }
+    if (!save_name.empty()) {
+        return load(save_name, options);
+    }
+    run(SAVES_PATH + "/" + DEFAULT_SAVE_NAME, options);
     return 0;
 }
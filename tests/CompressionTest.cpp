@@ -0,0 +1,148 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <random>
+#include <format>
+
+
+#include "Compression.hpp"
+#include "Checkpoint.hpp"
+
+
+/*
+ * Round trips buffers through the LZ block codec of Compression.hpp and replays a RecordChain over several keyframe
+ * periods the way CheckpointWriter and materialize_checkpoint() use it, with every section going through the codec
+ */
+
+
+constexpr size_t COMPRESSION_TEST_SIZE = 1 << 20;
+constexpr unsigned int CHAIN_TEST_CHECKPOINTS = CHECKPOINT_KEYFRAME_PERIOD * 2 + 3; // Crosses two keyframes
+constexpr unsigned int CHAIN_TEST_FOOD = 2000;
+
+
+/**
+ * @return Whether data decompressed to itself
+ */
+bool round_trip(const char* name, const std::vector<unsigned char> &data) {
+    const std::vector<unsigned char> compressed = lz_compress(data.data(), data.size());
+    std::vector<unsigned char> decompressed(data.size());
+    const bool passed = lz_decompress(compressed.data(), compressed.size(), decompressed.data(), decompressed.size()) and decompressed == data;
+    std::printf("%-44s %9zu -> %9zu bytes %s\n", name, data.size(), compressed.size(), passed ? "ok" : "FAILED");
+    return passed;
+}
+
+/**
+ * Records as they come out of a section written with LZ_ENCODING
+ */
+template<typename Record> [[nodiscard]] bool through_codec(const std::vector<Record> &records, std::vector<Record> &decoded) {
+    const std::vector<unsigned char> compressed = lz_compress(records.data(), records.size() * sizeof(Record));
+    decoded.resize(records.size());
+    return lz_decompress(compressed.data(), compressed.size(), (unsigned char*) decoded.data(), decoded.size() * sizeof(Record));
+}
+
+[[nodiscard]] bool same_records(const std::vector<FoodBinaryRecord> &records, const std::vector<FoodBinaryRecord> &other_records) {
+    return records.size() == other_records.size() and std::memcmp(records.data(), other_records.data(), records.size() * sizeof(FoodBinaryRecord)) == 0;
+}
+
+bool check_codec() {
+    std::mt19937 generator(0);
+    std::vector<unsigned char> random(COMPRESSION_TEST_SIZE);
+    for (unsigned char &byte: random) {
+        byte = (unsigned char) "ACGT"[generator() % 4];
+    }
+    std::vector<unsigned char> incompressible(COMPRESSION_TEST_SIZE);
+    for (unsigned char &byte: incompressible) {
+        byte = (unsigned char) generator();
+    }
+    std::vector<unsigned char> periodic(COMPRESSION_TEST_SIZE);
+    for (size_t index = 0; index < periodic.size(); index++) {
+        periodic[index] = (unsigned char) "abc"[index % 3];
+    }
+    // the second copy is further back than a match offset can reach
+    std::vector<unsigned char> far_repeat(incompressible.begin(), incompressible.begin() + LZ_MAX_OFFSET + 100);
+    far_repeat.insert(far_repeat.end(), incompressible.begin(), incompressible.begin() + 1000);
+
+    bool passed = true;
+    passed = round_trip("empty", {}) and passed;
+    for (size_t size = 1; size <= 2 * LZ_MIN_MATCH + 1; size++) {
+        passed = round_trip(std::format("{} zero bytes", size).c_str(), std::vector<unsigned char>(size, 0)) and passed;
+    }
+    passed = round_trip("random bytes from 4 letters", random) and passed;
+    passed = round_trip("incompressible", incompressible) and passed;
+    passed = round_trip("zeros", std::vector<unsigned char>(COMPRESSION_TEST_SIZE, 0)) and passed;
+    passed = round_trip("period 3, overlapping matches", periodic) and passed;
+    passed = round_trip("repeat past the largest offset", far_repeat) and passed;
+    return passed;
+}
+
+/**
+ * Food that moves, gets eaten and spawns between checkpoints, rebuilt on the reading side from keyframes and deltas
+ */
+bool check_chain() {
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<float> distribution(-100.0f, 100.0f);
+    std::vector<FoodBinaryRecord> foods;
+    uint64_t next_id = 0;
+    const auto spawn = [&]() {
+        foods.push_back({next_id++, 2.0f, {distribution(generator), distribution(generator)}, 16.0f, 0, 0});
+    };
+    for (unsigned int index = 0; index < CHAIN_TEST_FOOD; index++) {
+        spawn();
+    }
+
+    RecordChain<FoodBinaryRecord> written;
+    RecordChain<FoodBinaryRecord> read;
+    unsigned int keyframes = 0;
+    unsigned int deltas = 0;
+    bool passed = true;
+    for (unsigned int sequence = 0; sequence < CHAIN_TEST_CHECKPOINTS; sequence++) {
+        std::vector<FoodBinaryRecord> changed;
+        std::vector<RemovedRecord> removed;
+        std::vector<FoodBinaryRecord> decoded;
+        std::vector<RemovedRecord> decoded_removed;
+        if (sequence % CHECKPOINT_KEYFRAME_PERIOD == 0 or !written.diff(foods, changed, removed)) {
+            passed = through_codec(foods, decoded) and passed;
+            read.set(decoded);
+            keyframes++;
+        }
+        else {
+            passed = through_codec(changed, decoded) and through_codec(removed, decoded_removed) and read.apply(decoded, decoded_removed) and passed;
+            deltas++;
+        }
+        passed = same_records(read.get_records(), foods) and passed;
+        written.set(foods);
+
+        std::vector<FoodBinaryRecord> next;
+        for (FoodBinaryRecord &food: foods) {
+            const unsigned int roll = generator() % 100;
+            if (roll < 5) {
+                continue;
+            }
+            if (roll < 30) {
+                food.position.x += distribution(generator) / 100.0f;
+                food.calories -= 0.5f;
+            }
+            next.push_back(food);
+        }
+        foods = std::move(next);
+        for (unsigned int index = 0; index < CHAIN_TEST_FOOD / 20; index++) {
+            spawn();
+        }
+    }
+
+    // reordered survivors can't be a delta and have to be stored in full
+    std::vector<FoodBinaryRecord> changed;
+    std::vector<RemovedRecord> removed;
+    written.set(std::vector<FoodBinaryRecord>(foods.rbegin(), foods.rend()));
+    passed = !written.diff(foods, changed, removed) and passed;
+
+    std::printf("%-44s %u keyframes, %u deltas %s\n", "food chain across keyframes", keyframes, deltas, passed ? "ok" : "FAILED");
+    return passed;
+}
+
+int main() {
+    const bool codec_passed = check_codec();
+    const bool chain_passed = check_chain();
+    return codec_passed and chain_passed ? 0 : 1;
+}
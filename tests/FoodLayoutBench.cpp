@@ -0,0 +1,149 @@
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <random>
+#include <algorithm>
+#include <functional>
+
+
+#include "Food.hpp"
+
+
+/*
+ * Times the per-food queries of the interaction and render loops on food with its type tag (Food.hpp) against the
+ * virtual dispatch it replaced, rebuilt here as VirtualFood
+ * Food is allocated one by one and visited in shuffled order like the simulation's food list, so the tag lookups pay
+ * the same cache misses as the virtual calls. Both layouts have to give the same answers for every food.
+ */
+
+
+constexpr size_t FOOD_BENCH_COUNT = 200000;
+constexpr unsigned int FOOD_BENCH_REPEATS = 50;
+
+
+/**
+ * The food layout before the type tag, every query is a virtual call
+ */
+class VirtualFood: public Body {
+public:
+    virtual ~VirtualFood() = default;
+    [[nodiscard]] virtual FoodType get_food_type() const = 0;
+    [[nodiscard]] virtual float get_red() const = 0;
+    [[nodiscard]] virtual float get_green() const = 0;
+    [[nodiscard]] virtual float get_blue() const = 0;
+    [[nodiscard]] virtual Color get_color() const = 0;
+};
+
+class VirtualPlant: public VirtualFood {
+public:
+    [[nodiscard]] FoodType get_food_type() const override {
+        return PLANT;
+    }
+    [[nodiscard]] float get_red() const override {
+        return 0.0f;
+    }
+    [[nodiscard]] float get_green() const override {
+        return 255.0f;
+    }
+    [[nodiscard]] float get_blue() const override {
+        return 0.0f;
+    }
+    [[nodiscard]] Color get_color() const override {
+        return GREEN;
+    }
+};
+
+class VirtualMeat: public VirtualFood {
+public:
+    [[nodiscard]] FoodType get_food_type() const override {
+        return MEAT;
+    }
+    [[nodiscard]] float get_red() const override {
+        return 255.0f;
+    }
+    [[nodiscard]] float get_green() const override {
+        return 0.0f;
+    }
+    [[nodiscard]] float get_blue() const override {
+        return 0.0f;
+    }
+    [[nodiscard]] Color get_color() const override {
+        return RED;
+    }
+};
+
+
+/**
+ * What a sensor hit and a draw call read from one food
+ */
+template<typename FoodLike> [[nodiscard]] float query(const FoodLike* food) {
+    const Color color = food->get_color();
+    return food->get_red() + food->get_green() * 2.0f + food->get_blue() * 3.0f + (float) food->get_food_type() + (float) (color.r + color.g + color.b);
+}
+
+/**
+ * @return Nanoseconds per food
+ */
+[[nodiscard]] double time_per_food(const std::function<float()> &pass, float &sum) {
+    sum = pass();
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned int repeat = 0; repeat < FOOD_BENCH_REPEATS; repeat++) {
+        sum += pass();
+        asm volatile("" ::: "memory");
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / FOOD_BENCH_REPEATS / FOOD_BENCH_COUNT;
+}
+
+int main() {
+    std::mt19937 generator(0);
+    std::vector<std::unique_ptr<Food>> foods;
+    std::vector<std::unique_ptr<VirtualFood>> virtual_foods;
+    foods.reserve(FOOD_BENCH_COUNT);
+    virtual_foods.reserve(FOOD_BENCH_COUNT);
+    for (size_t index = 0; index < FOOD_BENCH_COUNT; index++) {
+        const bool plant = generator() % 4 != 0;
+        const Vector2 position = {(float) (generator() % 1000), (float) (generator() % 1000)};
+        foods.push_back(plant ? std::unique_ptr<Food>(std::make_unique<Plant>(16.0f, position)) : std::unique_ptr<Food>(std::make_unique<Meat>(16.0f, position)));
+        virtual_foods.push_back(plant ? std::unique_ptr<VirtualFood>(std::make_unique<VirtualPlant>()) : std::unique_ptr<VirtualFood>(std::make_unique<VirtualMeat>()));
+    }
+    // the same shuffle for both, so every food is compared with its own counterpart
+    std::vector<size_t> order(FOOD_BENCH_COUNT);
+    for (size_t index = 0; index < FOOD_BENCH_COUNT; index++) {
+        order[index] = index;
+    }
+    std::shuffle(order.begin(), order.end(), generator);
+    std::vector<const Food*> shuffled_foods;
+    std::vector<const VirtualFood*> shuffled_virtual_foods;
+    for (const size_t index: order) {
+        shuffled_foods.push_back(foods[index].get());
+        shuffled_virtual_foods.push_back(virtual_foods[index].get());
+    }
+
+    bool passed = true;
+    for (size_t index = 0; index < FOOD_BENCH_COUNT; index++) {
+        passed = query(shuffled_foods[index]) == query(shuffled_virtual_foods[index]) and passed;
+    }
+
+    float sum = 0.0f;
+    float virtual_sum = 0.0f;
+    const double tagged = time_per_food([&]() {
+        float pass_sum = 0.0f;
+        for (const Food* food: shuffled_foods) {
+            pass_sum += query(food);
+        }
+        return pass_sum;
+    }, sum);
+    const double virtual_dispatch = time_per_food([&]() {
+        float pass_sum = 0.0f;
+        for (const VirtualFood* food: shuffled_virtual_foods) {
+            pass_sum += query(food);
+        }
+        return pass_sum;
+    }, virtual_sum);
+    std::printf("%-44s %s\n", "type tag and virtual answers match", passed ? "ok" : "FAILED");
+    std::printf("%-14s %8s %8s\n", "ns per food", "tag", "virtual");
+    std::printf("%-14s %8.2f %8.2f\n", "queries", tagged, virtual_dispatch);
+    return passed and sum == virtual_sum ? 0 : 1;
+}
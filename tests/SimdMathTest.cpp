@@ -0,0 +1,172 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <functional>
+
+
+#include "SimdMath.hpp"
+
+
+/*
+ * Checks the documented error bounds of SimdMath.hpp against double precision libm and times every kernel against
+ * the libm loop it replaces
+ * Inputs are every SIMD_MATH_TEST_STRIDE-th float bit pattern in a range, so every exponent is covered evenly. The
+ * documented bounds are the maxima over every float (a stride of 1, about five minutes).
+ */
+
+
+constexpr std::uint32_t SIMD_MATH_TEST_STRIDE = 61;
+constexpr size_t SIMD_MATH_TEST_BATCH = 4096;
+constexpr unsigned int SIMD_MATH_BENCH_REPEATS = 2000;
+
+
+class ErrorBound {
+public:
+    const char* name;
+    double bound;
+    double measured = 0.0;
+
+    void add(const double error) {
+        this->measured = std::max(this->measured, error);
+    }
+
+    /**
+     * @return Whether the measured error is within the bound
+     */
+    bool report() const {
+        const bool passed = this->measured <= this->bound;
+        std::printf("%-44s %.3g (bound %.3g) %s\n", this->name, this->measured, this->bound, passed ? "ok" : "FAILED");
+        return passed;
+    }
+};
+
+
+[[nodiscard]] float float_from_bits(const std::uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(float));
+    return value;
+}
+
+/**
+ * Call check with batches of the normal floats in [-limit, limit]
+ */
+void for_each_batch(const float limit, const std::function<void(const std::vector<float>&)> &check) {
+    std::vector<float> inputs;
+    inputs.reserve(SIMD_MATH_TEST_BATCH);
+    for (const std::uint32_t sign: {0u, 0x80000000u}) {
+        for (std::uint32_t bits = 0x00800000u; bits < 0x7f800000u; bits += SIMD_MATH_TEST_STRIDE) {
+            const float value = float_from_bits(bits | sign);
+            if (std::abs(value) > limit) {
+                break;
+            }
+            inputs.push_back(value);
+            if (inputs.size() == SIMD_MATH_TEST_BATCH) {
+                check(inputs);
+                inputs.clear();
+            }
+        }
+    }
+    if (!inputs.empty()) {
+        check(inputs);
+    }
+}
+
+/**
+ * @return Nanoseconds per value
+ */
+[[nodiscard]] double time_per_value(const std::function<void()> &kernel) {
+    kernel();
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned int repeat = 0; repeat < SIMD_MATH_BENCH_REPEATS; repeat++) {
+        kernel();
+        asm volatile("" ::: "memory");
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / SIMD_MATH_BENCH_REPEATS / SIMD_MATH_TEST_BATCH;
+}
+
+bool check_bounds() {
+    std::vector<float> outputs(SIMD_MATH_TEST_BATCH);
+    std::vector<float> second_outputs(SIMD_MATH_TEST_BATCH);
+
+    ErrorBound exp_error{"batch_exp relative error", 8.4e-8};
+    for_each_batch(SIMD_MATH_EXP_MAX_INPUT, [&](const std::vector<float> &inputs) {
+        batch_exp(inputs.data(), outputs.data(), inputs.size());
+        for (size_t index = 0; index < inputs.size(); index++) {
+            if (inputs[index] < SIMD_MATH_EXP_MIN_INPUT) {
+                continue;
+            }
+            const double expected = std::exp((double) inputs[index]);
+            exp_error.add(std::abs(outputs[index] - expected) / expected);
+        }
+    });
+
+    ErrorBound sigmoid_error{"batch_sigmoid absolute error", 9e-8};
+    for_each_batch(INFINITY, [&](const std::vector<float> &inputs) {
+        batch_sigmoid(inputs.data(), outputs.data(), inputs.size());
+        for (size_t index = 0; index < inputs.size(); index++) {
+            sigmoid_error.add(std::abs(outputs[index] - 1.0 / (1.0 + std::exp(-(double) inputs[index]))));
+        }
+    });
+
+    ErrorBound tanh_error{"batch_tanh absolute error", 1.8e-7};
+    ErrorBound tanh_relative_error{"batch_tanh relative error", 2.8e-7};
+    for_each_batch(INFINITY, [&](const std::vector<float> &inputs) {
+        batch_tanh(inputs.data(), outputs.data(), inputs.size());
+        for (size_t index = 0; index < inputs.size(); index++) {
+            const double expected = std::tanh((double) inputs[index]);
+            tanh_error.add(std::abs(outputs[index] - expected));
+            tanh_relative_error.add(std::abs(outputs[index] - expected) / std::abs(expected));
+        }
+    });
+
+    ErrorBound sincos_error{"batch_sincos absolute error, |x| <= 10000", 9.4e-8};
+    ErrorBound far_sincos_error{"batch_sincos absolute error, |x| <= 100000", 9.7e-7};
+    for_each_batch(100000.0f, [&](const std::vector<float> &inputs) {
+        batch_sincos(inputs.data(), outputs.data(), second_outputs.data(), inputs.size());
+        for (size_t index = 0; index < inputs.size(); index++) {
+            const double error = std::max(std::abs(outputs[index] - std::sin((double) inputs[index])), std::abs(second_outputs[index] - std::cos((double) inputs[index])));
+            far_sincos_error.add(error);
+            if (std::abs(inputs[index]) <= 10000.0f) {
+                sincos_error.add(error);
+            }
+        }
+    });
+
+    bool passed = true;
+    for (const ErrorBound* bound: {&exp_error, &sigmoid_error, &tanh_error, &tanh_relative_error, &sincos_error, &far_sincos_error}) {
+        passed = bound->report() and passed;
+    }
+    return passed;
+}
+
+void benchmark() {
+    std::vector<float> inputs(SIMD_MATH_TEST_BATCH);
+    std::vector<float> outputs(SIMD_MATH_TEST_BATCH);
+    std::vector<float> second_outputs(SIMD_MATH_TEST_BATCH);
+    for (size_t index = 0; index < SIMD_MATH_TEST_BATCH; index++) {
+        inputs[index] = ((float) index - (float) SIMD_MATH_TEST_BATCH / 2.0f) * 0.01f;
+    }
+    const size_t count = SIMD_MATH_TEST_BATCH;
+    const double exp_batch = time_per_value([&]() { batch_exp(inputs.data(), outputs.data(), count); });
+    const double exp_libm = time_per_value([&]() { for (size_t index = 0; index < count; index++) { outputs[index] = std::exp(inputs[index]); } });
+    const double sigmoid_batch = time_per_value([&]() { batch_sigmoid(inputs.data(), outputs.data(), count); });
+    const double sigmoid_libm = time_per_value([&]() { for (size_t index = 0; index < count; index++) { outputs[index] = 1.0f / (1.0f + std::exp(-inputs[index])); } });
+    const double tanh_batch = time_per_value([&]() { batch_tanh(inputs.data(), outputs.data(), count); });
+    const double tanh_libm = time_per_value([&]() { for (size_t index = 0; index < count; index++) { outputs[index] = std::tanh(inputs[index]); } });
+    const double sincos_batch = time_per_value([&]() { batch_sincos(inputs.data(), outputs.data(), second_outputs.data(), count); });
+    const double sincos_libm = time_per_value([&]() { for (size_t index = 0; index < count; index++) { outputs[index] = std::sin(inputs[index]); second_outputs[index] = std::cos(inputs[index]); } });
+    std::printf("%-14s %8s %8s\n", "ns per value", "batch", "libm");
+    std::printf("%-14s %8.2f %8.2f\n", "exp", exp_batch, exp_libm);
+    std::printf("%-14s %8.2f %8.2f\n", "sigmoid", sigmoid_batch, sigmoid_libm);
+    std::printf("%-14s %8.2f %8.2f\n", "tanh", tanh_batch, tanh_libm);
+    std::printf("%-14s %8.2f %8.2f\n", "sincos", sincos_batch, sincos_libm);
+}
+
+int main() {
+    const bool passed = check_bounds();
+    benchmark();
+    return passed ? 0 : 1;
+}